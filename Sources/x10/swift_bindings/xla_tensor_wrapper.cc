@@ -21,10 +21,15 @@
 #include "tensorflow/compiler/tf2xla/xla_tensor/layout_manager.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/ops.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/token.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/recompile_diagnostics.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/shape_buckets.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/strided_slice_helpers.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/tensor.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/tensor_util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/aten_compat.h"
+#include "tensorflow/compiler/xla/xla_client/metrics_exporter.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
 #include "tensorflow/core/util/mirror_pad_mode.h"
 
 using swift_xla::XlaHelpers;
@@ -162,6 +167,47 @@ OpaqueXLATensor* copyTensorAndMakeResident(enum XLATensorScalarType type,
   return copyTensor(type, value, num_entries, shape, rank, cdevice);
 }
 
+void SetShapeBuckets(int64_t dim, const int64_t* sizes, size_t num_sizes) {
+  swift_xla::ShapeBuckets::SetDimensionBuckets(
+      dim, std::vector<xla::int64>(sizes, sizes + num_sizes));
+}
+void ClearShapeBuckets() { swift_xla::ShapeBuckets::ClearDimensionBuckets(); }
+OpaqueXLATensor* copyTensorToBucketAndMakeResident(
+    enum XLATensorScalarType type, const void* value, size_t num_entries,
+    const size_t* shape, size_t rank, const struct CDevice cdevice,
+    bool to_reduced_precision, OpaqueXLATensor** lengths) {
+  std::vector<xla::int64> dims(shape, shape + rank);
+  std::vector<int64_t> length_values(shape, shape + rank);
+  size_t lengths_shape = rank;
+  *lengths = copyTensorAndMakeResident(
+      XLATensorScalarType_Int64, length_values.data(), length_values.size(),
+      &lengths_shape, 1, cdevice, /*to_reduced_precision=*/false);
+  std::vector<xla::int64> padded_dims =
+      swift_xla::ShapeBuckets::GetPaddedDimensions(dims);
+  if (padded_dims == dims) {
+    return copyTensorAndMakeResident(type, value, num_entries, shape, rank,
+                                     cdevice, to_reduced_precision);
+  }
+  size_t element_size = 0;
+  switch (type) {
+#define DEFINE_SIZE_CASE(name, aten_name, DType) \
+  case XLATensorScalarType_##name:               \
+    element_size = sizeof(DType);                \
+    break;
+    LIST_SCALAR_TYPES(DEFINE_SIZE_CASE)
+#undef DEFINE_SIZE_CASE
+  }
+  std::vector<size_t> padded_shape(padded_dims.begin(), padded_dims.end());
+  size_t padded_num_entries = xla::util::Multiply<size_t>(padded_shape);
+  std::unique_ptr<char[]> padded_value(
+      new char[padded_num_entries * element_size]);
+  swift_xla::ShapeBuckets::PadData(value, dims, padded_value.get(),
+                                   padded_dims, element_size);
+  return copyTensorAndMakeResident(type, padded_value.get(),
+                                   padded_num_entries, padded_shape.data(),
+                                   rank, cdevice, to_reduced_precision);
+}
+
 const void* MaterializedTensor_getData(OpaqueMaterializedTensor* t) {
   return t->buffer().raw_data();
 }
@@ -774,6 +820,51 @@ StridedSliceSpec* ComputeIndexingBoundsAndStrides(
 }
 void PrintMetrics() {
   LOG(INFO) << "Metrics:\n" << xla::metrics::CreateMetricReport();
+  if (swift_xla::RecompileDiagnostics::Enabled()) {
+    LOG(INFO) << "Recompile causes:\n"
+              << swift_xla::RecompileDiagnostics::CreateReport();
+  }
+}
+bool StartMetricsExport(const char* path, const char* format,
+                        int64_t period_ms) {
+  xla::metrics_exporter::Format export_format;
+  if (!xla::metrics_exporter::ParseFormat(format, &export_format)) {
+    TF_LOG(ERROR) << "Invalid metrics export format: " << format;
+    return false;
+  }
+  if (period_ms > 0) {
+    xla::metrics_exporter::StartPeriodicExport(path, export_format, period_ms);
+  } else {
+    xla::metrics_exporter::WriteReport(path, export_format);
+  }
+  return true;
+}
+void StopMetricsExport() { xla::metrics_exporter::StopPeriodicExport(); }
+void StartTraceEvents(const char* path, int64_t num_steps) {
+  xla::trace_events::StartTracing(path, num_steps);
+}
+void StopTraceEvents() { xla::trace_events::StopTracing(); }
+OpaqueXLACapturedGraph* CaptureTensorsGraph(
+    OpaqueXLATensorArrayRef outputs, OpaqueXLATensorArrayRef inputs,
+    OpaqueXLACapturedGraph* previous) {
+  std::vector<XLATensor> outputs_array = outputs.array();
+  auto graph = XLATensor::CaptureTensorsGraph(
+      &outputs_array, inputs.array(),
+      previous != nullptr ? previous->get() : nullptr);
+  return graph != nullptr ? new OpaqueXLACapturedGraph(std::move(graph))
+                          : nullptr;
+}
+bool ReplayTensorsGraph(OpaqueXLACapturedGraph* graph,
+                        OpaqueXLATensorArrayRef inputs,
+                        OpaqueXLATensorArrayRef* outputs) {
+  std::vector<XLATensor> outputs_array;
+  if (!XLATensor::ReplayTensorsGraph(graph->get(), inputs.array(),
+                                     &outputs_array)) {
+    return false;
+  }
+  *outputs = ConvertTensorList(outputs_array);
+  return true;
 }
+void destroyCapturedGraph(OpaqueXLACapturedGraph* graph) { delete graph; }
 void DeleteString(OpaqueString* str) { delete str; }
 const char* GetStringCStr(OpaqueString* str) { return str->c_str(); }
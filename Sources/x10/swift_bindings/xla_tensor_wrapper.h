@@ -30,6 +30,8 @@ using OpaqueXLATensor = swift_xla::XLATensor;
 using OpaqueXLAShape = xla::util::MaybeRef<xla::Shape>;
 using XLAAnnotationScope = tensorflow::profiler::TraceMe;
 using OpaqueString = std::string;
+using OpaqueXLACapturedGraph =
+    std::shared_ptr<swift_xla::XLATensor::CapturedGraph>;
 extern "C" {
 #else
 typedef struct OpaqueXLATensor {
@@ -42,6 +44,8 @@ typedef struct XLAAnnotationScope {
 } XLAAnnotationScope;
 typedef struct OpaqueString {
 } OpaqueString;
+typedef struct OpaqueXLACapturedGraph {
+} OpaqueXLACapturedGraph;
 #endif
 
 XLAAnnotationScope* MakeAnnotationScope(const char* scope);
@@ -99,6 +103,21 @@ OpaqueXLATensor* copyTensorAndMakeResident(enum XLATensorScalarType type,
                                            const size_t* shape, size_t rank,
                                            const struct CDevice device,
                                            bool to_reduced_precision);
+// Registers the bucket sizes of the dim dimension (counting from the last one,
+// if negative) of the tensors created by copyTensorToBucketAndMakeResident().
+// An empty list of sizes removes the bucketing of the dimension.
+void SetShapeBuckets(int64_t dim, const int64_t* sizes, size_t num_sizes);
+void ClearShapeBuckets();
+// Same as copyTensorAndMakeResident(), but the dimensions with registered
+// bucket sizes are padded with zeros, up to their smallest bucket size which
+// fits them. This bounds the number of distinct shapes (and of compilations)
+// produced by variable size inputs. The original dimensions are returned in
+// the lengths tensor (of Int64 type, and rank elements), which lives on the
+// device, so that using it to mask the padding does not change the graphs.
+OpaqueXLATensor* copyTensorToBucketAndMakeResident(
+    enum XLATensorScalarType type, const void* value, size_t num_entries,
+    const size_t* shape, size_t rank, const struct CDevice device,
+    bool to_reduced_precision, OpaqueXLATensor** lengths);
 void destroyTensor(OpaqueXLATensor* t);
 OpaqueMaterializedTensor* XLATensor_materialize(OpaqueXLATensor* t);
 void destroyMaterializedTensor(OpaqueMaterializedTensor* t);
@@ -409,6 +428,41 @@ StridedSliceSpec* ComputeIndexingBoundsAndStrides(
 
 void PrintMetrics();
 
+// Writes machine readable reports of the metrics and counters into the path
+// file, every period_ms milliseconds from a background thread, or only once
+// (synchronously) if period_ms is 0. The format is either "openmetrics" or
+// "json". Returns false, without exporting anything, for invalid formats.
+bool StartMetricsExport(const char* path, const char* format,
+                        int64_t period_ms);
+// Stops the periodic metrics export, writing a last report.
+void StopMetricsExport();
+
+// Records a Chrome trace event timeline of the next num_steps steps (or until
+// StopTraceEvents() is called, if num_steps is 0) into the path file. An
+// active recording is written, and restarted.
+void StartTraceEvents(const char* path, int64_t num_steps);
+// Stops the trace event recording, writing the recorded events.
+void StopTraceEvents();
+
+// Syncs the outputs tensors of a traced step, and captures its computation
+// along with the bindings of the inputs and outputs tensors, so that the
+// following steps can be replayed without being traced. Every tensor the step
+// reads (like the weights), and every non special scalar value (0 and +/-1
+// are special), needs to be passed among the inputs. Returns nullptr if the
+// step cannot be captured. If previous is not null, the traced step is
+// validated against the previously captured one, which is never replayed
+// again if they diverge.
+OpaqueXLACapturedGraph* CaptureTensorsGraph(
+    OpaqueXLATensorArrayRef outputs, OpaqueXLATensorArrayRef inputs,
+    OpaqueXLACapturedGraph* previous);
+// Replays a captured step over new inputs tensors, storing the new outputs
+// tensors into outputs. Returns false, leaving outputs untouched, if the step
+// needs to be traced and captured again.
+bool ReplayTensorsGraph(OpaqueXLACapturedGraph* graph,
+                        OpaqueXLATensorArrayRef inputs,
+                        OpaqueXLATensorArrayRef* outputs);
+void destroyCapturedGraph(OpaqueXLACapturedGraph* graph);
+
 // Randomly shuffles the array defined by (data, size) by seed and then
 // returns the result.
 void SeededRandomShuffle(size_t* data, size_t size, int64_t seed);
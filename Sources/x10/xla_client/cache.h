@@ -17,14 +17,22 @@
 #ifndef X10_XLA_CLIENT_CACHE_H_
 #define X10_XLA_CLIENT_CACHE_H_
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
+#include <limits>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/types.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
 
 namespace xla {
 namespace util {
@@ -123,6 +131,235 @@ class Cache {
   ElementMap element_map_;
 };
 
+// Key and object cache with LRU expiration policy, which splits the entries
+// among a number of shards, each one with its own lock, so that threads
+// accessing different keys do not contend on a single mutex.
+// Besides the maximum number of entries, the cache can be bounded by a total
+// cost, as computed by the cost function provided at construction time (for
+// example, the size in bytes of the cached object). A zero max_size or max_cost
+// means no limit for that budget. The budgets are enforced over the whole
+// cache, evicting the globally least recently used entries, so that the key
+// distribution skew among the shards does not cause early evictions. Objects
+// whose cost alone exceeds max_cost are returned by Add(), but not stored.
+// The cache exports the <name>Hits, <name>Misses, <name>Evictions and
+// <name>Rejected counters, and the <name>ResidentCost gauge tracking the total
+// cost of the stored objects. Caches created with the same name share them.
+template <typename K, typename T, typename H = std::hash<K>,
+          typename E = std::equal_to<K>>
+class ShardedCache {
+ public:
+  using TypePtr = std::shared_ptr<T>;
+  using CostFn = std::function<int64(const K&, const T&)>;
+
+  ShardedCache(const std::string& name, size_t max_size, int64 max_cost = 0,
+               CostFn cost_fn = nullptr, size_t num_shards = 16)
+      : max_size_(max_size),
+        max_cost_(max_cost),
+        cost_fn_(std::move(cost_fn)),
+        hits_(absl::StrCat(name, "Hits")),
+        misses_(absl::StrCat(name, "Misses")),
+        evictions_(absl::StrCat(name, "Evictions")),
+        rejections_(absl::StrCat(name, "Rejected")),
+        resident_cost_(absl::StrCat(name, "ResidentCost")) {
+    num_shards = std::max<size_t>(num_shards, 1);
+    shards_.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+      shards_.emplace_back(new Shard());
+    }
+  }
+
+  ~ShardedCache() { Clear(); }
+
+  // Adds an object to the cache, unless it already exists, in which case the
+  // existing object is returned. If the cache grows beyond its limits, the
+  // least recently used objects will be removed from it.
+  TypePtr Add(K key, TypePtr object) {
+    int64 cost = cost_fn_ != nullptr ? cost_fn_(key, *object) : 1;
+    if (max_cost_ > 0 && cost > max_cost_) {
+      rejections_.AddValue(1);
+      return object;
+    }
+    Shard* shard = GetShard(key);
+    TypePtr result;
+    {
+      std::lock_guard<std::mutex> slock(shard->lock);
+      shard->element_list.emplace_front(
+          Element{std::move(key), std::move(object), cost, 0});
+      auto it = shard->element_list.begin();
+      auto emplace_result = shard->element_map.emplace(&it->key, it);
+      if (!emplace_result.second) {
+        shard->element_list.erase(it);
+        DoLRU(shard, emplace_result.first->second);
+        return emplace_result.first->second->object;
+      }
+      it->last_use = clock_.fetch_add(1);
+      result = it->object;
+      size_ += 1;
+      cost_ += cost;
+    }
+    resident_cost_.AddValue(cost);
+    EvictOverBudget();
+    return result;
+  }
+
+  // Retrieves the existing object if it exists, moving it to the head of its
+  // shard LRU list. Returns nullptr if no object with the specified key is
+  // found within the cache.
+  TypePtr Get(const K& key) {
+    Shard* shard = GetShard(key);
+    std::lock_guard<std::mutex> slock(shard->lock);
+    auto it = shard->element_map.find(&key);
+    if (it == shard->element_map.end()) {
+      misses_.AddValue(1);
+      return nullptr;
+    }
+    hits_.AddValue(1);
+    DoLRU(shard, it->second);
+    return it->second->object;
+  }
+
+  bool Erase(const K& key) {
+    Shard* shard = GetShard(key);
+    std::lock_guard<std::mutex> slock(shard->lock);
+    auto it = shard->element_map.find(&key);
+    if (it == shard->element_map.end()) {
+      return false;
+    }
+    auto lit = it->second;
+    RemoveCost(lit->cost);
+    shard->element_map.erase(it);
+    shard->element_list.erase(lit);
+    return true;
+  }
+
+  void Clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> slock(shard->lock);
+      for (auto& element : shard->element_list) {
+        RemoveCost(element.cost);
+      }
+      shard->element_map.clear();
+      shard->element_list.clear();
+    }
+  }
+
+ private:
+  struct Element {
+    K key;
+    TypePtr object;
+    int64 cost;
+    // The cache wide LRU clock value at the last access of the element.
+    uint64 last_use;
+  };
+
+  using ElementList = std::list<Element>;
+
+  struct Hasher {
+    size_t operator()(const K* key) const { return hasher(*key); }
+
+    H hasher;
+  };
+
+  struct Equaler {
+    bool operator()(const K* k1, const K* k2) const {
+      return equaler(*k1, *k2);
+    }
+
+    E equaler;
+  };
+
+  using ElementMap =
+      absl::flat_hash_map<const K*, typename ElementList::iterator, Hasher,
+                          Equaler>;
+
+  struct Shard {
+    std::mutex lock;
+    ElementList element_list;
+    ElementMap element_map;
+  };
+
+  Shard* GetShard(const K& key) const {
+    // The same hash is used by the shard maps, so mix it before selecting the
+    // shard, in order not to correlate the shard index with the map buckets.
+    size_t hash = H()(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return shards_[hash % shards_.size()].get();
+  }
+
+  // Must be called with the shard lock held. Since the clock is read under the
+  // shard lock, the last_use values are decreasing along each shard list.
+  void DoLRU(Shard* shard, typename ElementList::iterator it) {
+    it->last_use = clock_.fetch_add(1);
+    shard->element_list.splice(shard->element_list.begin(),
+                               shard->element_list, it);
+  }
+
+  void RemoveCost(int64 cost) {
+    size_ -= 1;
+    cost_ -= cost;
+    resident_cost_.AddValue(-cost);
+  }
+
+  bool OverBudget() const {
+    size_t size = size_.load();
+    // Like the max_cost check in Add(), always leave room for one entry.
+    return size > 1 && ((max_size_ > 0 && size > max_size_) ||
+                        (max_cost_ > 0 && cost_.load() > max_cost_));
+  }
+
+  // Evicts the least recently used entries of the whole cache, until both
+  // budgets are met. The oldest entry is the oldest among the shard tails.
+  void EvictOverBudget() {
+    if (!OverBudget()) {
+      return;
+    }
+    std::lock_guard<std::mutex> elock(evict_lock_);
+    while (OverBudget()) {
+      Shard* victim = nullptr;
+      uint64 victim_use = std::numeric_limits<uint64>::max();
+      for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> slock(shard->lock);
+        if (!shard->element_list.empty() &&
+            shard->element_list.back().last_use < victim_use) {
+          victim = shard.get();
+          victim_use = shard->element_list.back().last_use;
+        }
+      }
+      if (victim == nullptr) {
+        break;
+      }
+      // The tail might have been accessed or removed after the scan, in which
+      // case the scan is simply repeated.
+      std::lock_guard<std::mutex> slock(victim->lock);
+      if (victim->element_list.empty() ||
+          victim->element_list.back().last_use != victim_use) {
+        continue;
+      }
+      Element* last = &victim->element_list.back();
+      RemoveCost(last->cost);
+      evictions_.AddValue(1);
+      victim->element_map.erase(&last->key);
+      victim->element_list.pop_back();
+    }
+  }
+
+  size_t max_size_ = 0;
+  int64 max_cost_ = 0;
+  CostFn cost_fn_;
+  std::atomic<size_t> size_{0};
+  std::atomic<int64> cost_{0};
+  std::atomic<uint64> clock_{0};
+  std::mutex evict_lock_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  metrics::Counter hits_;
+  metrics::Counter misses_;
+  metrics::Counter evictions_;
+  metrics::Counter rejections_;
+  metrics::Gauge resident_cost_;
+};
+
 }  // namespace util
 }  // namespace xla
 
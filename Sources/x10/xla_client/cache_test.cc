@@ -0,0 +1,173 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/cache.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace xla {
+namespace util {
+namespace {
+
+using StringCache = ShardedCache<int, std::string>;
+
+int64 CounterValue(const std::string& name) {
+  metrics::CounterData* data = metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+int64 GaugeValue(const std::string& name) {
+  metrics::CounterData* data = metrics::GetGauge(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+std::shared_ptr<std::string> MakeValue(int key) {
+  return std::make_shared<std::string>(std::to_string(key));
+}
+
+TEST(ShardedCacheTest, HoldsMaxSizeEntries) {
+  // The size budget is global, so a full cache must not lose entries to the
+  // key distribution skew among the shards.
+  StringCache cache("TestFullCache", 256);
+  for (int i = 0; i < 256; ++i) {
+    cache.Add(i, MakeValue(i));
+  }
+  for (int i = 0; i < 256; ++i) {
+    auto value = cache.Get(i);
+    ASSERT_NE(value, nullptr) << i;
+    EXPECT_EQ(*value, std::to_string(i));
+  }
+  EXPECT_EQ(CounterValue("TestFullCacheEvictions"), 0);
+  EXPECT_EQ(CounterValue("TestFullCacheHits"), 256);
+  EXPECT_EQ(GaugeValue("TestFullCacheResidentCost"), 256);
+}
+
+TEST(ShardedCacheTest, EvictsLeastRecentlyUsed) {
+  StringCache cache("TestLruCache", 64);
+  for (int i = 0; i < 64; ++i) {
+    cache.Add(i, MakeValue(i));
+  }
+  // Touch the first half, so that the second half becomes the oldest.
+  for (int i = 0; i < 32; ++i) {
+    ASSERT_NE(cache.Get(i), nullptr);
+  }
+  for (int i = 64; i < 96; ++i) {
+    cache.Add(i, MakeValue(i));
+  }
+  for (int i = 0; i < 32; ++i) {
+    EXPECT_NE(cache.Get(i), nullptr) << i;
+  }
+  for (int i = 32; i < 64; ++i) {
+    EXPECT_EQ(cache.Get(i), nullptr) << i;
+  }
+  for (int i = 64; i < 96; ++i) {
+    EXPECT_NE(cache.Get(i), nullptr) << i;
+  }
+  EXPECT_EQ(CounterValue("TestLruCacheEvictions"), 32);
+  EXPECT_EQ(GaugeValue("TestLruCacheResidentCost"), 64);
+}
+
+TEST(ShardedCacheTest, AddReturnsExistingObject) {
+  StringCache cache("TestExistingCache", 16);
+  auto first = cache.Add(1, MakeValue(1));
+  auto second = cache.Add(1, std::make_shared<std::string>("other"));
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(GaugeValue("TestExistingCacheResidentCost"), 1);
+}
+
+TEST(ShardedCacheTest, EnforcesCostBudget) {
+  StringCache cache(
+      "TestCostCache", /*max_size=*/0, /*max_cost=*/1000,
+      [](const int& key, const std::string& value) { return key; });
+  // Objects above the per shard share of the budget, but within the total
+  // one, must still be stored.
+  cache.Add(600, MakeValue(600));
+  EXPECT_NE(cache.Get(600), nullptr);
+  cache.Add(300, MakeValue(300));
+  EXPECT_EQ(GaugeValue("TestCostCacheResidentCost"), 900);
+  // Going over the budget evicts the least recently used object.
+  cache.Add(200, MakeValue(200));
+  EXPECT_EQ(cache.Get(600), nullptr);
+  EXPECT_NE(cache.Get(300), nullptr);
+  EXPECT_NE(cache.Get(200), nullptr);
+  EXPECT_EQ(GaugeValue("TestCostCacheResidentCost"), 500);
+  EXPECT_EQ(CounterValue("TestCostCacheEvictions"), 1);
+
+  // Objects above the whole budget are returned, but not stored.
+  auto value = cache.Add(1001, MakeValue(1001));
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(*value, "1001");
+  EXPECT_EQ(cache.Get(1001), nullptr);
+  EXPECT_EQ(CounterValue("TestCostCacheRejected"), 1);
+  EXPECT_EQ(GaugeValue("TestCostCacheResidentCost"), 500);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Get(300), nullptr);
+  EXPECT_EQ(GaugeValue("TestCostCacheResidentCost"), 0);
+}
+
+TEST(ShardedCacheTest, Erase) {
+  StringCache cache("TestEraseCache", 16);
+  cache.Add(1, MakeValue(1));
+  cache.Add(2, MakeValue(2));
+  EXPECT_TRUE(cache.Erase(1));
+  EXPECT_FALSE(cache.Erase(1));
+  EXPECT_EQ(cache.Get(1), nullptr);
+  EXPECT_NE(cache.Get(2), nullptr);
+  EXPECT_EQ(GaugeValue("TestEraseCacheResidentCost"), 1);
+}
+
+TEST(ShardedCacheTest, ConcurrentGetAndAdd) {
+  const int kNumThreads = 8;
+  const int kNumKeys = 512;
+  const int kMaxSize = 128;
+  {
+    StringCache cache("TestConcurrentCache", kMaxSize);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; ++t) {
+      threads.emplace_back([&cache, t]() {
+        for (int i = 0; i < 4 * kNumKeys; ++i) {
+          int key = (i * 7 + t * 13) % kNumKeys;
+          auto value = cache.Get(key);
+          if (value == nullptr) {
+            value = cache.Add(key, MakeValue(key));
+          }
+          ASSERT_EQ(*value, std::to_string(key));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    int64 resident = GaugeValue("TestConcurrentCacheResidentCost");
+    EXPECT_LE(resident, kMaxSize);
+    int64 found = 0;
+    for (int i = 0; i < kNumKeys; ++i) {
+      found += cache.Get(i) != nullptr ? 1 : 0;
+    }
+    EXPECT_EQ(found, resident);
+  }
+  // The destructor releases the whole resident cost.
+  EXPECT_EQ(GaugeValue("TestConcurrentCacheResidentCost"), 0);
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace xla
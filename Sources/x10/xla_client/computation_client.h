@@ -130,6 +130,10 @@ class ComputationClient {
     std::string compilation_device;
     std::vector<std::string> devices;
     const Shape* output_shape = nullptr;
+    // The hash of the graph the computation has been lowered from, if known.
+    // Computation protos embed process specific IDs, so clients persisting
+    // compilation results across runs need it in order to build stable keys.
+    absl::optional<size_t> graph_hash;
   };
 
   struct ExecuteOptions {
@@ -244,6 +248,10 @@ class ComputationClient {
   virtual std::vector<DataPtr> ExecuteChained(
       absl::Span<const ExecuteChainedOp> ops, const std::string& device) = 0;
 
+  // Whether the ExecuteChained() API is implemented, which the features
+  // running graphs op-by-op (like the background compilation) depend upon.
+  virtual bool SupportsExecuteChained() const { return true; }
+
   virtual std::vector<std::vector<DataPtr>> DeconstructTuple(
       absl::Span<const DataPtr> tuples) = 0;
 
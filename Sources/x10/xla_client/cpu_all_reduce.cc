@@ -0,0 +1,381 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/cpu_all_reduce.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+
+#include "tensorflow/compiler/xla/primitive_util.h"
+#include "tensorflow/compiler/xla/service/custom_call_target_registry.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+#include "tensorflow/compiler/xla/xla_client/util.h"
+
+namespace xla {
+namespace cpu_all_reduce {
+namespace {
+
+// The decoded form of the descriptor built by EncodeDescriptor(). The layout
+// of the S64 array is:
+//
+//   op_id, kind, type, num_operands, element_count[num_operands],
+//   num_groups, { group_size, replica_id[group_size] }[num_groups]
+struct Descriptor {
+  int64 op_id = 0;
+  ReduceKind kind = ReduceKind::kSum;
+  PrimitiveType type = PRIMITIVE_TYPE_INVALID;
+  std::vector<int64> element_counts;
+  // The replicas of the group the calling replica belongs to.
+  std::vector<int64> group;
+};
+
+Descriptor DecodeDescriptor(const int64* data, int64 replica_id) {
+  Descriptor descriptor;
+  descriptor.op_id = data[0];
+  descriptor.kind = static_cast<ReduceKind>(data[1]);
+  descriptor.type = static_cast<PrimitiveType>(data[2]);
+  int64 num_operands = data[3];
+  descriptor.element_counts.assign(data + 4, data + 4 + num_operands);
+  const int64* groups = data + 4 + num_operands;
+  int64 num_groups = *groups++;
+  for (int64 i = 0; i < num_groups; ++i) {
+    int64 group_size = *groups++;
+    if (std::find(groups, groups + group_size, replica_id) !=
+        groups + group_size) {
+      descriptor.group.assign(groups, groups + group_size);
+    }
+    groups += group_size;
+  }
+  return descriptor;
+}
+
+struct Participant {
+  const void* const* inputs = nullptr;
+  void* const* outputs = nullptr;
+};
+
+// The run ID of the computation running on the current thread.
+thread_local int64 current_run_id = 0;
+
+// The meeting point of the members of a replica group, for a given execution
+// of an all-reduce operation.
+class Rendezvous {
+ public:
+  using Key = std::tuple<int64, int64, int64>;
+
+  Rendezvous(Key key, size_t size) : key_(key), participants_(size) {}
+
+  // Publishes the buffers of the rank-th member, and waits for all the other
+  // members to show up.
+  void Arrive(size_t rank, Participant participant) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    participants_[rank] = participant;
+    arrived_ += 1;
+    if (arrived_ == participants_.size()) {
+      cv_.notify_all();
+    } else {
+      cv_.wait(lock, [this] { return arrived_ == participants_.size(); });
+    }
+  }
+
+  // Waits for all the members to be done writing into the outputs of the other
+  // members. The last member to leave removes the rendezvous from the map,
+  // before releasing the others, so that their next execution of the same
+  // operation within the run meets on a new rendezvous.
+  void Leave();
+
+  // Only valid between Arrive() and Leave().
+  const std::vector<Participant>& participants() const {
+    return participants_;
+  }
+
+ private:
+  const Key key_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Participant> participants_;
+  size_t arrived_ = 0;
+  size_t left_ = 0;
+};
+
+struct RendezvousMap {
+  std::mutex mutex;
+  std::map<Rendezvous::Key, std::shared_ptr<Rendezvous>> map;
+};
+
+RendezvousMap* GetRendezvousMap() {
+  static RendezvousMap* rendezvous_map = new RendezvousMap();
+  return rendezvous_map;
+}
+
+std::shared_ptr<Rendezvous> GetRendezvous(int64 run_id, int64 op_id,
+                                          int64 group_leader,
+                                          size_t group_size) {
+  RendezvousMap* rendezvous_map = GetRendezvousMap();
+  Rendezvous::Key key(run_id, op_id, group_leader);
+  std::lock_guard<std::mutex> lock(rendezvous_map->mutex);
+  std::shared_ptr<Rendezvous>& rendezvous = rendezvous_map->map[key];
+  if (rendezvous == nullptr) {
+    rendezvous = std::make_shared<Rendezvous>(key, group_size);
+  }
+  return rendezvous;
+}
+
+void Rendezvous::Leave() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  left_ += 1;
+  if (left_ == participants_.size()) {
+    RendezvousMap* rendezvous_map = GetRendezvousMap();
+    {
+      std::lock_guard<std::mutex> map_lock(rendezvous_map->mutex);
+      rendezvous_map->map.erase(key_);
+    }
+    cv_.notify_all();
+  } else {
+    cv_.wait(lock, [this] { return left_ == participants_.size(); });
+  }
+}
+
+template <typename T, bool kIntegral = std::is_integral<T>::value>
+struct BitwiseOps {
+  static T Or(T a, T b) { return a | b; }
+  static T And(T a, T b) { return a & b; }
+};
+
+// EncodeDescriptor() rejects bitwise reductions of non integral types.
+template <typename T>
+struct BitwiseOps<T, false> {
+  static T Or(T a, T b) {
+    TF_LOG(FATAL) << "Invalid OR reduction type";
+    return a;
+  }
+  static T And(T a, T b) {
+    TF_LOG(FATAL) << "Invalid AND reduction type";
+    return a;
+  }
+};
+
+// Reduces the [start, end) slice of the operand-th array of all the members
+// into the first member's output, then copies the result to the other
+// members' outputs.
+template <typename T, typename F>
+void ReduceSliceWith(const std::vector<Participant>& participants,
+                     size_t operand, int64 start, int64 end,
+                     const F& reduce_fn) {
+  if (start >= end) {
+    return;
+  }
+  T* result = static_cast<T*>(participants[0].outputs[operand]) + start;
+  const T* first = static_cast<const T*>(participants[0].inputs[operand]);
+  std::copy(first + start, first + end, result);
+  int64 count = end - start;
+  for (size_t i = 1; i < participants.size(); ++i) {
+    const T* input =
+        static_cast<const T*>(participants[i].inputs[operand]) + start;
+    for (int64 j = 0; j < count; ++j) {
+      result[j] = reduce_fn(result[j], input[j]);
+    }
+  }
+  for (size_t i = 1; i < participants.size(); ++i) {
+    std::memcpy(static_cast<T*>(participants[i].outputs[operand]) + start,
+                result, count * sizeof(T));
+  }
+}
+
+template <typename T>
+void ReduceTypedSlice(ReduceKind kind,
+                      const std::vector<Participant>& participants,
+                      size_t operand, int64 start, int64 end) {
+  switch (kind) {
+    case ReduceKind::kSum:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                [](T a, T b) -> T { return a + b; });
+    case ReduceKind::kMul:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                [](T a, T b) -> T { return a * b; });
+    case ReduceKind::kMin:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                [](T a, T b) -> T { return std::min(a, b); });
+    case ReduceKind::kMax:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                [](T a, T b) -> T { return std::max(a, b); });
+    case ReduceKind::kOr:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                BitwiseOps<T>::Or);
+    case ReduceKind::kAnd:
+      return ReduceSliceWith<T>(participants, operand, start, end,
+                                BitwiseOps<T>::And);
+  }
+}
+
+void ReduceSlice(ReduceKind kind, PrimitiveType type,
+                 const std::vector<Participant>& participants, size_t operand,
+                 int64 start, int64 end) {
+  switch (type) {
+    case PRED:
+      return ReduceTypedSlice<bool>(kind, participants, operand, start, end);
+    case S8:
+      return ReduceTypedSlice<int8>(kind, participants, operand, start, end);
+    case U8:
+      return ReduceTypedSlice<uint8>(kind, participants, operand, start, end);
+    case S32:
+      return ReduceTypedSlice<int32>(kind, participants, operand, start, end);
+    case U32:
+      return ReduceTypedSlice<uint32>(kind, participants, operand, start, end);
+    case S64:
+      return ReduceTypedSlice<int64>(kind, participants, operand, start, end);
+    case U64:
+      return ReduceTypedSlice<uint64>(kind, participants, operand, start, end);
+    case BF16:
+      return ReduceTypedSlice<bfloat16>(kind, participants, operand, start,
+                                        end);
+    case F16:
+      return ReduceTypedSlice<half>(kind, participants, operand, start, end);
+    case F32:
+      return ReduceTypedSlice<float>(kind, participants, operand, start, end);
+    case F64:
+      return ReduceTypedSlice<double>(kind, participants, operand, start, end);
+    default:
+      TF_LOG(FATAL) << "Unsupported all-reduce type: "
+                    << PrimitiveType_Name(type);
+  }
+}
+
+bool IsSupportedType(PrimitiveType type) {
+  switch (type) {
+    case PRED:
+    case S8:
+    case U8:
+    case S32:
+    case U32:
+    case S64:
+    case U64:
+    case BF16:
+    case F16:
+    case F32:
+    case F64:
+      return true;
+    default:
+      return false;
+  }
+}
+
+metrics::Metric* AllReduceTimeMetric() {
+  static metrics::Metric* metric =
+      new metrics::Metric("CpuAllReduceTime", metrics::MetricFnTime);
+  return metric;
+}
+
+metrics::Metric* AllReduceBytesMetric() {
+  static metrics::Metric* metric =
+      new metrics::Metric("CpuAllReduceBytes", metrics::MetricFnBytes);
+  return metric;
+}
+
+}  // namespace
+
+const char* const kTarget = "x10_cpu_all_reduce";
+
+std::vector<int64> EncodeDescriptor(
+    ReduceKind kind, PrimitiveType type,
+    absl::Span<const int64> element_counts,
+    const std::vector<std::vector<int64>>& groups) {
+  XLA_CHECK(IsSupportedType(type))
+      << "Unsupported all-reduce type: " << PrimitiveType_Name(type);
+  XLA_CHECK((kind != ReduceKind::kOr && kind != ReduceKind::kAnd) ||
+            primitive_util::IsIntegralType(type) || type == PRED)
+      << "Bitwise all-reduce requires an integral type: "
+      << PrimitiveType_Name(type);
+  std::vector<int64> descriptor = {0, static_cast<int64>(kind),
+                                   static_cast<int64>(type),
+                                   static_cast<int64>(element_counts.size())};
+  descriptor.insert(descriptor.end(), element_counts.begin(),
+                    element_counts.end());
+  descriptor.push_back(groups.size());
+  for (auto& group : groups) {
+    XLA_CHECK(!group.empty());
+    descriptor.push_back(group.size());
+    descriptor.insert(descriptor.end(), group.begin(), group.end());
+  }
+  descriptor[0] = util::DataHash(descriptor.data() + 1,
+                                 (descriptor.size() - 1) * sizeof(int64));
+  return descriptor;
+}
+
+// The CPU custom call entry point. Executed concurrently by all the replicas,
+// each one on the thread running its own device computation.
+extern "C" void X10CpuAllReduce(void* out, const void** in) {
+  const int64* data = static_cast<const int64*>(in[0]);
+  int64 replica_id = *static_cast<const uint32*>(in[1]);
+  Descriptor descriptor = DecodeDescriptor(data, replica_id);
+  if (descriptor.group.empty()) {
+    TF_LOG(FATAL) << "Replica " << replica_id
+                  << " is not part of any all-reduce group";
+  }
+
+  void* const* outputs = static_cast<void* const*>(out);
+  const void* const* inputs = in + 2;
+  size_t rank = std::find(descriptor.group.begin(), descriptor.group.end(),
+                          replica_id) -
+                descriptor.group.begin();
+  size_t element_size = ShapeUtil::ByteSizeOfPrimitiveType(descriptor.type);
+  int64 num_bytes = 0;
+  for (int64 count : descriptor.element_counts) {
+    num_bytes += count * element_size;
+  }
+
+  metrics::TimedSection timed(AllReduceTimeMetric());
+  AllReduceBytesMetric()->AddSample(num_bytes);
+  XLA_COUNTER("CpuAllReduce", 1);
+  if (descriptor.group.size() == 1) {
+    for (size_t i = 0; i < descriptor.element_counts.size(); ++i) {
+      std::memcpy(outputs[i], inputs[i],
+                  descriptor.element_counts[i] * element_size);
+    }
+    return;
+  }
+
+  std::shared_ptr<Rendezvous> rendezvous =
+      GetRendezvous(current_run_id, descriptor.op_id, descriptor.group.front(),
+                    descriptor.group.size());
+  rendezvous->Arrive(rank, {inputs, outputs});
+  // Every member reduces its own slice of each array, and writes the result
+  // into the outputs of all the members.
+  const std::vector<Participant>& participants = rendezvous->participants();
+  size_t group_size = participants.size();
+  for (size_t i = 0; i < descriptor.element_counts.size(); ++i) {
+    int64 count = descriptor.element_counts[i];
+    int64 start = count * rank / group_size;
+    int64 end = count * (rank + 1) / group_size;
+    ReduceSlice(descriptor.kind, descriptor.type, participants, i, start, end);
+  }
+  rendezvous->Leave();
+}
+
+void SetRunId(int64 run_id) { current_run_id = run_id; }
+
+XLA_CPU_REGISTER_CUSTOM_CALL_TARGET_WITH_SYM("x10_cpu_all_reduce",
+                                             X10CpuAllReduce);
+
+}  // namespace cpu_all_reduce
+}  // namespace xla
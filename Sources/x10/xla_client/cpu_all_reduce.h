@@ -0,0 +1,75 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef X10_XLA_CLIENT_CPU_ALL_REDUCE_H_
+#define X10_XLA_CLIENT_CPU_ALL_REDUCE_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "tensorflow/compiler/xla/types.h"
+#include "tensorflow/compiler/xla/xla_data.pb.h"
+
+namespace xla {
+namespace cpu_all_reduce {
+
+// In-process cross replica all-reduce for the replicas of a computation running
+// on the CPU devices of the local client. Computations call it via a custom
+// call to the kTarget target, whose operands are:
+//
+//   0: The S64[N] descriptor returned by EncodeDescriptor().
+//   1: The U32[] replica ID, as returned by the xla::ReplicaId() operation.
+//   2..: The arrays to be reduced, all of the type recorded in the descriptor.
+//
+// The custom call result is a tuple with the reduced arrays, of the same shape
+// as the inputs. All the replicas of a group meet in shared memory. Every one
+// of them reduces a slice of the arrays over all the group members, and writes
+// the result into the outputs of all the members.
+
+extern const char* const kTarget;
+
+enum class ReduceKind {
+  kSum,
+  kMin,
+  kMax,
+  kMul,
+  kOr,
+  kAnd,
+};
+
+// Encodes the description of an all-reduce operation. The groups must list all
+// the replicas taking part to the computation (if the computation has no
+// explicit replica groups, a single group with all the replicas).
+// Replicas meet on an ID derived from the descriptor content, rather than on a
+// per lowering one, as every replica might have compiled its own copy of the
+// computation, and on the run ID of the execution (see SetRunId()). Operations
+// sharing the same ID within a run are still matched correctly, since the
+// replicas run them in the same order.
+std::vector<int64> EncodeDescriptor(
+    ReduceKind kind, PrimitiveType type,
+    absl::Span<const int64> element_counts,
+    const std::vector<std::vector<int64>>& groups);
+
+// Sets the run ID of the computations executed by the calling thread, which
+// must be the same for all the replicas of an execution, and distinct among
+// executions which can run concurrently. The all-reduce operations of distinct
+// runs never meet, even if their descriptors are the same.
+void SetRunId(int64 run_id);
+
+}  // namespace cpu_all_reduce
+}  // namespace xla
+
+#endif  // X10_XLA_CLIENT_CPU_ALL_REDUCE_H_
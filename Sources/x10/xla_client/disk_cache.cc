@@ -0,0 +1,254 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/disk_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+#include "tensorflow/compiler/xla/xla_client/util.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace xla {
+namespace util {
+namespace {
+
+constexpr char kEntrySuffix[] = ".x10c";
+constexpr uint32 kEntryMagic = 0x43303158;
+constexpr uint32 kEntryVersion = 1;
+
+// The entry header. Entries are only meant to be shared among processes
+// running on the same host, so the header is stored in native byte order.
+struct EntryHeader {
+  uint32 magic = kEntryMagic;
+  uint32 version = kEntryVersion;
+  uint64 key_size = 0;
+  uint64 payload_size = 0;
+  uint32 checksum = 0;
+  uint32 padding = 0;
+};
+
+uint32 ComputeChecksum(const std::string& key, const std::string& payload) {
+  uint32 crc = tensorflow::crc32c::Value(key.data(), key.size());
+  return tensorflow::crc32c::Extend(crc, payload.data(), payload.size());
+}
+
+std::string EncodeEntry(const std::string& key, const std::string& payload) {
+  EntryHeader header;
+  header.key_size = key.size();
+  header.payload_size = payload.size();
+  header.checksum = ComputeChecksum(key, payload);
+  std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.reserve(sizeof(header) + key.size() + payload.size());
+  data.append(key);
+  data.append(payload);
+  return data;
+}
+
+// Decodes the raw file content into the payload. Returns false if the content
+// is not a well formed entry for the given key.
+bool DecodeEntry(const std::string& data, const std::string& key,
+                 std::string* payload) {
+  EntryHeader header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kEntryMagic || header.version != kEntryVersion ||
+      header.key_size != key.size() ||
+      sizeof(header) + header.key_size + header.payload_size != data.size()) {
+    return false;
+  }
+  if (data.compare(sizeof(header), key.size(), key) != 0) {
+    return false;
+  }
+  *payload = data.substr(sizeof(header) + key.size());
+  return ComputeChecksum(key, *payload) == header.checksum;
+}
+
+metrics::Counter* DiskCacheHitCounter() {
+  static metrics::Counter* counter =
+      new metrics::Counter("PersistentCacheHit");
+  return counter;
+}
+
+metrics::Counter* DiskCacheMissCounter() {
+  static metrics::Counter* counter =
+      new metrics::Counter("PersistentCacheMiss");
+  return counter;
+}
+
+}  // namespace
+
+DiskCache::DiskCache(std::string path, int64 max_bytes)
+    : path_(std::move(path)), max_bytes_(max_bytes) {
+  XLA_CHECK_OK(tensorflow::Env::Default()->RecursivelyCreateDir(path_));
+  LoadIndex();
+}
+
+std::string DiskCache::GetEntryName(const std::string& key) const {
+  return absl::StrCat(absl::Hex(Hash(key), absl::kZeroPad16), kEntrySuffix);
+}
+
+void DiskCache::LoadIndex() {
+  tensorflow::Env* env = tensorflow::Env::Default();
+  std::vector<std::string> children;
+  XLA_CHECK_OK(env->GetChildren(path_, &children));
+  for (auto& name : children) {
+    if (!absl::EndsWith(name, kEntrySuffix)) {
+      continue;
+    }
+    tensorflow::FileStatistics stat;
+    if (env->Stat(tensorflow::io::JoinPath(path_, name), &stat).ok()) {
+      entries_[name] = {stat.length, stat.mtime_nsec};
+      total_bytes_ += stat.length;
+    }
+  }
+  TF_VLOG(2) << "Persistent cache at " << path_ << " has " << entries_.size()
+             << " entries, " << total_bytes_ << " bytes";
+}
+
+absl::optional<std::string> DiskCache::Get(
+    const std::string& key,
+    const std::function<bool(const std::string&)>& accept) {
+  std::string name = GetEntryName(key);
+  std::string data;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(name);
+    if (it == entries_.end()) {
+      // Another process sharing the directory might have added the entry.
+      if (!tensorflow::Env::Default()
+               ->FileExists(tensorflow::io::JoinPath(path_, name))
+               .ok()) {
+        DiskCacheMissCounter()->AddValue(1);
+        return absl::nullopt;
+      }
+      it = entries_.emplace(name, Entry()).first;
+    }
+    it->second.last_use_ns = sys_util::NowNs();
+  }
+  tensorflow::Status status = tensorflow::ReadFileToString(
+      tensorflow::Env::Default(), tensorflow::io::JoinPath(path_, name), &data);
+  std::string payload;
+  if (!status.ok() || !DecodeEntry(data, key, &payload)) {
+    TF_LOG(WARNING) << "Dropping corrupted persistent cache entry "
+                    << tensorflow::io::JoinPath(path_, name) << ": " << status;
+    XLA_COUNTER("PersistentCacheCorrupted", 1);
+    DiskCacheMissCounter()->AddValue(1);
+    std::lock_guard<std::mutex> lock(lock_);
+    Remove(name);
+    return absl::nullopt;
+  }
+  if (accept != nullptr && !accept(payload)) {
+    TF_LOG(WARNING) << "Dropping rejected persistent cache entry "
+                    << tensorflow::io::JoinPath(path_, name);
+    XLA_COUNTER("PersistentCacheRejected", 1);
+    DiskCacheMissCounter()->AddValue(1);
+    std::lock_guard<std::mutex> lock(lock_);
+    Remove(name);
+    return absl::nullopt;
+  }
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    Entry& entry = entries_[name];
+    total_bytes_ += static_cast<int64>(data.size()) - entry.size;
+    entry.size = data.size();
+  }
+  DiskCacheHitCounter()->AddValue(1);
+  static metrics::Metric* load_metric =
+      new metrics::Metric("PersistentCacheLoadBytes", metrics::MetricFnBytes);
+  load_metric->AddSample(data.size());
+  return payload;
+}
+
+void DiskCache::Add(const std::string& key, const std::string& payload) {
+  std::string name = GetEntryName(key);
+  std::string data = EncodeEntry(key, payload);
+  std::string entry_path = tensorflow::io::JoinPath(path_, name);
+  std::string tmp_path = absl::StrCat(entry_path, ".tmp.", sys_util::NowNs());
+  tensorflow::Env* env = tensorflow::Env::Default();
+  tensorflow::Status status =
+      tensorflow::WriteStringToFile(env, tmp_path, data);
+  if (status.ok()) {
+    status = env->RenameFile(tmp_path, entry_path);
+  }
+  if (!status.ok()) {
+    TF_LOG(WARNING) << "Unable to write persistent cache entry " << entry_path
+                    << ": " << status;
+    env->DeleteFile(tmp_path).IgnoreError();
+    return;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  Entry& entry = entries_[name];
+  total_bytes_ += static_cast<int64>(data.size()) - entry.size;
+  entry.size = data.size();
+  entry.last_use_ns = sys_util::NowNs();
+  Evict(name);
+}
+
+void DiskCache::Remove(const std::string& name) {
+  auto it = entries_.find(name);
+  if (it != entries_.end()) {
+    total_bytes_ -= it->second.size;
+    entries_.erase(it);
+  }
+  tensorflow::Env::Default()
+      ->DeleteFile(tensorflow::io::JoinPath(path_, name))
+      .IgnoreError();
+}
+
+void DiskCache::Evict(const std::string& keep_name) {
+  if (total_bytes_ <= max_bytes_) {
+    return;
+  }
+  std::vector<std::pair<int64, std::string>> lru;
+  lru.reserve(entries_.size());
+  for (auto& name_entry : entries_) {
+    if (name_entry.first != keep_name) {
+      lru.emplace_back(name_entry.second.last_use_ns, name_entry.first);
+    }
+  }
+  std::sort(lru.begin(), lru.end());
+  for (size_t i = 0; i < lru.size() && total_bytes_ > max_bytes_; ++i) {
+    XLA_COUNTER("PersistentCacheEvictions", 1);
+    Remove(lru[i].second);
+  }
+}
+
+DiskCache* GetCompilationDiskCache() {
+  static DiskCache* cache = []() -> DiskCache* {
+    std::string path =
+        sys_util::GetEnvString("XLA_PERSISTENT_CACHE_PATH", "");
+    if (path.empty()) {
+      return nullptr;
+    }
+    int64 max_bytes = sys_util::GetEnvInt("XLA_PERSISTENT_CACHE_SIZE",
+                                          static_cast<int64>(4) << 30);
+    return new DiskCache(std::move(path), max_bytes);
+  }();
+  return cache;
+}
+
+}  // namespace util
+}  // namespace xla
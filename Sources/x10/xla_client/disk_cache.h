@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef X10_XLA_CLIENT_DISK_CACHE_H_
+#define X10_XLA_CLIENT_DISK_CACHE_H_
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "absl/types/optional.h"
+#include "tensorflow/compiler/xla/types.h"
+
+namespace xla {
+namespace util {
+
+// Persistent key/blob store backed by a local directory. Every entry is stored
+// within its own file, whose name is derived from the hash of the key. Files
+// carry a header with the full key, the payload size and a CRC32C checksum, so
+// that truncated, corrupted or colliding entries are detected (and dropped) at
+// load time. The total size of the files is kept within the max_bytes budget by
+// removing the least recently used entries. Multiple processes can share the
+// same directory, as entries are written to temporary files and then renamed
+// in place.
+class DiskCache {
+ public:
+  DiskCache(std::string path, int64 max_bytes);
+
+  // Retrieves the payload stored for key, or absl::nullopt if no such entry
+  // exists, or if the entry did not pass the integrity checks. If accept is
+  // not null, it is called with the payload, and the entries it rejects (like
+  // ones which cannot be loaded anymore) are removed and counted as misses.
+  absl::optional<std::string> Get(
+      const std::string& key,
+      const std::function<bool(const std::string&)>& accept = nullptr);
+
+  // Stores the payload for key, possibly evicting older entries in order to
+  // stay within the size budget.
+  void Add(const std::string& key, const std::string& payload);
+
+  const std::string& path() const { return path_; }
+
+ private:
+  struct Entry {
+    int64 size = 0;
+    int64 last_use_ns = 0;
+  };
+
+  std::string GetEntryName(const std::string& key) const;
+
+  void Remove(const std::string& name);
+
+  void LoadIndex();
+
+  void Evict(const std::string& keep_name);
+
+  std::mutex lock_;
+  std::string path_;
+  int64 max_bytes_ = 0;
+  int64 total_bytes_ = 0;
+  std::map<std::string, Entry> entries_;
+};
+
+// Returns the process wide disk cache for compiled computations, or nullptr if
+// the cache has not been enabled (by setting the XLA_PERSISTENT_CACHE_PATH
+// environment variable).
+DiskCache* GetCompilationDiskCache();
+
+}  // namespace util
+}  // namespace xla
+
+#endif  // X10_XLA_CLIENT_DISK_CACHE_H_
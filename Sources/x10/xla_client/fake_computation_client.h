@@ -65,6 +65,8 @@ class FakeComputationClient : public ComputationClient {
   std::vector<DataPtr> ExecuteChained(absl::Span<const ExecuteChainedOp> ops,
                                       const std::string& device) override;
 
+  bool SupportsExecuteChained() const override { return false; }
+
   std::vector<std::vector<DataPtr>> DeconstructTuple(
       absl::Span<const DataPtr> tuples) override;
 
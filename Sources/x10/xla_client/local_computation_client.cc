@@ -12,18 +12,35 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#define EIGEN_USE_THREADS
+
 #include "tensorflow/compiler/xla/xla_client/local_computation_client.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
 #include <tuple>
 
 #include "platforms/deepsea/executor/deepsea_platform.h"
 #include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/debug_options_flags.h"
+#include "tensorflow/compiler/xla/service/hlo.pb.h"
+#include "tensorflow/compiler/xla/service/platform_util.h"
+#include "tensorflow/compiler/xla/xla_client/cpu_all_reduce.h"
 #include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/disk_cache.h"
 #include "tensorflow/compiler/xla/xla_client/multi_wait.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/thread_pool.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
-#include "tensorflow/compiler/xla/service/platform_util.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/public/version.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 
 namespace xla {
 namespace {
@@ -104,6 +121,155 @@ std::vector<const xla::Shape*> ArgumentLayoutAsPointers(
   return argument_layout_ptrs;
 }
 
+// Builds the key for the persistent compilation cache. Other than the graph
+// hash, it captures everything else which affects the generated executable:
+// the compiler (platform, TF version and flags), the program shape, the
+// input/output aliasing and the build options.
+std::string GetPersistentCacheKey(const xla::LocalClient* client,
+                                  size_t graph_hash,
+                                  const XlaComputation& computation,
+                                  const xla::ExecutableBuildOptions& options) {
+  // The compiler falls back to the XLA_FLAGS debug options when the build
+  // options carry none.
+  std::string debug_options;
+  XLA_CHECK(tensorflow::SerializeToStringDeterministic(
+      options.has_debug_options() ? options.debug_options()
+                                  : xla::GetDebugOptionsFromFlags(),
+      &debug_options));
+  return absl::StrCat(
+      graph_hash, "|", client->platform()->Name(), "|", TF_VERSION_STRING, "|",
+      tf_git_version(), "|", sys_util::GetEnvString("XLA_FLAGS", ""), "|",
+      debug_options, "|",
+      xla::ProgramShape(computation.proto().host_program_shape()).ToString(),
+      "|", computation.proto().input_output_alias().SerializeAsString(), "|",
+      options.result_layout() != nullptr
+          ? options.result_layout()->ToString(/*print_layout=*/true)
+          : "",
+      "|", options.num_replicas());
+}
+
+// The executables generated by the local client backends cannot be serialized,
+// so what we persist is the HLO module after the optimization passes. Reloading
+// it only needs to run the backend code generation.
+std::string SerializeExecutable(const xla::LocalExecutable& executable) {
+  return executable.executable()->module().ToProto().SerializeAsString();
+}
+
+std::shared_ptr<xla::LocalExecutable> LoadExecutable(
+    xla::LocalClient* client, const std::string& payload,
+    xla::ExecutableBuildOptions options) {
+  xla::HloModuleProto proto;
+  if (!proto.ParseFromString(payload)) {
+    // DiskCache::Get() counts and drops the entries the accept callback
+    // rejects.
+    return nullptr;
+  }
+  XlaComputation computation(std::move(proto));
+  std::vector<xla::Shape> argument_layouts = BuildArgumentLayouts(computation);
+  options.set_run_backend_only(true);
+  auto executables = client->Compile(
+      computation, ArgumentLayoutAsPointers(argument_layouts), options);
+  if (!executables.ok()) {
+    TF_LOG(WARNING) << "Unable to load persisted executable: "
+                    << executables.status();
+    return nullptr;
+  }
+  return std::move(executables.ValueOrDie().front());
+}
+
+std::shared_ptr<xla::LocalExecutable> CompileExecutable(
+    xla::LocalClient* client, const XlaComputation& computation,
+    const absl::optional<size_t>& graph_hash,
+    const xla::ExecutableBuildOptions& options) {
+  util::DiskCache* disk_cache = util::GetCompilationDiskCache();
+  std::string cache_key;
+  if (disk_cache != nullptr && graph_hash) {
+    cache_key =
+        GetPersistentCacheKey(client, *graph_hash, computation, options);
+    // Payloads which cannot be loaded are dropped from the cache, rather than
+    // failing again on every run.
+    std::shared_ptr<xla::LocalExecutable> executable;
+    disk_cache->Get(cache_key, [&](const std::string& payload) {
+      tensorflow::profiler::TraceMe trace("XLA Load Persisted Compile");
+      executable = LoadExecutable(client, payload, options);
+      return executable != nullptr;
+    });
+    if (executable != nullptr) {
+      return executable;
+    }
+  }
+  std::vector<xla::Shape> argument_layouts = BuildArgumentLayouts(computation);
+  std::shared_ptr<xla::LocalExecutable> executable =
+      std::move(client
+                    ->Compile(computation,
+                              ArgumentLayoutAsPointers(argument_layouts),
+                              options)
+                    .ValueOrDie()
+                    .front());
+  if (!cache_key.empty()) {
+    disk_cache->Add(cache_key, SerializeExecutable(*executable));
+  }
+  return executable;
+}
+
+// Returns the number of CPU devices the local client should expose, from the
+// XLA_CPU_DEVICE_COUNT environment variable. Defaults to a single device, which
+// uses all the host cores.
+int GetCpuDeviceCount() {
+  static const int count =
+      std::max<int>(sys_util::GetEnvInt("XLA_CPU_DEVICE_COUNT", 1), 1);
+  return count;
+}
+
+// The CPU platform exposes a single device, unless told otherwise by the
+// --xla_force_host_platform_device_count debug flag. The flags are parsed from
+// the XLA_FLAGS environment variable the first time they are needed, which is
+// at the creation of the first local client, so appending the flag there is
+// enough, unless the user already set it explicitly.
+void ForceCpuDeviceCount(int count) {
+  if (count <= 1) {
+    return;
+  }
+  std::string flags = sys_util::GetEnvString("XLA_FLAGS", "");
+  if (flags.find("--xla_force_host_platform_device_count") !=
+      std::string::npos) {
+    return;
+  }
+  std::string device_count_flag =
+      absl::StrCat("--xla_force_host_platform_device_count=", count);
+  flags = flags.empty() ? device_count_flag
+                        : absl::StrCat(flags, " ", device_count_flag);
+  setenv("XLA_FLAGS", flags.c_str(), 1);
+}
+
+// Generates run IDs for replicated computations which are launched one replica
+// at a time (by the per device threads of the Swift side, each one calling
+// ExecuteComputation() on its own device). The N-th execution of a given
+// computation on any of its devices gets the same run ID, so that the replicas
+// meet within the cross replica collectives.
+class ReplicaRunIds {
+ public:
+  explicit ReplicaRunIds(size_t num_replicas)
+      : base_(NextBase()), run_counts_(num_replicas, 0) {}
+
+  xla::RunId Next(size_t replica) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    XLA_CHECK_LT(replica, run_counts_.size());
+    int64 run = run_counts_[replica]++;
+    return xla::RunId(base_ + run);
+  }
+
+ private:
+  static int64 NextBase() {
+    static std::atomic<int64>* next_base = new std::atomic<int64>(1);
+    return next_base->fetch_add(1) << 32;
+  }
+
+  std::mutex mutex_;
+  int64 base_;
+  std::vector<int64> run_counts_;
+};
+
 }  // namespace
 
 using DataPtr = ComputationClient::DataPtr;
@@ -126,6 +292,23 @@ class LocalComputationClient::Device {
     transfer_from_device_stream_->Init();
   }
 
+  // Gives the device its own set of intra-op threads, instead of the backend
+  // wide pool, so that multiple CPU devices running concurrently do not
+  // compete for the same threads.
+  void CreateIntraOpThreadPool(int num_threads) {
+    intra_op_thread_pool_ = std::make_unique<tensorflow::thread::ThreadPool>(
+        tensorflow::Env::Default(),
+        absl::StrCat("XlaDevice", device_ordinal_), num_threads);
+    intra_op_device_ = std::make_unique<Eigen::ThreadPoolDevice>(
+        intra_op_thread_pool_->AsEigenThreadPool(), num_threads);
+  }
+
+  const Eigen::ThreadPoolDevice* intra_op_thread_pool() const {
+    return intra_op_device_ != nullptr
+               ? intra_op_device_.get()
+               : client_->backend().eigen_intra_op_thread_pool_device();
+  }
+
   xla::LocalClient* client() const { return client_; }
   int device_ordinal() const { return device_ordinal_; }
   int32_t mesh_id() const { return mesh_id_; }
@@ -135,6 +318,18 @@ class LocalComputationClient::Device {
   }
   bool is_cpu() const { return is_cpu_; }
 
+  // Whether host data laid out as the given shape can be written straight
+  // into the device buffers for it, without going through the transfer
+  // manager. This is the case on CPU, when the device shape is the host one.
+  bool CanPopulateDirectly(const Shape& shape) const {
+    if (!is_cpu_ || !shape.IsArray()) {
+      return false;
+    }
+    Shape device_shape =
+        client_->backend().transfer_manager()->HostShapeToDeviceShape(shape);
+    return ShapeUtil::Equal(device_shape, shape);
+  }
+
   int64 RunAsyncStart() {
     mutex_.Lock();
     XLA_CHECK(mutex_.AwaitWithTimeout(
@@ -185,6 +380,8 @@ class LocalComputationClient::Device {
   bool is_cpu_;
   std::unique_ptr<se::Stream> stream_;
   std::unique_ptr<se::Stream> transfer_from_device_stream_;
+  std::unique_ptr<tensorflow::thread::ThreadPool> intra_op_thread_pool_;
+  std::unique_ptr<Eigen::ThreadPoolDevice> intra_op_device_;
 };
 
 class LocalComputationClient::LocalData : public Data {
@@ -195,6 +392,11 @@ class LocalComputationClient::LocalData : public Data {
       : Data(std::move(device), buffer.on_host_shape()),
         buffer_(std::make_shared<ScopedShapedBuffer>(std::move(buffer))),
         computation_id_(computation_id) {}
+  LocalData(std::string device, std::shared_ptr<const ShapedBuffer> buffer,
+            int64 computation_id)
+      : Data(std::move(device), buffer->on_host_shape()),
+        buffer_(std::move(buffer)),
+        computation_id_(computation_id) {}
 
   void Assign(const Data& data) override {
     const LocalData& xrt_data = dynamic_cast<const LocalData&>(data);
@@ -212,11 +414,24 @@ class LocalComputationClient::LocalData : public Data {
 
   const ShapedBuffer& buffer() const { return *buffer_; }
 
+  // Returns a buffer for the index-th tuple element, which aliases the device
+  // memory of this tuple and keeps it alive.
+  std::shared_ptr<const ShapedBuffer> SubBuffer(int64 index) const {
+    struct SubShapedBuffer {
+      std::shared_ptr<const ShapedBuffer> tuple;
+      ShapedBuffer buffer;
+    };
+    auto sub_buffer = std::make_shared<SubShapedBuffer>(SubShapedBuffer{
+        buffer_, buffer_->SubShapedBuffer({index}).ValueOrDie()});
+    return std::shared_ptr<const ShapedBuffer>(sub_buffer,
+                                               &sub_buffer->buffer);
+  }
+
   int64 computation_id() const { return computation_id_; }
 
  private:
   // TODO(parkers): Remove Assign() and allow buffer_ to be by value.
-  std::shared_ptr<ScopedShapedBuffer> buffer_;
+  std::shared_ptr<const ShapedBuffer> buffer_;
   int64 computation_id_;
 };
 
@@ -232,6 +447,8 @@ struct LocalComputationClient::LocalComputation : public Computation {
   // finished async.
   std::shared_ptr<LocalExecutable> handle;
   std::shared_ptr<DeviceAssignment> assignment;
+  // Set for replicated computations.
+  std::unique_ptr<ReplicaRunIds> replica_run_ids;
 };
 
 DataPtr LocalComputationClient::CreateDataPlaceholder(std::string device,
@@ -274,19 +491,53 @@ DataPtr LocalComputationClient::TransferToServer(
 std::vector<DataPtr> LocalComputationClient::TransferToServer(
     absl::Span<const TensorSource> tensors) {
   tensorflow::profiler::TraceMe trace("TransferToServer");
+  metrics::TimedSection timed(TransferToServerMetric());
+  // On CPU devices the device memory is host memory, so if the device layout
+  // is the dense dim0-major one the PopulateFn produces, the tensors are
+  // populated straight into the device buffers. The other ones go through a
+  // temporary host buffer, which is then transferred to the device.
+  std::vector<std::unique_ptr<ScopedShapedBuffer>> device_buffers(
+      tensors.size());
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    Device* device = GetDevice(tensors[i].device);
+    if (device->CanPopulateDirectly(tensors[i].shape)) {
+      tensorflow::profiler::TraceMe trace("Allocate");
+      device_buffers[i] = std::make_unique<ScopedShapedBuffer>(
+          device->client()
+              ->backend()
+              .transfer_manager()
+              ->AllocateScopedShapedBuffer(
+                  tensors[i].shape,
+                  device->client()->backend().memory_allocator(),
+                  device->device_ordinal())
+              .ValueOrDie());
+    }
+  }
+
   std::vector<std::unique_ptr<char[]>> buffers;
   buffers.resize(tensors.size());
   size_t total_size = 0;
-  // TODO(parkers): This copy may not be strictly necessary when the layouts
-  // are known to be properly sized from the start.
+  size_t copied_size = 0;
   util::MultiWait mwait(tensors.size());
   for (size_t i = 0; i < tensors.size(); ++i) {
     size_t size = xla::ShapeUtil::ByteSizeOf(tensors[i].shape);
     total_size += size;
-    auto converter = [&, i, size]() {
-      buffers[i] = std::make_unique<char[]>(size + 1);
-      tensors[i].populate_fn(tensors[i], buffers[i].get(), size);
-    };
+    std::function<void()> converter;
+    if (device_buffers[i] != nullptr) {
+      converter = [&, i, size]() {
+        if (size > 0) {
+          tensors[i].populate_fn(tensors[i],
+                                 device_buffers[i]->root_buffer().opaque(),
+                                 size);
+        }
+      };
+    } else {
+      copied_size += size;
+      converter = [&, i, size]() {
+        buffers[i] = std::make_unique<char[]>(size + 1);
+        tensors[i].populate_fn(tensors[i], buffers[i].get(), size);
+      };
+    }
     if (tensors.size() == 1) {
       mwait.Completer(std::move(converter))();
     } else {
@@ -296,6 +547,8 @@ std::vector<DataPtr> LocalComputationClient::TransferToServer(
   mwait.Wait();
 
   OutboundDataMetric()->AddSample(total_size);
+  XLA_COUNTER("TransferToServerCopiedBytes", copied_size);
+  XLA_COUNTER("TransferToServerDirectBytes", total_size - copied_size);
 
   struct ReturnSubStream {
     void operator()(se::Stream* substream) {
@@ -309,6 +562,11 @@ std::vector<DataPtr> LocalComputationClient::TransferToServer(
   std::vector<DataPtr> out;
   for (size_t i = 0; i < tensors.size(); ++i) {
     const TensorSource& tensor = tensors[i];
+    if (device_buffers[i] != nullptr) {
+      out.push_back(std::make_shared<LocalData>(
+          tensor.device, std::move(*device_buffers[i]), -1));
+      continue;
+    }
     Device* device = GetDevice(tensor.device);
 
     int device_ordinal = device->device_ordinal();
@@ -384,11 +642,15 @@ std::vector<Literal> LocalComputationClient::TransferFromServer(
 
 std::vector<ComputationPtr> LocalComputationClient::Compile(
     std::vector<CompileInstance> instances) {
+  static const size_t kCompileThreads = sys_util::GetEnvInt(
+      "XLA_COMPILE_THREADS", std::thread::hardware_concurrency());
+  static auto* deduping = new ConcurrentCompileDedupping;
   metrics::TimedSection timed(CompileMetric());
-  // TODO(parkers): Probably have to do this in parallel if actually given
-  // n computations.
-  std::vector<ComputationPtr> out;
-  for (CompileInstance& instance : instances) {
+  XLA_VALUE_METRIC("CompileBatchSize", instances.size());
+
+  std::vector<ComputationPtr> out(instances.size());
+  auto compile_instance = [&](size_t index) {
+    CompileInstance& instance = instances[index];
     Device* device = GetDevice(instance.compilation_device);
 
     std::unique_ptr<xla::DeviceAssignment> assignment;
@@ -414,8 +676,6 @@ std::vector<ComputationPtr> LocalComputationClient::Compile(
     });
 
     const XlaComputation& computation = instance.computation;
-    std::vector<xla::Shape> argument_layouts =
-        BuildArgumentLayouts(computation);
     xla::ExecutableBuildOptions exec_build_options;
 
     if (instance.output_shape) {
@@ -425,7 +685,6 @@ std::vector<ComputationPtr> LocalComputationClient::Compile(
     exec_build_options.set_num_replicas(instance.devices.size());
 
     std::shared_ptr<xla::LocalExecutable> xla_computation;
-    static auto* deduping = new ConcurrentCompileDedupping;
 
     deduping->mutex.Lock();
     ConcurrentCompileDedupping::Key key{
@@ -438,14 +697,13 @@ std::vector<ComputationPtr> LocalComputationClient::Compile(
 
     if (deduping->ShouldCompile(key, &xla_computation)) {
       deduping->mutex.Unlock();
-      xla_computation = std::move(
-          device->client()
-              ->Compile(computation, ArgumentLayoutAsPointers(argument_layouts),
-                        exec_build_options)
-              .ValueOrDie()
-              .front());
+      xla_computation =
+          CompileExecutable(device->client(), computation,
+                            instance.graph_hash, exec_build_options);
       deduping->mutex.Lock();
       deduping->Publish(key, xla_computation);
+    } else {
+      XLA_COUNTER("CompileDedupped", 1);
     }
     auto cond = [&]() { return xla_computation != nullptr; };
     deduping->mutex.Await(absl::Condition(&cond));
@@ -455,8 +713,40 @@ std::vector<ComputationPtr> LocalComputationClient::Compile(
         std::move(instance.computation),
         xla::ProgramShape(instance.computation.GetProgramShape().ValueOrDie()),
         instance.devices, std::move(xla_computation));
+    if (assignment != nullptr) {
+      local_computation->replica_run_ids =
+          std::make_unique<ReplicaRunIds>(instance.devices.size());
+    }
     local_computation->assignment = std::move(assignment);
-    out.push_back(std::move(local_computation));
+    out[index] = std::move(local_computation);
+  };
+
+  // Compile the instances in parallel, using at most kCompileThreads workers
+  // which pull the next instance to compile from a shared index. Identical
+  // computations are still compiled only once, as the workers go through the
+  // deduping logic above.
+  size_t num_workers =
+      std::min(std::max<size_t>(kCompileThreads, 1), instances.size());
+  if (num_workers <= 1) {
+    for (size_t i = 0; i < instances.size(); ++i) {
+      compile_instance(i);
+    }
+  } else {
+    std::atomic<size_t> next_index(0);
+    auto worker = [&]() {
+      for (size_t i = next_index++; i < instances.size(); i = next_index++) {
+        compile_instance(i);
+      }
+    };
+    // The calling thread is one of the workers, so that the compilation makes
+    // progress even when the compile pool threads are all busy (possibly with
+    // compilations which called in here).
+    util::MultiWait mwait(num_workers);
+    for (size_t i = 1; i < num_workers; ++i) {
+      env::ScheduleCompileClosure(mwait.Completer(worker));
+    }
+    mwait.Completer(worker)();
+    mwait.Wait();
   }
   return out;
 }
@@ -464,46 +754,71 @@ std::vector<ComputationPtr> LocalComputationClient::Compile(
 std::vector<DataPtr> LocalComputationClient::ExecuteComputation(
     const Computation& computation, absl::Span<const DataPtr> arguments,
     const std::string& device, const ExecuteComputationOptions& options) {
+  metrics::TimedSection timed(ExecuteMetric());
   auto& local_computation = dynamic_cast<const LocalComputation&>(computation);
+  if (local_computation.replica_run_ids == nullptr) {
+    return ExecuteOnDevice(local_computation, arguments, device,
+                           options.explode_tuple, xla::RunId());
+  }
+  const std::vector<std::string>& devices = local_computation.devices();
+  auto it = std::find(devices.begin(), devices.end(), device);
+  XLA_CHECK(it != devices.end())
+      << "Device " << device << " is not a replica of the computation";
+  return ExecuteOnDevice(
+      local_computation, arguments, device, options.explode_tuple,
+      local_computation.replica_run_ids->Next(it - devices.begin()));
+}
+
+std::vector<DataPtr> LocalComputationClient::ExecuteOnDevice(
+    const LocalComputation& computation, absl::Span<const DataPtr> arguments,
+    const std::string& device, bool explode_tuple, const xla::RunId& run_id) {
   Device* device_ptr = GetDevice(device);
   std::vector<const xla::ShapedBuffer*> args;
   for (const DataPtr& opaque_arg : arguments) {
     args.push_back(&dynamic_cast<const LocalData&>(*opaque_arg).buffer());
   }
 
-  std::unique_ptr<xla::DeviceAssignment> devices;
-
   xla::ExecutableRunOptions run_options;
   run_options.set_stream(device_ptr->stream());
   run_options.set_allocator(device_ptr->client()->backend().memory_allocator());
-  run_options.set_intra_op_thread_pool(
-      device_ptr->client()->backend().eigen_intra_op_thread_pool_device());
-
-  run_options.set_device_assignment(local_computation.assignment.get());
+  run_options.set_intra_op_thread_pool(device_ptr->intra_op_thread_pool());
+  run_options.set_device_assignment(computation.assignment.get());
+  run_options.set_run_id(run_id);
 
   bool is_cpu = device_ptr->is_cpu();
   int64 computation_id = -1;
-  if (!is_cpu) {
+  if (is_cpu) {
+    // CPU computations run on the thread of the host stream, right after the
+    // callbacks enqueued before them, so this is where the all-reduce runtime
+    // gets the run ID which keeps concurrent executions apart.
+    int64 run_id_value = run_id.ToInt();
+    run_options.stream()->ThenDoHostCallback(
+        [run_id_value]() { cpu_all_reduce::SetRunId(run_id_value); });
+  } else {
     tensorflow::profiler::TraceMe trace("Acquire Async slot");
     computation_id = device_ptr->RunAsyncStart();
   }
   xla::ScopedShapedBuffer tmp =
-      local_computation.handle->RunAsync(args, run_options).ValueOrDie();
-  size_t num_tuples = tmp.on_host_shape().tuple_shapes().size();
+      computation.handle->RunAsync(args, run_options).ValueOrDie();
   std::vector<DataPtr> out;
-  out.reserve(num_tuples);
-  for (size_t i = 0; i < num_tuples; ++i) {
-    out.push_back(std::make_shared<LocalData>(
-        device, tmp.TakeSubTree(ShapeIndex({static_cast<xla::int64>(i)})),
-        computation_id));
+  if (explode_tuple) {
+    size_t num_tuples = tmp.on_host_shape().tuple_shapes().size();
+    out.reserve(num_tuples);
+    for (size_t i = 0; i < num_tuples; ++i) {
+      out.push_back(std::make_shared<LocalData>(
+          device, tmp.TakeSubTree(ShapeIndex({static_cast<xla::int64>(i)})),
+          computation_id));
+    }
+  } else {
+    out.push_back(
+        std::make_shared<LocalData>(device, std::move(tmp), computation_id));
   }
 
   if (is_cpu) {
     TF_CHECK_OK(run_options.stream()->BlockHostUntilDone());
   } else {
     run_options.stream()->ThenDoHostCallback(
-        [handle = local_computation.handle,
-         assignment = local_computation.assignment,
+        [handle = computation.handle, assignment = computation.assignment,
          device_ptr]() { device_ptr->RunAsyncFinish(); });
   }
 
@@ -515,7 +830,26 @@ std::vector<std::vector<DataPtr>> LocalComputationClient::ExecuteReplicated(
     const std::vector<std::vector<DataPtr>>& arguments,
     absl::Span<const std::string> devices,
     const ExecuteReplicatedOptions& options) {
-  TF_LOG(FATAL) << "Implement";
+  metrics::TimedSection timed(ExecuteReplicatedMetric());
+  XLA_CHECK_EQ(devices.size(), arguments.size());
+  XLA_CHECK_EQ(devices.size(), computation.devices().size());
+  auto& local_computation = dynamic_cast<const LocalComputation&>(computation);
+
+  // The replicas must run concurrently, as they wait for each other within the
+  // cross replica collectives. On CPU ExecuteOnDevice() blocks until the
+  // computation is done, so every replica gets its own thread.
+  xla::RunId run_id;
+  std::vector<std::vector<DataPtr>> results(devices.size());
+  util::MultiWait mwait(devices.size());
+  for (size_t i = 0; i < devices.size(); ++i) {
+    auto replica = [&, i]() {
+      results[i] = ExecuteOnDevice(local_computation, arguments[i], devices[i],
+                                   options.explode_tuple, run_id);
+    };
+    env::ScheduleClosure(mwait.Completer(std::move(replica)));
+  }
+  mwait.Wait();
+  return results;
 }
 
 std::vector<std::vector<DataPtr>> LocalComputationClient::ExecuteParallel(
@@ -523,17 +857,87 @@ std::vector<std::vector<DataPtr>> LocalComputationClient::ExecuteParallel(
     const std::vector<std::vector<DataPtr>>& arguments,
     absl::Span<const std::string> devices,
     const ExecuteParallelOptions& options) {
-  TF_LOG(FATAL) << "Implement";
+  metrics::TimedSection timed(ExecuteParallelMetric());
+  XLA_CHECK_EQ(devices.size(), arguments.size());
+  XLA_CHECK_EQ(devices.size(), computations.size());
+  std::vector<std::vector<DataPtr>> results(devices.size());
+  util::MultiWait mwait(devices.size());
+  for (size_t i = 0; i < devices.size(); ++i) {
+    auto executor = [&, i]() {
+      results[i] = ExecuteOnDevice(
+          dynamic_cast<const LocalComputation&>(*computations[i]),
+          arguments[i], devices[i], options.explode_tuple, xla::RunId());
+    };
+    env::ScheduleClosure(mwait.Completer(std::move(executor)));
+  }
+  mwait.Wait();
+  return results;
 }
 
 std::vector<DataPtr> LocalComputationClient::ExecuteChained(
     absl::Span<const ExecuteChainedOp> ops, const std::string& device) {
-  TF_LOG(FATAL) << "Implement";
+  metrics::TimedSection timed(ExecuteChainedMetric());
+  std::vector<int64> uses(ops.size(), 0);
+  for (auto& op : ops) {
+    for (auto& input : op.inputs) {
+      uses[input.op_index] += 1;
+    }
+  }
+  std::vector<std::vector<DataPtr>> ops_outputs(ops.size());
+  std::vector<DataPtr> results;
+  for (size_t i = 0; i < ops.size(); ++i) {
+    const ExecuteChainedOp& op = ops[i];
+    if (op.device_data != nullptr) {
+      ops_outputs[i].push_back(op.device_data);
+    } else {
+      std::vector<DataPtr> arguments;
+      arguments.reserve(op.inputs.size());
+      for (auto& input : op.inputs) {
+        XLA_CHECK_LT(input.op_index, i);
+        XLA_CHECK_LT(input.output_index.value_or(0),
+                     ops_outputs[input.op_index].size());
+        arguments.push_back(
+            ops_outputs[input.op_index][input.output_index.value_or(0)]);
+      }
+      ops_outputs[i] = ExecuteOnDevice(
+          dynamic_cast<const LocalComputation&>(*op.computation), arguments,
+          device, /*explode_tuple=*/true, xla::RunId());
+    }
+
+    for (auto& output : op.outputs) {
+      if (output.result_index >= results.size()) {
+        results.resize(output.result_index + 1);
+      }
+      XLA_CHECK_LT(output.output_index.value_or(0), ops_outputs[i].size());
+      results[output.result_index] =
+          ops_outputs[i][output.output_index.value_or(0)];
+    }
+    // Drop references to any intermediate result which is not used anymore.
+    for (auto& input : op.inputs) {
+      uses[input.op_index] -= 1;
+      if (uses[input.op_index] == 0) {
+        ops_outputs[input.op_index].clear();
+      }
+    }
+  }
+  return results;
 }
 
 std::vector<std::vector<DataPtr>> LocalComputationClient::DeconstructTuple(
     absl::Span<const DataPtr> tuples) {
-  TF_LOG(FATAL) << "Implement";
+  metrics::TimedSection timed(DeconstructTupleMetric());
+  std::vector<std::vector<DataPtr>> results(tuples.size());
+  for (size_t i = 0; i < tuples.size(); ++i) {
+    const auto& local_data = dynamic_cast<const LocalData&>(*tuples[i]);
+    int64 count = ShapeUtil::TupleElementCount(local_data.shape());
+    results[i].reserve(count);
+    for (int64 j = 0; j < count; ++j) {
+      results[i].push_back(std::make_shared<LocalData>(
+          local_data.device(), local_data.SubBuffer(j),
+          local_data.computation_id()));
+    }
+  }
+  return results;
 }
 
 std::string LocalComputationClient::GetResourceDomain(
@@ -548,7 +952,13 @@ std::string LocalComputationClient::GetDefaultDevice() const {
 size_t LocalComputationClient::GetNumDevices() const { return devices_.size(); }
 
 std::vector<std::string> LocalComputationClient::GetLocalDevices() const {
-  TF_LOG(FATAL) << "Implement";
+  std::vector<std::string> local_devices;
+  for (auto& device : device_names_) {
+    if (devices_.count(device) > 0) {
+      local_devices.push_back(device);
+    }
+  }
+  return local_devices;
 }
 
 std::vector<std::string> LocalComputationClient::GetAllDevices() const {
@@ -601,13 +1011,22 @@ StatusOr<xla::LocalClient*> getTPULocalClient() {
 }
 
 LocalComputationClient::LocalComputationClient() {
+  ForceCpuDeviceCount(GetCpuDeviceCount());
   xla::LocalClientOptions options;
   options.set_platform(xla::PlatformUtil::GetPlatform("cpu").ValueOrDie());
   xla::LocalClient* cpu_client =
       xla::ClientLibrary::GetOrCreateLocalClient(options).ValueOrDie();
+  // With multiple CPU devices, the host cores are split among them.
+  int cpu_device_threads =
+      std::max<int>(std::thread::hardware_concurrency() /
+                        std::max(cpu_client->device_count(), 1),
+                    1);
   for (int i = 0; i < cpu_client->device_count(); ++i) {
     std::string key = absl::StrCat("CPU:", i);
     devices_[key] = std::make_unique<Device>(cpu_client, i, i, true);
+    if (cpu_client->device_count() > 1) {
+      devices_[key]->CreateIntraOpThreadPool(cpu_device_threads);
+    }
     device_names_.push_back(key);
   }
   auto tpu_client_statusor = getTPULocalClient();
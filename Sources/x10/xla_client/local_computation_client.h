@@ -95,6 +95,15 @@ class LocalComputationClient : public ComputationClient {
   Device* GetDevice(std::string device) const;
 
  private:
+  // Runs the computation on a single device. Replicas of the same replicated
+  // execution must share the same run_id, which is used by the backends to
+  // match the participants of the cross replica collectives.
+  std::vector<DataPtr> ExecuteOnDevice(const LocalComputation& computation,
+                                       absl::Span<const DataPtr> arguments,
+                                       const std::string& device,
+                                       bool explode_tuple,
+                                       const xla::RunId& run_id);
+
   std::string default_device_ = "CPU:0";
   std::unordered_map<std::string, std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, int32_t> remote_devices_;
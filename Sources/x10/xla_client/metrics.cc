@@ -14,7 +14,10 @@
 
 #include "tensorflow/compiler/xla/xla_client/metrics.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
 #include <map>
 #include <sstream>
 
@@ -32,17 +35,23 @@ class MetricsArena {
 
   // Registers a new metric in the global arena.
   void RegisterMetric(const std::string& name, MetricReprFn repr_fn,
-                      size_t max_samples, std::shared_ptr<MetricData>* data);
+                      std::shared_ptr<MetricData>* data);
 
   void RegisterCounter(const std::string& name,
                        std::shared_ptr<CounterData>* data);
 
+  void RegisterGauge(const std::string& name,
+                     std::shared_ptr<CounterData>* data);
+
   void ForEachMetric(
       const std::function<void(const std::string&, MetricData*)>& metric_func);
 
   void ForEachCounter(const std::function<void(const std::string&,
                                                CounterData*)>& counter_func);
 
+  void ForEachGauge(const std::function<void(const std::string&,
+                                             CounterData*)>& gauge_func);
+
   std::vector<std::string> GetMetricNames() {
     std::vector<std::string> names;
     std::lock_guard<std::mutex> lock(lock_);
@@ -73,10 +82,26 @@ class MetricsArena {
     return it != counters_.end() ? it->second.get() : nullptr;
   }
 
+  std::vector<std::string> GetGaugeNames() {
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto& name_data : gauges_) {
+      names.push_back(name_data.first);
+    }
+    return names;
+  }
+
+  CounterData* GetGauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = gauges_.find(name);
+    return it != gauges_.end() ? it->second.get() : nullptr;
+  }
+
  private:
   std::mutex lock_;
   std::map<std::string, std::shared_ptr<MetricData>> metrics_;
   std::map<std::string, std::shared_ptr<CounterData>> counters_;
+  std::map<std::string, std::shared_ptr<CounterData>> gauges_;
 };
 
 MetricsArena* MetricsArena::Get() {
@@ -85,12 +110,11 @@ MetricsArena* MetricsArena::Get() {
 }
 
 void MetricsArena::RegisterMetric(const std::string& name, MetricReprFn repr_fn,
-                                  size_t max_samples,
                                   std::shared_ptr<MetricData>* data) {
   std::lock_guard<std::mutex> lock(lock_);
   if (*data == nullptr) {
     *data = xla::util::MapInsert(&metrics_, name, [&]() {
-      return std::make_shared<MetricData>(std::move(repr_fn), max_samples);
+      return std::make_shared<MetricData>(std::move(repr_fn));
     });
   }
 }
@@ -104,6 +128,15 @@ void MetricsArena::RegisterCounter(const std::string& name,
   }
 }
 
+void MetricsArena::RegisterGauge(const std::string& name,
+                                 std::shared_ptr<CounterData>* data) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (*data == nullptr) {
+    *data = xla::util::MapInsert(
+        &gauges_, name, []() { return std::make_shared<CounterData>(); });
+  }
+}
+
 void MetricsArena::ForEachMetric(
     const std::function<void(const std::string&, MetricData*)>& metric_func) {
   std::lock_guard<std::mutex> lock(lock_);
@@ -120,6 +153,14 @@ void MetricsArena::ForEachCounter(
   }
 }
 
+void MetricsArena::ForEachGauge(
+    const std::function<void(const std::string&, CounterData*)>& gauge_func) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto& name_data : gauges_) {
+    gauge_func(name_data.first, name_data.second.get());
+  }
+}
+
 const std::vector<double>* ReadEnvPercentiles() {
   std::string percentiles = sys_util::GetEnvString(
       "XLA_METRICS_PERCENTILES", "0.01:0.05:0.1:0.2:0.5:0.8:0.9:0.95:0.99");
@@ -134,48 +175,37 @@ const std::vector<double>* ReadEnvPercentiles() {
   return metrics_percentiles.release();
 }
 
-const std::vector<double>& GetPercentiles() {
-  static const std::vector<double>* metrics_percentiles = ReadEnvPercentiles();
-  return *metrics_percentiles;
-}
-
 void EmitMetricInfo(const std::string& name, MetricData* data,
                     std::stringstream* ss) {
-  double accumulator = 0.0;
-  size_t total_samples = 0;
-  std::vector<Sample> samples = data->Samples(&accumulator, &total_samples);
+  MetricSnapshot snapshot = data->Snapshot();
   (*ss) << "Metric: " << name << std::endl;
-  (*ss) << "  TotalSamples: " << total_samples << std::endl;
-  (*ss) << "  Accumulator: " << data->Repr(accumulator) << std::endl;
-  if (!samples.empty()) {
-    double total = 0.0;
-    for (auto& sample : samples) {
-      total += sample.value;
-    }
-    int64 delta_time =
-        samples.back().timestamp_ns - samples.front().timestamp_ns;
-    if (delta_time > 0) {
-      double value_sec = 1e6 * (total / (delta_time / 1000.0));
-      (*ss) << "  ValueRate: " << data->Repr(value_sec) << " / second"
-            << std::endl;
-      double count_sec =
-          1e6 * (static_cast<double>(samples.size()) / (delta_time / 1000.0));
-      (*ss) << "  Rate: " << count_sec << " / second" << std::endl;
-    }
+  (*ss) << "  TotalSamples: " << snapshot.total_samples << std::endl;
+  (*ss) << "  Accumulator: " << data->Repr(snapshot.accumulator) << std::endl;
+  if (snapshot.total_samples == 0) {
+    return;
+  }
+  (*ss) << "  Mean: " << data->Repr(snapshot.Mean()) << std::endl;
+  (*ss) << "  Min: " << data->Repr(snapshot.min) << std::endl;
+  (*ss) << "  Max: " << data->Repr(snapshot.max) << std::endl;
+  int64 delta_time = snapshot.last_timestamp_ns - snapshot.first_timestamp_ns;
+  if (delta_time > 0) {
+    double value_sec = 1e6 * (snapshot.accumulator / (delta_time / 1000.0));
+    (*ss) << "  ValueRate: " << data->Repr(value_sec) << " / second"
+          << std::endl;
+    double count_sec =
+        1e6 * (static_cast<double>(snapshot.total_samples) /
+               (delta_time / 1000.0));
+    (*ss) << "  Rate: " << count_sec << " / second" << std::endl;
   }
 
-  const std::vector<double>& metrics_percentiles = GetPercentiles();
-  std::sort(
-      samples.begin(), samples.end(),
-      [](const Sample& s1, const Sample& s2) { return s1.value < s2.value; });
+  const std::vector<double>& metrics_percentiles = GetReportPercentiles();
   (*ss) << "  Percentiles: ";
   for (size_t i = 0; i < metrics_percentiles.size(); ++i) {
-    size_t index = metrics_percentiles[i] * samples.size();
     if (i > 0) {
       (*ss) << "; ";
     }
-    (*ss) << (metrics_percentiles[i] * 100.0)
-          << "%=" << data->Repr(samples[index].value);
+    (*ss) << (metrics_percentiles[i] * 100.0) << "%="
+          << data->Repr(snapshot.Percentile(metrics_percentiles[i]));
   }
   (*ss) << std::endl;
 }
@@ -186,55 +216,223 @@ void EmitCounterInfo(const std::string& name, CounterData* data,
   (*ss) << "  Value: " << data->Value() << std::endl;
 }
 
+void EmitGaugeInfo(const std::string& name, CounterData* data,
+                   std::stringstream* ss) {
+  (*ss) << "Gauge: " << name << std::endl;
+  (*ss) << "  Value: " << data->Value() << std::endl;
+}
+
+template <typename T>
+void AtomicAdd(std::atomic<T>* target, T value) {
+  T current = target->load(std::memory_order_relaxed);
+  while (!target->compare_exchange_weak(current, current + value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+template <typename T>
+void AtomicMin(std::atomic<T>* target, T value) {
+  T current = target->load(std::memory_order_relaxed);
+  while (value < current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+template <typename T>
+void AtomicMax(std::atomic<T>* target, T value) {
+  T current = target->load(std::memory_order_relaxed);
+  while (value > current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
 }  // namespace
 
-MetricData::MetricData(MetricReprFn repr_fn, size_t max_samples)
-    : repr_fn_(std::move(repr_fn)), samples_(max_samples) {}
+constexpr size_t MetricSnapshot::kNumBuckets;
+constexpr size_t MetricData::kNumShards;
+
+size_t MetricSnapshot::BucketIndex(double value) {
+  if (!(value > 0.0)) {
+    return 0;
+  }
+  uint64 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  // Same as the exponent returned by std::frexp() for normal numbers, with the
+  // mantissa in [0.5, 1.0).
+  int exponent = static_cast<int>((bits >> 52) & 0x7ff) - 1022;
+  if (exponent <= kMinExponent) {
+    return 1;
+  }
+  if (exponent > kMaxExponent) {
+    return kNumBuckets - 1;
+  }
+  size_t sub_bucket = (bits >> (52 - kSubBucketBits)) & (kSubBuckets - 1);
+  return 1 + (exponent - kMinExponent - 1) * kSubBuckets + sub_bucket;
+}
+
+double MetricSnapshot::BucketValue(size_t index) {
+  if (index == 0) {
+    return 0.0;
+  }
+  int exponent = static_cast<int>((index - 1) / kSubBuckets) + kMinExponent;
+  double sub_bucket = static_cast<double>((index - 1) % kSubBuckets);
+  // The middle point of the bucket range.
+  return std::ldexp(1.0 + (sub_bucket + 0.5) / kSubBuckets, exponent);
+}
+
+double MetricSnapshot::Percentile(double pct) const {
+  if (total_samples == 0) {
+    return 0.0;
+  }
+  uint64 rank = static_cast<uint64>(pct * total_samples);
+  uint64 count = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    count += buckets[i];
+    if (count > rank) {
+      // Bucket 0 holds the non positive values, which are mostly zeros.
+      double value = i > 0 ? BucketValue(i) : std::min(min, 0.0);
+      return std::min(std::max(value, min), max);
+    }
+  }
+  return max;
+}
+
+struct MetricData::Shard {
+  Shard() {
+    for (auto& bucket : buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<double> accumulator{0.0};
+  std::atomic<double> min{std::numeric_limits<double>::infinity()};
+  std::atomic<double> max{-std::numeric_limits<double>::infinity()};
+  std::atomic<int64> first_timestamp_ns{std::numeric_limits<int64>::max()};
+  std::atomic<int64> last_timestamp_ns{std::numeric_limits<int64>::min()};
+  std::atomic<uint64> buckets[MetricSnapshot::kNumBuckets];
+};
+
+MetricData::MetricData(MetricReprFn repr_fn) : repr_fn_(std::move(repr_fn)) {
+  for (auto& shard : shards_) {
+    shard.store(nullptr);
+  }
+}
+
+MetricData::~MetricData() {
+  for (auto& shard : shards_) {
+    delete shard.load();
+  }
+}
+
+MetricUnit MetricData::Unit() const {
+  using ReprFnPtr = std::string (*)(double);
+  const ReprFnPtr* repr_fn = repr_fn_.target<ReprFnPtr>();
+  if (repr_fn != nullptr && *repr_fn == MetricFnTime) {
+    return MetricUnit::kTime;
+  }
+  if (repr_fn != nullptr && *repr_fn == MetricFnBytes) {
+    return MetricUnit::kBytes;
+  }
+  return MetricUnit::kNone;
+}
+
+MetricData::Shard* MetricData::GetShard() {
+  // Threads are assigned shards round robin, the first time they post a
+  // sample to any metric.
+  static std::atomic<size_t> next_shard(0);
+  static thread_local size_t shard_index = next_shard++ % kNumShards;
+  Shard* shard = shards_[shard_index].load(std::memory_order_acquire);
+  if (TF_PREDICT_FALSE(shard == nullptr)) {
+    // Shards are only allocated when used, as most metrics are posted to by a
+    // few threads.
+    Shard* new_shard = new Shard();
+    if (shards_[shard_index].compare_exchange_strong(shard, new_shard)) {
+      shard = new_shard;
+    } else {
+      delete new_shard;
+    }
+  }
+  return shard;
+}
 
 void MetricData::AddSample(int64 timestamp_ns, double value) {
-  std::lock_guard<std::mutex> lock(lock_);
-  size_t position = count_ % samples_.size();
-  ++count_;
-  accumulator_ += value;
-  samples_[position] = Sample(timestamp_ns, value);
+  Shard* shard = GetShard();
+  shard->buckets[MetricSnapshot::BucketIndex(value)].fetch_add(
+      1, std::memory_order_relaxed);
+  AtomicAdd(&shard->accumulator, value);
+  AtomicMin(&shard->min, value);
+  AtomicMax(&shard->max, value);
+  AtomicMin(&shard->first_timestamp_ns, timestamp_ns);
+  // Racing threads might leave a slightly older timestamp, which is fine for
+  // the rate computations, and cheaper than a compare and swap loop.
+  shard->last_timestamp_ns.store(timestamp_ns, std::memory_order_relaxed);
 }
 
 double MetricData::Accumulator() const {
-  std::lock_guard<std::mutex> lock(lock_);
-  return accumulator_;
+  double accumulator = 0.0;
+  for (auto& shard_ptr : shards_) {
+    Shard* shard = shard_ptr.load(std::memory_order_acquire);
+    if (shard != nullptr) {
+      accumulator += shard->accumulator.load(std::memory_order_relaxed);
+    }
+  }
+  return accumulator;
 }
 
 size_t MetricData::TotalSamples() const {
-  std::lock_guard<std::mutex> lock(lock_);
-  return count_;
+  size_t count = 0;
+  for (auto& shard_ptr : shards_) {
+    Shard* shard = shard_ptr.load(std::memory_order_acquire);
+    if (shard != nullptr) {
+      for (auto& bucket : shard->buckets) {
+        count += bucket.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  return count;
 }
 
-std::vector<Sample> MetricData::Samples(double* accumulator,
-                                        size_t* total_samples) const {
-  std::lock_guard<std::mutex> lock(lock_);
-  std::vector<Sample> samples;
-  if (count_ <= samples_.size()) {
-    samples.insert(samples.end(), samples_.begin(), samples_.begin() + count_);
-  } else {
-    size_t position = count_ % samples_.size();
-    samples.insert(samples.end(), samples_.begin() + position, samples_.end());
-    samples.insert(samples.end(), samples_.begin(),
-                   samples_.begin() + position);
+MetricSnapshot MetricData::Snapshot() const {
+  MetricSnapshot snapshot;
+  snapshot.buckets.resize(MetricSnapshot::kNumBuckets, 0);
+  snapshot.min = std::numeric_limits<double>::infinity();
+  snapshot.max = -std::numeric_limits<double>::infinity();
+  snapshot.first_timestamp_ns = std::numeric_limits<int64>::max();
+  snapshot.last_timestamp_ns = std::numeric_limits<int64>::min();
+  for (auto& shard_ptr : shards_) {
+    Shard* shard = shard_ptr.load(std::memory_order_acquire);
+    if (shard == nullptr) {
+      continue;
+    }
+    snapshot.accumulator += shard->accumulator.load(std::memory_order_relaxed);
+    snapshot.min =
+        std::min(snapshot.min, shard->min.load(std::memory_order_relaxed));
+    snapshot.max =
+        std::max(snapshot.max, shard->max.load(std::memory_order_relaxed));
+    snapshot.first_timestamp_ns =
+        std::min(snapshot.first_timestamp_ns,
+                 shard->first_timestamp_ns.load(std::memory_order_relaxed));
+    snapshot.last_timestamp_ns =
+        std::max(snapshot.last_timestamp_ns,
+                 shard->last_timestamp_ns.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < MetricSnapshot::kNumBuckets; ++i) {
+      snapshot.buckets[i] += shard->buckets[i].load(std::memory_order_relaxed);
+    }
   }
-  if (accumulator != nullptr) {
-    *accumulator = accumulator_;
+  for (uint64 bucket : snapshot.buckets) {
+    snapshot.total_samples += bucket;
   }
-  if (total_samples != nullptr) {
-    *total_samples = count_;
+  if (snapshot.total_samples == 0) {
+    snapshot.min = snapshot.max = 0.0;
+    snapshot.first_timestamp_ns = snapshot.last_timestamp_ns = 0;
   }
-  return samples;
+  return snapshot;
 }
 
-Metric::Metric(std::string name, MetricReprFn repr_fn, size_t max_samples)
-    : name_(std::move(name)),
-      repr_fn_(std::move(repr_fn)),
-      max_samples_(max_samples),
-      data_(nullptr) {}
+Metric::Metric(std::string name, MetricReprFn repr_fn)
+    : name_(std::move(name)), repr_fn_(std::move(repr_fn)), data_(nullptr) {}
 
 double Metric::Accumulator() const { return GetData()->Accumulator(); }
 
@@ -246,10 +444,7 @@ void Metric::AddSample(double value) {
   GetData()->AddSample(sys_util::NowNs(), value);
 }
 
-std::vector<Sample> Metric::Samples(double* accumulator,
-                                    size_t* total_samples) const {
-  return GetData()->Samples(accumulator, total_samples);
-}
+MetricSnapshot Metric::Snapshot() const { return GetData()->Snapshot(); }
 
 std::string Metric::Repr(double value) const { return GetData()->Repr(value); }
 
@@ -259,7 +454,7 @@ MetricData* Metric::GetData() const {
     // The RegisterMetric() API is a synchronization point, and even if multiple
     // threads enters it, the data will be created only once.
     MetricsArena* arena = MetricsArena::Get();
-    arena->RegisterMetric(name_, repr_fn_, max_samples_, &data_ptr_);
+    arena->RegisterMetric(name_, repr_fn_, &data_ptr_);
     // Even if multiple threads will enter this IF statement, they will all
     // fetch the same value, and hence store the same value below.
     data = data_ptr_.get();
@@ -285,6 +480,19 @@ CounterData* Counter::GetData() const {
   return data;
 }
 
+Gauge::Gauge(std::string name) : name_(std::move(name)), data_(nullptr) {}
+
+CounterData* Gauge::GetData() const {
+  CounterData* data = data_.load();
+  if (TF_PREDICT_FALSE(data == nullptr)) {
+    MetricsArena* arena = MetricsArena::Get();
+    arena->RegisterGauge(name_, &data_ptr_);
+    data = data_ptr_.get();
+    data_.store(data);
+  }
+  return data;
+}
+
 std::string MetricFnValue(double value) {
   std::stringstream ss;
   ss.precision(2);
@@ -344,9 +552,17 @@ std::string CreateMetricReport() {
   arena->ForEachCounter([&ss](const std::string& name, CounterData* data) {
     EmitCounterInfo(name, data, &ss);
   });
+  arena->ForEachGauge([&ss](const std::string& name, CounterData* data) {
+    EmitGaugeInfo(name, data, &ss);
+  });
   return ss.str();
 }
 
+const std::vector<double>& GetReportPercentiles() {
+  static const std::vector<double>* metrics_percentiles = ReadEnvPercentiles();
+  return *metrics_percentiles;
+}
+
 std::vector<std::string> GetMetricNames() {
   return MetricsArena::Get()->GetMetricNames();
 }
@@ -363,5 +579,13 @@ CounterData* GetCounter(const std::string& name) {
   return MetricsArena::Get()->GetCounter(name);
 }
 
+std::vector<std::string> GetGaugeNames() {
+  return MetricsArena::Get()->GetGaugeNames();
+}
+
+CounterData* GetGauge(const std::string& name) {
+  return MetricsArena::Get()->GetGauge(name);
+}
+
 }  // namespace metrics
 }  // namespace xla
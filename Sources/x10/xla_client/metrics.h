@@ -18,6 +18,7 @@
 #define X10_XLA_CLIENT_METRICS_H_
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -25,30 +26,72 @@
 
 #include "absl/strings/str_cat.h"
 #include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
 #include "tensorflow/compiler/xla/types.h"
 
 namespace xla {
 namespace metrics {
 
-struct Sample {
-  Sample() = default;
-  Sample(int64 timestamp_ns, double value)
-      : timestamp_ns(timestamp_ns), value(value) {}
+using MetricReprFn = std::function<std::string(double)>;
 
-  int64 timestamp_ns = 0;
-  double value = 0;
+// The unit of the sample values of a metric, as implied by its MetricReprFn.
+enum class MetricUnit {
+  kNone,
+  kBytes,
+  // Times are in nanoseconds.
+  kTime,
 };
 
-using MetricReprFn = std::function<std::string(double)>;
+// A merged view of all the samples posted to a metric, since its creation.
+// Sample values are counted within log-bucketed (HDR histogram style) buckets:
+// every power of two range is split into kSubBuckets linear buckets, so the
+// values returned by Percentile() are within 1/(2*kSubBuckets) of the actual
+// ones (relative error).
+struct MetricSnapshot {
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  // The range of the (frexp() style) binary exponents of the tracked values.
+  // Values outside of it are counted within the first/last buckets, but the
+  // exact minimum and maximum are still tracked.
+  static constexpr int kMinExponent = -24;
+  static constexpr int kMaxExponent = 64;
+  // Bucket 0 counts the non positive values.
+  static constexpr size_t kNumBuckets =
+      1 + (kMaxExponent - kMinExponent) * kSubBuckets;
+
+  static size_t BucketIndex(double value);
+
+  // Returns the value the samples within the given bucket are accounted as.
+  static double BucketValue(size_t index);
+
+  // Returns the value below which falls the pct (0.0 < pct < 1.0) fraction of
+  // the samples.
+  double Percentile(double pct) const;
+
+  double Mean() const {
+    return total_samples > 0 ? accumulator / total_samples : 0.0;
+  }
 
-// Class used to collect time-stamped numeric samples. The samples are stored in
-// a circular buffer whose size can be configured at constructor time.
+  size_t total_samples = 0;
+  double accumulator = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  int64 first_timestamp_ns = 0;
+  int64 last_timestamp_ns = 0;
+  std::vector<uint64> buckets;
+};
+
+// Class used to collect time-stamped numeric samples. Samples are recorded
+// without locks, within per thread (group) shards which are merged only when
+// the metric is read, so that posting samples to heavily used metrics stays
+// cheap.
 class MetricData {
  public:
-  // Creates a new MetricData object with the internal circular buffer storing
-  // max_samples samples. The repr_fn argument allow to specify a function which
-  // pretty-prints a sample value.
-  MetricData(MetricReprFn repr_fn, size_t max_samples);
+  // The repr_fn argument allow to specify a function which pretty-prints a
+  // sample value.
+  explicit MetricData(MetricReprFn repr_fn);
+
+  ~MetricData();
 
   // Returns the total values of all the samples being posted to this metric.
   double Accumulator() const;
@@ -57,20 +100,22 @@ class MetricData {
 
   void AddSample(int64 timestamp_ns, double value);
 
-  // Returns a vector with all the current samples, from the oldest to the
-  // newer. If accumulator is not nullptr, it will receive the current value of
-  // the metrics' accumulator (the sum of all posted values). If total_samples
-  // is not nullptr, it will receive the count of the posted values.
-  std::vector<Sample> Samples(double* accumulator, size_t* total_samples) const;
+  // Returns the merged statistics of all the samples posted to the metric.
+  MetricSnapshot Snapshot() const;
 
   std::string Repr(double value) const { return repr_fn_(value); }
 
+  MetricUnit Unit() const;
+
  private:
-  mutable std::mutex lock_;
+  struct Shard;
+
+  static constexpr size_t kNumShards = 8;
+
+  Shard* GetShard();
+
   MetricReprFn repr_fn_;
-  size_t count_ = 0;
-  std::vector<Sample> samples_;
-  double accumulator_ = 0.0;
+  std::atomic<Shard*> shards_[kNumShards];
 };
 
 // Counters are a very lightweight form of metrics which do not need to track
@@ -106,8 +151,7 @@ std::string MetricFnTime(double value);
 //   }
 class Metric {
  public:
-  explicit Metric(std::string name, MetricReprFn repr_fn = MetricFnValue,
-                  size_t max_samples = 1024);
+  explicit Metric(std::string name, MetricReprFn repr_fn = MetricFnValue);
 
   const std::string& Name() const { return name_; }
 
@@ -117,7 +161,7 @@ class Metric {
 
   void AddSample(double value);
 
-  std::vector<Sample> Samples(double* accumulator, size_t* total_samples) const;
+  MetricSnapshot Snapshot() const;
 
   std::string Repr(double value) const;
 
@@ -126,7 +170,6 @@ class Metric {
 
   std::string name_;
   MetricReprFn repr_fn_;
-  size_t max_samples_;
   mutable std::shared_ptr<MetricData> data_ptr_;
   mutable std::atomic<MetricData*> data_;
 };
@@ -153,6 +196,25 @@ class Counter {
   mutable std::atomic<CounterData*> data_;
 };
 
+// A Gauge tracks an integer value which, unlike the counter ones, is expected
+// to go up and down during the process lifetime (like the number of bytes held
+// by a cache), and hence it is exported as a gauge by the metric exporters.
+class Gauge {
+ public:
+  explicit Gauge(std::string name);
+
+  void AddValue(xla::int64 value) { GetData()->AddValue(value); }
+
+  xla::int64 Value() const { return GetData()->Value(); }
+
+ private:
+  CounterData* GetData() const;
+
+  std::string name_;
+  mutable std::shared_ptr<CounterData> data_ptr_;
+  mutable std::atomic<CounterData*> data_;
+};
+
 #define XLA_COUNTER(name, value)                \
   do {                                          \
     static ::xla::metrics::Counter* __counter = \
@@ -172,6 +234,10 @@ class Counter {
 // Creates a report with the current metrics statistics.
 std::string CreateMetricReport();
 
+// Returns the percentiles emitted by the reports, as configured by the
+// XLA_METRICS_PERCENTILES environment variable.
+const std::vector<double>& GetReportPercentiles();
+
 // Returns the currently registered metric names. Note that the list can grow
 // since metrics are usualy function intialized (they are static function
 // variables).
@@ -190,6 +256,12 @@ std::vector<std::string> GetCounterNames();
 // does not exist.
 CounterData* GetCounter(const std::string& name);
 
+// Returns the currently registered gauge names.
+std::vector<std::string> GetGaugeNames();
+
+// Retrieves the data of a given gauge, or nullptr if such gauge does not exist.
+CounterData* GetGauge(const std::string& name);
+
 // Scope based utility class to measure the time the code takes within a given
 // C++ scope.
 class TimedSection {
@@ -200,6 +272,9 @@ class TimedSection {
   ~TimedSection() {
     int64 now = sys_util::NowNs();
     metric_->AddSample(now, now - start_);
+    if (trace_events::IsTracing()) {
+      trace_events::RecordEvent(metric_->Name(), start_, now);
+    }
   }
 
   double Elapsed() const {
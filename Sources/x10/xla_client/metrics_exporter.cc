@@ -0,0 +1,464 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/metrics_exporter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_replace.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+
+namespace xla {
+namespace metrics_exporter {
+namespace {
+
+using metrics::MetricSnapshot;
+using metrics::MetricUnit;
+
+// Histogram buckets are exported with power of two bounds, rather than with
+// the finer MetricSnapshot ones, to keep reports small.
+constexpr int kNumBucketGroups =
+    MetricSnapshot::kMaxExponent - MetricSnapshot::kMinExponent;
+
+double BucketGroupUpperBound(int group) {
+  return std::ldexp(1.0, group + MetricSnapshot::kMinExponent + 1);
+}
+
+// Returns the cumulative counts of the samples within the power of two
+// bucket groups.
+std::vector<uint64> CumulativeGroupCounts(const MetricSnapshot& snapshot) {
+  std::vector<uint64> counts(kNumBucketGroups, 0);
+  for (size_t i = 1; i < snapshot.buckets.size(); ++i) {
+    counts[(i - 1) / MetricSnapshot::kSubBuckets] += snapshot.buckets[i];
+  }
+  uint64 count = snapshot.buckets[0];
+  for (auto& group_count : counts) {
+    count += group_count;
+    group_count = count;
+  }
+  return counts;
+}
+
+double UnitScale(MetricUnit unit) {
+  return unit == MetricUnit::kTime ? 1e-9 : 1.0;
+}
+
+std::string FormatOpenMetricsValue(double value) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "+Inf" : "-Inf";
+  }
+  return absl::StrFormat("%.15g", value);
+}
+
+std::string FormatJsonValue(double value) {
+  return std::isfinite(value) ? absl::StrFormat("%.15g", value) : "null";
+}
+
+void AppendJsonString(const std::string& value, std::string* out) {
+  out->push_back('"');
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppend(out, "\\u00",
+                      absl::Hex(static_cast<int>(c), absl::kZeroPad2));
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+// Converts a CamelCase metric name into the snake case OpenMetrics one (for
+// example, "IrValueTensorToXlaData" becomes "x10_ir_value_tensor_to_xla_data").
+std::string OpenMetricsName(const std::string& name) {
+  std::string result = "x10_";
+  for (size_t i = 0; i < name.size(); ++i) {
+    char c = name[i];
+    if (std::isupper(c)) {
+      bool word_start =
+          i > 0 && (std::islower(name[i - 1]) || std::isdigit(name[i - 1]) ||
+                    (std::isupper(name[i - 1]) && i + 1 < name.size() &&
+                     std::islower(name[i + 1])));
+      if (word_start && result.back() != '_') {
+        result.push_back('_');
+      }
+      result.push_back(std::tolower(c));
+    } else if (std::isalnum(c)) {
+      result.push_back(c);
+    } else if (result.back() != '_') {
+      result.push_back('_');
+    }
+  }
+  return result;
+}
+
+std::string UnitSuffix(MetricUnit unit) {
+  switch (unit) {
+    case MetricUnit::kTime:
+      return "seconds";
+    case MetricUnit::kBytes:
+      return "bytes";
+    default:
+      return "";
+  }
+}
+
+std::string WithUnit(const std::string& name, const std::string& unit) {
+  if (unit.empty() || absl::EndsWith(name, absl::StrCat("_", unit))) {
+    return name;
+  }
+  return absl::StrCat(name, "_", unit);
+}
+
+void AppendOpenMetricsFamily(const std::string& family, const char* type,
+                             const std::string& unit, const std::string& help,
+                             std::string* out) {
+  absl::StrAppend(out, "# TYPE ", family, " ", type, "\n");
+  if (!unit.empty()) {
+    absl::StrAppend(out, "# UNIT ", family, " ", unit, "\n");
+  }
+  absl::StrAppend(out, "# HELP ", family, " ",
+                  absl::StrReplaceAll(help, {{"\\", "\\\\"},
+                                             {"\"", "\\\""},
+                                             {"\n", "\\n"}}),
+                  "\n");
+}
+
+std::string CreateOpenMetricsReport() {
+  std::string report;
+  // Distinct metrics might map to the same OpenMetrics name, in which case
+  // only the first one is exported, as families must be unique.
+  std::set<std::string> families;
+  auto add_family = [&](const std::string& family, const std::string& name) {
+    if (!families.insert(family).second) {
+      TF_VLOG(1) << "Skipping the export of " << name << ", as its "
+                 << family << " OpenMetrics name is already taken";
+      return false;
+    }
+    return true;
+  };
+
+  for (auto& name : metrics::GetCounterNames()) {
+    metrics::CounterData* data = metrics::GetCounter(name);
+    std::string family = OpenMetricsName(name);
+    if (data == nullptr || !add_family(family, name)) {
+      continue;
+    }
+    AppendOpenMetricsFamily(family, "counter", "",
+                            absl::StrCat("The ", name, " counter."), &report);
+    absl::StrAppend(&report, family, "_total ", data->Value(), "\n");
+  }
+  for (auto& name : metrics::GetGaugeNames()) {
+    metrics::CounterData* data = metrics::GetGauge(name);
+    std::string family = OpenMetricsName(name);
+    if (data == nullptr || !add_family(family, name)) {
+      continue;
+    }
+    AppendOpenMetricsFamily(family, "gauge", "",
+                            absl::StrCat("The ", name, " gauge."), &report);
+    absl::StrAppend(&report, family, " ", data->Value(), "\n");
+  }
+  for (auto& name : metrics::GetMetricNames()) {
+    metrics::MetricData* data = metrics::GetMetric(name);
+    if (data == nullptr) {
+      continue;
+    }
+    MetricUnit unit = data->Unit();
+    std::string unit_name = UnitSuffix(unit);
+    std::string base_name = OpenMetricsName(name);
+    std::string family = WithUnit(base_name, unit_name);
+    std::string min_family = WithUnit(absl::StrCat(base_name, "_min"),
+                                      unit_name);
+    std::string max_family = WithUnit(absl::StrCat(base_name, "_max"),
+                                      unit_name);
+    if (!add_family(family, name) || !add_family(min_family, name) ||
+        !add_family(max_family, name)) {
+      continue;
+    }
+    double scale = UnitScale(unit);
+    MetricSnapshot snapshot = data->Snapshot();
+
+    AppendOpenMetricsFamily(family, "histogram", unit_name,
+                            absl::StrCat("The ", name, " metric samples."),
+                            &report);
+    if (snapshot.buckets[0] > 0) {
+      absl::StrAppend(&report, family, "_bucket{le=\"0\"} ",
+                      snapshot.buckets[0], "\n");
+    }
+    std::vector<uint64> counts = CumulativeGroupCounts(snapshot);
+    // Only the groups between the first and last non empty ones are exported.
+    // The last group also counts the values beyond its bound, so it is only
+    // accounted within the +Inf bucket.
+    int first_group = 0;
+    int last_group = -1;
+    if (snapshot.total_samples > snapshot.buckets[0]) {
+      while (counts[first_group] == snapshot.buckets[0]) {
+        ++first_group;
+      }
+      last_group = first_group;
+      while (counts[last_group] < snapshot.total_samples) {
+        ++last_group;
+      }
+      last_group = std::min(last_group, kNumBucketGroups - 2);
+    }
+    for (int group = first_group; group <= last_group; ++group) {
+      absl::StrAppend(
+          &report, family, "_bucket{le=\"",
+          FormatOpenMetricsValue(BucketGroupUpperBound(group) * scale), "\"} ",
+          counts[group], "\n");
+    }
+    absl::StrAppend(&report, family, "_bucket{le=\"+Inf\"} ",
+                    snapshot.total_samples, "\n");
+    absl::StrAppend(&report, family, "_count ", snapshot.total_samples, "\n");
+    absl::StrAppend(&report, family, "_sum ",
+                    FormatOpenMetricsValue(snapshot.accumulator * scale), "\n");
+
+    AppendOpenMetricsFamily(min_family, "gauge", unit_name,
+                            absl::StrCat("The ", name, " minimum sample."),
+                            &report);
+    absl::StrAppend(&report, min_family, " ",
+                    FormatOpenMetricsValue(snapshot.min * scale), "\n");
+    AppendOpenMetricsFamily(max_family, "gauge", unit_name,
+                            absl::StrCat("The ", name, " maximum sample."),
+                            &report);
+    absl::StrAppend(&report, max_family, " ",
+                    FormatOpenMetricsValue(snapshot.max * scale), "\n");
+  }
+  report.append("# EOF\n");
+  return report;
+}
+
+std::string UnitName(MetricUnit unit) {
+  switch (unit) {
+    case MetricUnit::kTime:
+      return "nanoseconds";
+    case MetricUnit::kBytes:
+      return "bytes";
+    default:
+      return "";
+  }
+}
+
+std::string CreateJsonReport() {
+  std::string report =
+      absl::StrCat("{\"timestamp_ns\":", sys_util::NowNs(), ",\"counters\":{");
+  bool first = true;
+  for (auto& name : metrics::GetCounterNames()) {
+    metrics::CounterData* data = metrics::GetCounter(name);
+    if (data == nullptr) {
+      continue;
+    }
+    if (!first) {
+      report.push_back(',');
+    }
+    first = false;
+    AppendJsonString(name, &report);
+    absl::StrAppend(&report, ":{\"type\":\"counter\",\"value\":", data->Value(),
+                    "}");
+  }
+  report.append("},\"gauges\":{");
+  first = true;
+  for (auto& name : metrics::GetGaugeNames()) {
+    metrics::CounterData* data = metrics::GetGauge(name);
+    if (data == nullptr) {
+      continue;
+    }
+    if (!first) {
+      report.push_back(',');
+    }
+    first = false;
+    AppendJsonString(name, &report);
+    absl::StrAppend(&report, ":{\"type\":\"gauge\",\"value\":", data->Value(),
+                    "}");
+  }
+  report.append("},\"metrics\":{");
+  first = true;
+  for (auto& name : metrics::GetMetricNames()) {
+    metrics::MetricData* data = metrics::GetMetric(name);
+    if (data == nullptr) {
+      continue;
+    }
+    if (!first) {
+      report.push_back(',');
+    }
+    first = false;
+    MetricSnapshot snapshot = data->Snapshot();
+    AppendJsonString(name, &report);
+    report.append(":{\"type\":\"histogram\",\"unit\":");
+    AppendJsonString(UnitName(data->Unit()), &report);
+    absl::StrAppend(
+        &report, ",\"count\":", snapshot.total_samples,
+        ",\"sum\":", FormatJsonValue(snapshot.accumulator),
+        ",\"min\":", FormatJsonValue(snapshot.min),
+        ",\"max\":", FormatJsonValue(snapshot.max),
+        ",\"mean\":", FormatJsonValue(snapshot.Mean()),
+        ",\"first_timestamp_ns\":", snapshot.first_timestamp_ns,
+        ",\"last_timestamp_ns\":", snapshot.last_timestamp_ns,
+        ",\"percentiles\":{");
+    const std::vector<double>& percentiles = metrics::GetReportPercentiles();
+    for (size_t i = 0; i < percentiles.size(); ++i) {
+      absl::StrAppend(&report, i > 0 ? "," : "", "\"", percentiles[i], "\":",
+                      FormatJsonValue(snapshot.Percentile(percentiles[i])));
+    }
+    report.append("},\"buckets\":[");
+    std::vector<uint64> counts = CumulativeGroupCounts(snapshot);
+    bool first_bucket = true;
+    if (snapshot.buckets[0] > 0) {
+      absl::StrAppend(&report, "{\"le\":0,\"count\":", snapshot.buckets[0],
+                      "}");
+      first_bucket = false;
+    }
+    uint64 previous_count = snapshot.buckets[0];
+    for (int group = 0; group < kNumBucketGroups - 1; ++group) {
+      if (counts[group] == previous_count) {
+        continue;
+      }
+      absl::StrAppend(&report, first_bucket ? "" : ",", "{\"le\":",
+                      FormatJsonValue(BucketGroupUpperBound(group)),
+                      ",\"count\":", counts[group], "}");
+      first_bucket = false;
+      previous_count = counts[group];
+    }
+    absl::StrAppend(&report, "]}");
+  }
+  report.append("}}\n");
+  return report;
+}
+
+class PeriodicExporter {
+ public:
+  PeriodicExporter(std::string path, Format format, int64 period_ms)
+      : path_(std::move(path)),
+        format_(format),
+        period_(period_ms),
+        thread_([this]() { Run(); }) {}
+
+  ~PeriodicExporter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+      cv_.notify_all();
+    }
+    thread_.join();
+    WriteReport(path_, format_);
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, period_, [this]() { return stopped_; })) {
+      lock.unlock();
+      WriteReport(path_, format_);
+      lock.lock();
+    }
+  }
+
+  const std::string path_;
+  const Format format_;
+  const std::chrono::milliseconds period_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+struct ExportState {
+  std::mutex lock;
+  std::unique_ptr<PeriodicExporter> exporter;
+};
+
+ExportState* GetExportState() {
+  static ExportState* state = new ExportState();
+  return state;
+}
+
+}  // namespace
+
+bool ParseFormat(const std::string& name, Format* format) {
+  if (name == "openmetrics") {
+    *format = Format::kOpenMetrics;
+  } else if (name == "json") {
+    *format = Format::kJson;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string CreateReport(Format format) {
+  switch (format) {
+    case Format::kOpenMetrics:
+      return CreateOpenMetricsReport();
+    case Format::kJson:
+      return CreateJsonReport();
+  }
+  XLA_ERROR() << "Invalid metrics export format: " << static_cast<int>(format);
+}
+
+void WriteReport(const std::string& path, Format format) {
+  XLA_TIMED("MetricsExportTime");
+  std::string temp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream file(temp_path, std::ios::out | std::ios::trunc);
+    file << CreateReport(format);
+    if (!file) {
+      TF_LOG(ERROR) << "Unable to write metrics into " << temp_path;
+      return;
+    }
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    TF_LOG(ERROR) << "Unable to rename " << temp_path << " into " << path;
+  }
+}
+
+void StartPeriodicExport(const std::string& path, Format format,
+                         int64 period_ms) {
+  XLA_CHECK_GT(period_ms, 0);
+  ExportState* state = GetExportState();
+  std::lock_guard<std::mutex> lock(state->lock);
+  state->exporter.reset();
+  state->exporter =
+      absl::make_unique<PeriodicExporter>(path, format, period_ms);
+}
+
+void StopPeriodicExport() {
+  ExportState* state = GetExportState();
+  std::lock_guard<std::mutex> lock(state->lock);
+  state->exporter.reset();
+}
+
+}  // namespace metrics_exporter
+}  // namespace xla
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef X10_XLA_CLIENT_METRICS_EXPORTER_H_
+#define X10_XLA_CLIENT_METRICS_EXPORTER_H_
+
+#include <string>
+
+#include "tensorflow/compiler/xla/types.h"
+
+namespace xla {
+namespace metrics_exporter {
+
+enum class Format {
+  // The OpenMetrics (Prometheus) text exposition format.
+  kOpenMetrics,
+  kJson,
+};
+
+// Parses a format name ("openmetrics" or "json") into format. Returns false if
+// the name is not a valid one.
+bool ParseFormat(const std::string& name, Format* format);
+
+// Creates a machine readable export of the current metrics and counters.
+// In the OpenMetrics format, counters are exported as counters and gauges as
+// gauges, while metrics are exported as histograms (with power of two buckets),
+// plus min and max gauges. Names are the snake case version of the metric
+// ones, with an "x10_" prefix and a unit suffix (time metrics are exported in
+// seconds).
+// The JSON format keeps the metric names and units, and has the form:
+//
+//   {"timestamp_ns": ...,
+//    "counters": {"<name>": {"type": "counter", "value": ...}, ...},
+//    "gauges": {"<name>": {"type": "gauge", "value": ...}, ...},
+//    "metrics": {"<name>": {"type": "histogram", "unit": ..., "count": ...,
+//                           "sum": ..., "min": ..., "max": ..., "mean": ...,
+//                           "percentiles": {"0.5": ..., ...},
+//                           "buckets": [{"le": ..., "count": ...}, ...]},
+//                ...}}
+//
+// where the bucket counts are cumulative, like the OpenMetrics ones.
+std::string CreateReport(Format format);
+
+// Writes the report into path, atomically replacing the previous content (so
+// that concurrent readers never see a partial report).
+void WriteReport(const std::string& path, Format format);
+
+// Starts a background thread writing the report into path every period_ms
+// milliseconds, replacing any previously started export. A last report is
+// written when the export is stopped.
+void StartPeriodicExport(const std::string& path, Format format,
+                         int64 period_ms);
+
+void StopPeriodicExport();
+
+}  // namespace metrics_exporter
+}  // namespace xla
+
+#endif  // X10_XLA_CLIENT_METRICS_EXPORTER_H_
@@ -0,0 +1,105 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/metrics_exporter.h"
+
+#include <string>
+
+#include "absl/strings/match.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace xla {
+namespace metrics_exporter {
+namespace {
+
+void RecordTestMetrics() {
+  static bool recorded = false;
+  if (recorded) {
+    return;
+  }
+  recorded = true;
+  XLA_COUNTER("ExporterTestCounter", 3);
+  XLA_COUNTER("XRTExporterTestCounter", 1);
+  static metrics::Gauge* gauge = new metrics::Gauge("ExporterTestGauge");
+  gauge->AddValue(5);
+  gauge->AddValue(-7);
+  static metrics::Metric* time_metric =
+      new metrics::Metric("ExporterTestTime", metrics::MetricFnTime);
+  // 1ms, 2ms and 4ms, which fall within distinct power of two buckets.
+  time_metric->AddSample(1e6);
+  time_metric->AddSample(2e6);
+  time_metric->AddSample(4e6);
+}
+
+TEST(MetricsExporterTest, ParseFormat) {
+  Format format;
+  ASSERT_TRUE(ParseFormat("openmetrics", &format));
+  EXPECT_EQ(format, Format::kOpenMetrics);
+  ASSERT_TRUE(ParseFormat("json", &format));
+  EXPECT_EQ(format, Format::kJson);
+  EXPECT_FALSE(ParseFormat("xml", &format));
+}
+
+TEST(MetricsExporterTest, OpenMetricsReport) {
+  RecordTestMetrics();
+  std::string report = CreateReport(Format::kOpenMetrics);
+
+  EXPECT_TRUE(absl::StrContains(
+      report, "# TYPE x10_exporter_test_counter counter\n"));
+  EXPECT_TRUE(
+      absl::StrContains(report, "\nx10_exporter_test_counter_total 3\n"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\nx10_xrt_exporter_test_counter_total 1\n"));
+
+  // Gauges can go down, so they must not be exported as counters.
+  EXPECT_TRUE(
+      absl::StrContains(report, "# TYPE x10_exporter_test_gauge gauge\n"));
+  EXPECT_TRUE(absl::StrContains(report, "\nx10_exporter_test_gauge -2\n"));
+  EXPECT_FALSE(absl::StrContains(report, "x10_exporter_test_gauge_total"));
+
+  EXPECT_TRUE(absl::StrContains(
+      report, "# TYPE x10_exporter_test_time_seconds histogram\n"
+              "# UNIT x10_exporter_test_time_seconds seconds\n"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\nx10_exporter_test_time_seconds_bucket{le=\"+Inf\"} 3\n"
+              "x10_exporter_test_time_seconds_count 3\n"
+              "x10_exporter_test_time_seconds_sum 0.007\n"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\nx10_exporter_test_time_min_seconds 0.001\n"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\nx10_exporter_test_time_max_seconds 0.004\n"));
+  EXPECT_TRUE(absl::EndsWith(report, "# EOF\n"));
+}
+
+TEST(MetricsExporterTest, JsonReport) {
+  RecordTestMetrics();
+  std::string report = CreateReport(Format::kJson);
+
+  EXPECT_TRUE(absl::StartsWith(report, "{\"timestamp_ns\":"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\"ExporterTestCounter\":{\"type\":\"counter\",\"value\":3}"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\"gauges\":{\"ExporterTestGauge\":{\"type\":\"gauge\","
+              "\"value\":-2}"));
+  EXPECT_TRUE(absl::StrContains(
+      report, "\"ExporterTestTime\":{\"type\":\"histogram\",\"unit\":"
+              "\"nanoseconds\",\"count\":3,\"sum\":7000000,\"min\":1000000,"
+              "\"max\":4000000,"));
+  EXPECT_TRUE(absl::EndsWith(report, "}}\n"));
+}
+
+}  // namespace
+}  // namespace metrics_exporter
+}  // namespace xla
@@ -0,0 +1,194 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "tensorflow/core/platform/test.h"
+
+namespace xla {
+namespace metrics {
+namespace {
+
+// The relative error of the values the buckets account their samples as.
+constexpr double kMaxRelativeError = 1.0 / (2 * MetricSnapshot::kSubBuckets);
+
+void ExpectNear(double value, double expected) {
+  EXPECT_LE(std::abs(value - expected), expected * kMaxRelativeError)
+      << value << " vs. " << expected;
+}
+
+TEST(MetricsTest, BucketIndexOfNonPositiveValues) {
+  EXPECT_EQ(MetricSnapshot::BucketIndex(0.0), 0);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(-0.0), 0);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(-1.0), 0);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                -std::numeric_limits<double>::infinity()),
+            0);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::numeric_limits<double>::quiet_NaN()),
+            0);
+  EXPECT_EQ(MetricSnapshot::BucketValue(0), 0.0);
+}
+
+TEST(MetricsTest, BucketIndexOutOfRange) {
+  // Values below and above the tracked exponents go to the first and last
+  // positive buckets.
+  size_t last = MetricSnapshot::kNumBuckets - 1;
+  EXPECT_EQ(MetricSnapshot::BucketIndex(std::numeric_limits<double>::min()),
+            1);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::numeric_limits<double>::denorm_min()),
+            1);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::ldexp(1.0, MetricSnapshot::kMinExponent - 1)),
+            1);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::ldexp(1.0, MetricSnapshot::kMaxExponent)),
+            last);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(std::numeric_limits<double>::max()),
+            last);
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::numeric_limits<double>::infinity()),
+            last);
+  // The largest tracked value is in the last bucket as well.
+  EXPECT_EQ(MetricSnapshot::BucketIndex(
+                std::nextafter(std::ldexp(1.0, MetricSnapshot::kMaxExponent),
+                               0.0)),
+            last);
+}
+
+TEST(MetricsTest, BucketIndexWithinRange) {
+  // Walks the tracked range in steps smaller than the buckets: the indices
+  // never decrease, each bucket is hit, and the bucket values are within the
+  // relative error of the values.
+  double lowest = std::ldexp(1.0, MetricSnapshot::kMinExponent);
+  double highest = std::ldexp(1.0, MetricSnapshot::kMaxExponent);
+  size_t previous = MetricSnapshot::BucketIndex(lowest);
+  EXPECT_EQ(previous, 1);
+  for (double value = lowest; value < highest;
+       value *= 1.0 + kMaxRelativeError / 2) {
+    size_t index = MetricSnapshot::BucketIndex(value);
+    ASSERT_GE(index, previous) << value;
+    ASSERT_LE(index, previous + 1) << value;
+    ASSERT_LT(index, MetricSnapshot::kNumBuckets) << value;
+    ExpectNear(MetricSnapshot::BucketValue(index), value);
+    previous = index;
+  }
+  EXPECT_EQ(previous, MetricSnapshot::kNumBuckets - 1);
+
+  // Powers of two start a bucket, and the values right below them end the
+  // previous one.
+  for (int exponent = MetricSnapshot::kMinExponent + 1;
+       exponent < MetricSnapshot::kMaxExponent; ++exponent) {
+    double value = std::ldexp(1.0, exponent);
+    size_t index = MetricSnapshot::BucketIndex(value);
+    EXPECT_EQ(MetricSnapshot::BucketIndex(std::nextafter(value, 0.0)),
+              index - 1)
+        << value;
+    EXPECT_EQ((index - 1) % MetricSnapshot::kSubBuckets, 0) << value;
+  }
+}
+
+TEST(MetricsTest, EmptySnapshot) {
+  MetricData data(MetricFnValue);
+  MetricSnapshot snapshot = data.Snapshot();
+  EXPECT_EQ(snapshot.total_samples, 0);
+  EXPECT_EQ(snapshot.Percentile(0.5), 0.0);
+  EXPECT_EQ(snapshot.Mean(), 0.0);
+}
+
+TEST(MetricsTest, Percentiles) {
+  MetricData data(MetricFnValue);
+  for (int i = 1; i <= 1000; ++i) {
+    data.AddSample(i, i);
+  }
+  MetricSnapshot snapshot = data.Snapshot();
+  EXPECT_EQ(snapshot.total_samples, 1000);
+  EXPECT_EQ(snapshot.accumulator, 500500);
+  EXPECT_EQ(snapshot.min, 1);
+  EXPECT_EQ(snapshot.max, 1000);
+  EXPECT_EQ(snapshot.first_timestamp_ns, 1);
+  EXPECT_EQ(snapshot.last_timestamp_ns, 1000);
+  for (double pct : {0.01, 0.05, 0.1, 0.2, 0.5, 0.8, 0.9, 0.95, 0.99}) {
+    ExpectNear(snapshot.Percentile(pct), pct * 1000 + 1);
+  }
+  // The estimates never leave the range of the samples.
+  EXPECT_GE(snapshot.Percentile(0.0001), 1);
+  EXPECT_LE(snapshot.Percentile(0.9999), 1000);
+}
+
+TEST(MetricsTest, PercentilesOfConstantSamples) {
+  MetricData data(MetricFnValue);
+  for (int i = 0; i < 10; ++i) {
+    data.AddSample(i, 3.0);
+  }
+  MetricSnapshot snapshot = data.Snapshot();
+  // The bucket value is clamped to the exact minimum and maximum.
+  EXPECT_EQ(snapshot.Percentile(0.01), 3.0);
+  EXPECT_EQ(snapshot.Percentile(0.99), 3.0);
+}
+
+TEST(MetricsTest, PercentilesOfNonPositiveSamples) {
+  MetricData data(MetricFnValue);
+  data.AddSample(0, -5.0);
+  for (int i = 0; i < 5; ++i) {
+    data.AddSample(0, 0.0);
+  }
+  for (int i = 0; i < 4; ++i) {
+    data.AddSample(0, 100.0);
+  }
+  MetricSnapshot snapshot = data.Snapshot();
+  EXPECT_EQ(snapshot.min, -5.0);
+  // The non positive values share bucket 0, which is accounted as the minimum
+  // or zero, whichever is lower.
+  EXPECT_EQ(snapshot.Percentile(0.05), -5.0);
+  EXPECT_EQ(snapshot.Percentile(0.5), -5.0);
+  EXPECT_EQ(snapshot.Percentile(0.7), 100.0);
+}
+
+TEST(MetricsTest, SnapshotMergesThreads) {
+  const int kNumThreads = 16;
+  const int kNumSamples = 1000;
+  MetricData data(MetricFnValue);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&data, t]() {
+      for (int i = 0; i < kNumSamples; ++i) {
+        data.AddSample(t * kNumSamples + i, t + 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  MetricSnapshot snapshot = data.Snapshot();
+  EXPECT_EQ(snapshot.total_samples, kNumThreads * kNumSamples);
+  EXPECT_EQ(data.TotalSamples(), kNumThreads * kNumSamples);
+  EXPECT_EQ(snapshot.accumulator,
+            kNumSamples * kNumThreads * (kNumThreads + 1) / 2);
+  EXPECT_EQ(data.Accumulator(), snapshot.accumulator);
+  EXPECT_EQ(snapshot.min, 1);
+  EXPECT_EQ(snapshot.max, kNumThreads);
+  EXPECT_EQ(snapshot.first_timestamp_ns, 0);
+  ExpectNear(snapshot.Percentile(0.5), kNumThreads / 2 + 1);
+}
+
+}  // namespace
+}  // namespace metrics
+}  // namespace xla
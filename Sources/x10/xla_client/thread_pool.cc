@@ -14,24 +14,59 @@
 
 #include "tensorflow/compiler/xla/xla_client/thread_pool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <exception>
 #include <mutex>
+#include <string>
+#include <vector>
 
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
 
 namespace xla {
 namespace env {
 namespace {
 
+// A work stealing thread pool. Every worker thread owns a deque of closures:
+// closures scheduled by a worker go to the back of its own deque, which the
+// worker pops from (LIFO, for cache locality), while idle workers steal from
+// the front of the others' deques. Closures scheduled by threads outside the
+// pool go into a shared injection queue.
+// Closures might block waiting for other closures (for example via
+// util::MultiWait), so every scheduled closure either wakes up an idle worker,
+// or adds a new one to the pool. Unlike threads created for a single closure,
+// added workers stay within the pool, up to max_threads of them. Beyond that,
+// closures are queued until a worker becomes available, which deadlocks if all
+// the workers are blocked waiting for the queued closures. So max_threads must
+// be at least the number of closures which wait for each other (like the
+// replicas of a computation), and saturation is logged.
 class ThreadPool {
  public:
-  explicit ThreadPool(size_t num_threads) {
-    threads_.reserve(num_threads);
-    for (size_t i = 0; i < num_threads; ++i) {
-      threads_.emplace_back([this]() { Worker(); });
+  ThreadPool(const std::string& name, size_t num_threads, size_t max_threads,
+             const char* max_size_env_var)
+      : name_(name),
+        max_size_env_var_(max_size_env_var),
+        closure_event_name_(absl::StrCat(name, "Closure")),
+        max_threads_(std::max<size_t>(max_threads, 1)),
+        queues_(max_threads_ + 1),
+        queue_depth_(absl::StrCat(name, "QueueDepth")),
+        wait_time_(absl::StrCat(name, "WaitTime"), metrics::MetricFnTime),
+        threads_created_(absl::StrCat(name, "ThreadsCreated")),
+        saturated_(absl::StrCat(name, "Saturated")) {
+    for (auto& queue : queues_) {
+      queue = absl::make_unique<WorkQueue>();
+    }
+    threads_.reserve(max_threads_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < std::min(num_threads, max_threads_); ++i) {
+      AddWorker();
     }
   }
 
@@ -47,73 +82,186 @@ class ThreadPool {
   }
 
   void Schedule(std::function<void()> closure) {
-    // If we have more work scheduled than waiting worker threads, just schedule
-    // it on a separate thread. This prevents tricky thread-pool-size-deadlocks
-    // caused by an undersized thread pool and closures that end up doing sync
-    // waits on the pool threads.
-    bool scheduled = false;
+    WorkQueue* queue = current_pool_ == this ? queues_[current_worker_].get()
+                                             : queues_[max_threads_].get();
     {
-      std::lock_guard<std::mutex> lock(mutex_);
-      if (work_.size() < waiting_) {
-        work_.emplace_back(std::move(closure));
-        scheduled = true;
-      }
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->work.push_back(Work{std::move(closure), sys_util::NowNs()});
     }
-    if (scheduled) {
+    size_t pending = pending_.fetch_add(1) + 1;
+    queue_depth_.AddSample(pending);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_ > 0) {
+      --idle_;
+      ++wakeups_;
       cv_.notify_one();
+    } else if (num_threads_ < max_threads_) {
+      AddWorker();
     } else {
-      ScheduleOnThread(std::move(closure));
+      saturated_.AddValue(1);
+      if (!saturation_logged_) {
+        saturation_logged_ = true;
+        TF_LOG(WARNING) << name_ << " saturated with " << max_threads_
+                        << " threads, queueing closures. Closures waiting for "
+                           "queued ones will deadlock, raise "
+                        << max_size_env_var_ << " if the pool stalls";
+      }
     }
   }
 
  private:
-  void Worker() {
+  struct Work {
+    std::function<void()> closure;
+    int64 schedule_time_ns;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Work> work;
+  };
+
+  // Must be called with mutex_ held.
+  void AddWorker() {
+    size_t index = num_threads_.load();
+    threads_.emplace_back([this, index]() { Worker(index); });
+    num_threads_ = index + 1;
+    threads_created_.AddValue(1);
+  }
+
+  void Worker(size_t index) {
+    current_pool_ = this;
+    current_worker_ = index;
+    trace_events::SetThreadName(absl::StrCat(name_, "/", index));
     while (true) {
-      std::function<void()> closure = GetWork();
-      if (closure == nullptr) {
+      Work work;
+      if (GetWork(index, &work)) {
+        wait_time_.AddSample(sys_util::NowNs() - work.schedule_time_ns);
+        trace_events::TraceScope trace(closure_event_name_.c_str());
+        work.closure();
+      } else if (!WaitForWork()) {
         break;
       }
-      closure();
     }
   }
 
-  void ScheduleOnThread(std::function<void()> closure) {
-    std::thread thread(std::move(closure));
-    thread.detach();
+  bool GetWork(size_t index, Work* work) {
+    if (PopBack(queues_[index].get(), work) ||
+        PopFront(queues_[max_threads_].get(), work)) {
+      return true;
+    }
+    size_t num_threads = num_threads_.load();
+    for (size_t i = 1; i < num_threads; ++i) {
+      if (PopFront(queues_[(index + i) % num_threads].get(), work)) {
+        return true;
+      }
+    }
+    return false;
   }
 
-  std::function<void()> GetWork() {
+  bool PopBack(WorkQueue* queue, Work* work) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->work.empty()) {
+      return false;
+    }
+    *work = std::move(queue->work.back());
+    queue->work.pop_back();
+    pending_.fetch_sub(1);
+    return true;
+  }
+
+  bool PopFront(WorkQueue* queue, Work* work) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->work.empty()) {
+      return false;
+    }
+    *work = std::move(queue->work.front());
+    queue->work.pop_front();
+    pending_.fetch_sub(1);
+    return true;
+  }
+
+  // Sleeps until a new closure is scheduled. Returns false if the pool is
+  // exiting.
+  bool WaitForWork() {
     std::unique_lock<std::mutex> lock(mutex_);
-    ++waiting_;
-    cv_.wait(lock, [this] { return exiting_ || !work_.empty(); });
-    --waiting_;
-    if (work_.empty()) {
-      return nullptr;
+    // A closure scheduled after the last GetWork() scan, sees this worker as
+    // busy and wakes up (or creates) another one. Rescan instead of sleeping.
+    if (pending_.load() > 0) {
+      return !exiting_;
+    }
+    ++idle_;
+    cv_.wait(lock, [this] { return exiting_ || wakeups_ > 0; });
+    if (wakeups_ > 0) {
+      --wakeups_;
+    } else {
+      --idle_;
     }
-    std::function<void()> closure(std::move(work_.front()));
-    work_.pop_front();
-    return closure;
+    return !exiting_;
   }
 
+  static thread_local ThreadPool* current_pool_;
+  static thread_local size_t current_worker_;
+
+  const std::string name_;
+  const char* const max_size_env_var_;
+  const std::string closure_event_name_;
+  const size_t max_threads_;
+  // One queue per worker, plus the injection queue at index max_threads_.
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> num_threads_{0};
+  metrics::Metric queue_depth_;
+  metrics::Metric wait_time_;
+  metrics::Counter threads_created_;
+  metrics::Counter saturated_;
   std::vector<std::thread> threads_;
   std::mutex mutex_;
   std::condition_variable cv_;
   bool exiting_ = false;
-  std::deque<std::function<void()>> work_;
-  size_t waiting_ = 0;
+  // Workers waiting for work, which have not been woken up yet.
+  size_t idle_ = 0;
+  // Wake ups issued by Schedule(), which the woken workers have yet to consume.
+  size_t wakeups_ = 0;
+  // Whether the first saturation of the pool has been logged.
+  bool saturation_logged_ = false;
 };
 
+thread_local ThreadPool* ThreadPool::current_pool_ = nullptr;
+thread_local size_t ThreadPool::current_worker_ = 0;
+
+// The default bound on the number of threads of a pool. Blocking closures (like
+// the replicas of a computation waiting for each other) need as many threads
+// as there are of them running concurrently, so the bound is large.
+constexpr size_t kDefaultMaxThreads = 256;
+
+ThreadPool* CreateThreadPool(const std::string& name,
+                             const char* size_env_var, size_t default_size,
+                             const char* max_size_env_var) {
+  size_t num_threads = sys_util::GetEnvInt(size_env_var, default_size);
+  size_t max_threads = sys_util::GetEnvInt(
+      max_size_env_var, std::max<size_t>(num_threads, kDefaultMaxThreads));
+  return new ThreadPool(name, num_threads, max_threads, max_size_env_var);
+}
+
 ThreadPool* GetThreadPool() {
-  static size_t num_threads = sys_util::GetEnvInt(
-      "XLA_THREAD_POOL_SIZE", std::thread::hardware_concurrency());
-  static ThreadPool* pool = new ThreadPool(num_threads);
+  static ThreadPool* pool = CreateThreadPool(
+      "ThreadPool", "XLA_THREAD_POOL_SIZE", std::thread::hardware_concurrency(),
+      "XLA_THREAD_POOL_MAX_SIZE");
   return pool;
 }
 
 ThreadPool* GetIoThreadPool() {
-  static size_t num_threads = sys_util::GetEnvInt(
-      "XLA_IO_THREAD_POOL_SIZE", std::thread::hardware_concurrency());
-  static ThreadPool* pool = new ThreadPool(num_threads);
+  static ThreadPool* pool = CreateThreadPool(
+      "IoThreadPool", "XLA_IO_THREAD_POOL_SIZE",
+      std::thread::hardware_concurrency(), "XLA_IO_THREAD_POOL_MAX_SIZE");
+  return pool;
+}
+
+ThreadPool* GetCompileThreadPool() {
+  static ThreadPool* pool =
+      CreateThreadPool("CompileThreadPool", "XLA_COMPILE_THREAD_POOL_SIZE", 1,
+                       "XLA_COMPILE_THREAD_POOL_MAX_SIZE");
   return pool;
 }
 
@@ -185,5 +333,17 @@ Completion ScheduleIoClosureWithCompletion(std::function<void()> closure) {
   return Completion(std::move(data));
 }
 
+void ScheduleCompileClosure(std::function<void()> closure) {
+  GetCompileThreadPool()->Schedule(std::move(closure));
+}
+
+Completion ScheduleCompileClosureWithCompletion(
+    std::function<void()> closure) {
+  auto data = std::make_shared<Completion::Data>();
+  GetCompileThreadPool()->Schedule(
+      Completion::Data::GetCompleter(data, std::move(closure)));
+  return Completion(std::move(data));
+}
+
 }  // namespace env
 }  // namespace xla
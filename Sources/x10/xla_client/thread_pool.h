@@ -47,6 +47,11 @@ Completion ScheduleClosureWithCompletion(std::function<void()> closure);
 void ScheduleIoClosure(std::function<void()> closure);
 Completion ScheduleIoClosureWithCompletion(std::function<void()> closure);
 
+// Schedules a computation compilation. Compilations run on their own threads,
+// so that long compilations do not delay the closures of the other pools.
+void ScheduleCompileClosure(std::function<void()> closure);
+Completion ScheduleCompileClosureWithCompletion(std::function<void()> closure);
+
 }  // namespace env
 }  // namespace xla
 
@@ -0,0 +1,310 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+
+namespace xla {
+namespace trace_events {
+namespace {
+
+struct Event {
+  std::string name;
+  // 'X' for complete events, 'i' for instant ones.
+  char phase;
+  int64 start_ns;
+  int64 end_ns;
+  EventArgs args;
+};
+
+struct ThreadEvents {
+  explicit ThreadEvents(int64 tid) : tid(tid) {}
+
+  std::mutex lock;
+  const int64 tid;
+  std::string name;
+  std::vector<Event> events;
+};
+
+void AppendJsonString(const std::string& value, std::string* out) {
+  out->push_back('"');
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppend(out, "\\u00",
+                          absl::Hex(static_cast<int>(c), absl::kZeroPad2));
+        } else {
+          out->push_back(c);
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+class Recorder {
+ public:
+  static Recorder* Get() {
+    static Recorder* recorder = new Recorder();
+    return recorder;
+  }
+
+  bool IsActive() const { return active_.load(std::memory_order_relaxed); }
+
+  void Start(const std::string& path, int64 num_steps) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (IsActive()) {
+      TF_LOG(WARNING) << "Trace events recording into " << path_
+                      << " restarted, writing the events recorded so far";
+      active_ = false;
+      Write();
+    }
+    // Drop the events added since the last recording stopped (by the scopes
+    // which were open at that time), which do not belong to the new one.
+    for (auto& thread_events : threads_) {
+      std::lock_guard<std::mutex> thread_lock(thread_events->lock);
+      thread_events->events.clear();
+    }
+    path_ = path;
+    steps_left_ = num_steps;
+    num_events_ = 0;
+    start_ns_ = sys_util::NowNs();
+    active_ = true;
+    TF_LOG(INFO) << "Recording trace events into " << path_
+                 << (num_steps > 0 ? absl::StrCat(" for ", num_steps, " steps")
+                                   : std::string());
+  }
+
+  void Stop() {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!IsActive()) {
+      return;
+    }
+    active_ = false;
+    Write();
+  }
+
+  void MarkStep() {
+    if (!IsActive()) {
+      return;
+    }
+    int64 now = sys_util::NowNs();
+    Add(Event{"MarkStep", 'i', now, now, {}});
+    std::lock_guard<std::mutex> lock(lock_);
+    if (IsActive() && steps_left_ > 0 && --steps_left_ == 0) {
+      active_ = false;
+      Write();
+    }
+  }
+
+  void Add(Event event) {
+    static const int64 max_events =
+        sys_util::GetEnvInt("XLA_TRACE_MAX_EVENTS", 1000000);
+    if (num_events_.fetch_add(1) >= max_events) {
+      XLA_COUNTER("TraceEventsDropped", 1);
+      return;
+    }
+    ThreadEvents* thread_events = GetThreadEvents();
+    std::lock_guard<std::mutex> lock(thread_events->lock);
+    thread_events->events.push_back(std::move(event));
+  }
+
+  void SetThreadName(std::string name) {
+    ThreadEvents* thread_events = GetThreadEvents();
+    std::lock_guard<std::mutex> lock(thread_events->lock);
+    thread_events->name = std::move(name);
+  }
+
+ private:
+  ThreadEvents* GetThreadEvents() {
+    // Every thread records into its own buffer, which outlives the thread, as
+    // the recorder keeps a reference to it.
+    static thread_local ThreadEvents* thread_events = nullptr;
+    if (thread_events == nullptr) {
+      std::lock_guard<std::mutex> lock(lock_);
+      threads_.push_back(std::make_shared<ThreadEvents>(threads_.size() + 1));
+      thread_events = threads_.back().get();
+    }
+    return thread_events;
+  }
+
+  // Must be called with lock_ held.
+  void Write() {
+    int64 pid = getpid();
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() {
+      if (!first) {
+        json.append(",\n");
+      }
+      first = false;
+    };
+    size_t num_events = 0;
+    for (auto& thread_events : threads_) {
+      std::lock_guard<std::mutex> lock(thread_events->lock);
+      if (thread_events->events.empty()) {
+        continue;
+      }
+      separator();
+      absl::StrAppend(&json,
+                      "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":", pid,
+                      ",\"tid\":", thread_events->tid, ",\"args\":{\"name\":");
+      AppendJsonString(thread_events->name.empty()
+                           ? absl::StrCat("Thread ", thread_events->tid)
+                           : thread_events->name,
+                       &json);
+      json.append("}}");
+      for (auto& event : thread_events->events) {
+        // Scopes open across a restart end within a recording they did not
+        // start in.
+        if (event.start_ns < start_ns_) {
+          continue;
+        }
+        separator();
+        json.append("{\"name\":");
+        AppendJsonString(event.name, &json);
+        // Timestamps are in microseconds, relative to the recording start.
+        double ts = (event.start_ns - start_ns_) / 1000.0;
+        absl::StrAppend(&json, ",\"ph\":\"", std::string(1, event.phase),
+                        "\",\"ts\":", absl::StrFormat("%.3f", ts),
+                        ",\"pid\":", pid, ",\"tid\":", thread_events->tid);
+        if (event.phase == 'X') {
+          double dur = (event.end_ns - event.start_ns) / 1000.0;
+          absl::StrAppend(&json, ",\"dur\":", absl::StrFormat("%.3f", dur));
+        } else {
+          json.append(",\"s\":\"p\"");
+        }
+        if (!event.args.empty()) {
+          json.append(",\"args\":{");
+          for (size_t i = 0; i < event.args.size(); ++i) {
+            if (i > 0) {
+              json.push_back(',');
+            }
+            AppendJsonString(event.args[i].first, &json);
+            json.push_back(':');
+            AppendJsonString(event.args[i].second, &json);
+          }
+          json.push_back('}');
+        }
+        json.push_back('}');
+        ++num_events;
+      }
+      thread_events->events.clear();
+    }
+    json.append("]}\n");
+
+    std::ofstream file(path_, std::ios::out | std::ios::trunc);
+    file << json;
+    if (!file) {
+      TF_LOG(ERROR) << "Unable to write trace events into " << path_;
+    } else {
+      TF_LOG(INFO) << "Wrote " << num_events << " trace events into " << path_;
+    }
+  }
+
+  std::mutex lock_;
+  std::atomic<bool> active_{false};
+  std::atomic<int64> num_events_{0};
+  std::string path_;
+  int64 steps_left_ = 0;
+  int64 start_ns_ = 0;
+  std::vector<std::shared_ptr<ThreadEvents>> threads_;
+};
+
+bool StartTracingFromEnv() {
+  std::string path = sys_util::GetEnvString("XLA_TRACE_FILE", "");
+  if (!path.empty()) {
+    StartTracing(path, sys_util::GetEnvInt("XLA_TRACE_STEPS", 10));
+  }
+  return true;
+}
+
+}  // namespace
+
+void StartTracing(const std::string& path, int64 num_steps) {
+  Recorder::Get()->Start(path, num_steps);
+}
+
+void StopTracing() { Recorder::Get()->Stop(); }
+
+bool IsTracing() {
+  static const bool env_checked = StartTracingFromEnv();
+  (void)env_checked;
+  return Recorder::Get()->IsActive();
+}
+
+void MarkStep() {
+  if (IsTracing()) {
+    Recorder::Get()->MarkStep();
+  }
+}
+
+void SetThreadName(std::string name) {
+  Recorder::Get()->SetThreadName(std::move(name));
+}
+
+void RecordEvent(std::string name, int64 start_ns, int64 end_ns,
+                 EventArgs args) {
+  if (IsTracing()) {
+    Recorder::Get()->Add(
+        Event{std::move(name), 'X', start_ns, end_ns, std::move(args)});
+  }
+}
+
+TraceScope::TraceScope(const char* name) : name_(name) {
+  if (IsTracing()) {
+    start_ns_ = sys_util::NowNs();
+  }
+}
+
+TraceScope::TraceScope(const char* name, size_t graph_hash)
+    : name_(name), graph_hash_(graph_hash), has_graph_hash_(true) {
+  if (IsTracing()) {
+    start_ns_ = sys_util::NowNs();
+  }
+}
+
+TraceScope::~TraceScope() {
+  if (start_ns_ >= 0) {
+    EventArgs args;
+    if (has_graph_hash_) {
+      args.emplace_back("graph_hash", absl::StrCat(graph_hash_));
+    }
+    RecordEvent(name_, start_ns_, sys_util::NowNs(), std::move(args));
+  }
+}
+
+}  // namespace trace_events
+}  // namespace xla
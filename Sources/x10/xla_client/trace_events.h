@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef X10_XLA_CLIENT_TRACE_EVENTS_H_
+#define X10_XLA_CLIENT_TRACE_EVENTS_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/compiler/xla/types.h"
+
+namespace xla {
+namespace trace_events {
+
+using EventArgs = std::vector<std::pair<std::string, std::string>>;
+
+// Starts recording trace events, for the next num_steps steps (or until
+// StopTracing() is called, if num_steps is 0). When the recording stops, the
+// events are written into path, in the Chrome trace event JSON format, which
+// can be loaded by chrome://tracing or the Perfetto UI.
+// If a recording is already active, its events are written first, and the
+// recording restarts. Recording can also be started at process start, by
+// setting the XLA_TRACE_FILE (and XLA_TRACE_STEPS) environment variables.
+void StartTracing(const std::string& path, int64 num_steps);
+
+// Stops the recording, and writes the recorded events. Does nothing if no
+// recording is active.
+void StopTracing();
+
+// Returns whether trace events are being recorded.
+bool IsTracing();
+
+// Marks the end of a step, stopping the recording if the requested number of
+// steps has been reached.
+void MarkStep();
+
+// Sets the name of the calling thread track within the timeline.
+void SetThreadName(std::string name);
+
+// Records an event for the calling thread, which took place between the
+// start_ns and end_ns times (as returned by sys_util::NowNs()).
+void RecordEvent(std::string name, int64 start_ns, int64 end_ns,
+                 EventArgs args = {});
+
+// Records the time spent within a C++ scope as a trace event, if recording.
+// The name must outlive the scope. The optional graph hash argument is only
+// formatted if the event is actually recorded.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name);
+
+  TraceScope(const char* name, size_t graph_hash);
+
+  ~TraceScope();
+
+ private:
+  const char* name_;
+  int64 start_ns_ = -1;
+  size_t graph_hash_ = 0;
+  bool has_graph_hash_ = false;
+};
+
+}  // namespace trace_events
+}  // namespace xla
+
+#endif  // X10_XLA_CLIENT_TRACE_EVENTS_H_
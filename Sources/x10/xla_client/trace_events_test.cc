@@ -0,0 +1,87 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace xla {
+namespace trace_events {
+namespace {
+
+std::string TracePath(const std::string& name) {
+  return absl::StrCat(::testing::TempDir(), "/", name, ".json");
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+TEST(TraceEventsTest, RecordsSteps) {
+  std::string path = TracePath("steps");
+  StartTracing(path, /*num_steps=*/2);
+  ASSERT_TRUE(IsTracing());
+  { TraceScope scope("FirstStep"); }
+  MarkStep();
+  ASSERT_TRUE(IsTracing());
+  RecordEvent("SecondStep", sys_util::NowNs(), sys_util::NowNs(),
+              {{"key", "va\"lue"}});
+  MarkStep();
+  EXPECT_FALSE(IsTracing());
+
+  std::string trace = ReadFile(path);
+  EXPECT_TRUE(absl::StartsWith(trace, "{\"displayTimeUnit\":\"ms\","));
+  EXPECT_TRUE(absl::StrContains(trace, "{\"name\":\"FirstStep\",\"ph\":\"X\""));
+  EXPECT_TRUE(absl::StrContains(trace, "\"args\":{\"key\":\"va\\\"lue\"}"));
+  EXPECT_TRUE(absl::StrContains(trace, "{\"name\":\"MarkStep\",\"ph\":\"i\""));
+}
+
+TEST(TraceEventsTest, StartRestartsActiveRecording) {
+  std::string first_path = TracePath("first");
+  std::string second_path = TracePath("second");
+  StartTracing(first_path, /*num_steps=*/0);
+  { TraceScope scope("FirstRecording"); }
+  // A scope open across the restart belongs to neither recording.
+  auto open_scope = absl::make_unique<TraceScope>("AcrossRestart");
+  StartTracing(second_path, /*num_steps=*/0);
+  EXPECT_TRUE(IsTracing());
+  open_scope.reset();
+  { TraceScope scope("SecondRecording"); }
+  StopTracing();
+  EXPECT_FALSE(IsTracing());
+
+  std::string first_trace = ReadFile(first_path);
+  EXPECT_TRUE(absl::StrContains(first_trace, "FirstRecording"));
+  EXPECT_FALSE(absl::StrContains(first_trace, "SecondRecording"));
+  std::string second_trace = ReadFile(second_path);
+  EXPECT_FALSE(absl::StrContains(second_trace, "FirstRecording"));
+  EXPECT_FALSE(absl::StrContains(second_trace, "AcrossRestart"));
+  EXPECT_TRUE(absl::StrContains(second_trace, "SecondRecording"));
+  EXPECT_FALSE(absl::StrContains(second_trace, "\"ts\":-"));
+}
+
+}  // namespace
+}  // namespace trace_events
+}  // namespace xla
@@ -19,6 +19,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -1046,6 +1047,24 @@ class NonOwnedAnyScalarBuffer : public AnyScalarBuffer {
   }
 };
 
+// Implementation of Scalar buffer pointing into memory owned by another
+// object, which the buffer keeps alive. Used to adopt the storage of results
+// fetched from the device without copying them.
+template <typename T>
+class SharedAnyScalarBuffer : public AnyScalarBuffer {
+ public:
+  SharedAnyScalarBuffer(std::shared_ptr<const void> owner, const T* data,
+                        size_t len)
+      : AnyScalarBuffer(internal::GetScalarType<T>()),
+        owner_(std::move(owner)) {
+    set_base(data);
+    set_size(len);
+  }
+
+ private:
+  std::shared_ptr<const void> owner_;
+};
+
 template <typename T>
 std::unique_ptr<AnyScalarBuffer> AnyScalarBuffer::make(
     std::unique_ptr<T[]> data, size_t len) {
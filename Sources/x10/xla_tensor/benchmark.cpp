@@ -0,0 +1,531 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for the host side (tracing) paths of the x10 runtime.
+//
+// Usage: benchmark [--filter=<substring>] [--repetitions=<n>]
+//                  [--json=<path>] [--device=<device>|default]
+//
+// Every benchmark runs once to warm up, then --repetitions times, and reports
+// the median, minimum and maximum of its measurements. With --json the results
+// are also written as JSON, with a fixed key order and number formatting, so
+// that files from different runs can be diffed and tracked over time. The
+// benchmarks which execute computations only run when a --device is given, and
+// run on the FakeComputationClient the binary is linked with, which measures
+// the x10 side of the execution paths without a device or a server.
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/cache.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/util.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/copy_kernels.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/device.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir_util.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/lowering_context.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/op_by_op_executor.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ops/arithmetic_ir_ops.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ops/scalar.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/tensor.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/tensor_util.h"
+
+namespace swift_xla {
+namespace {
+
+// Keeps the compiler from optimizing away the measured computations.
+volatile size_t result_sink = 0;
+
+struct BenchmarkOptions {
+  std::string filter;
+  int repetitions = 5;
+  std::string json_path;
+  // Empty if the benchmarks which need a device should not run.
+  std::string device;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  std::string unit;
+  double median = 0;
+  double min = 0;
+  double max = 0;
+};
+
+class BenchmarkRunner {
+ public:
+  explicit BenchmarkRunner(BenchmarkOptions options)
+      : options_(std::move(options)) {}
+
+  const BenchmarkOptions& options() const { return options_; }
+
+  // Runs the fn benchmark, which returns a single measurement in unit, if its
+  // name matches the filter.
+  void Run(const std::string& name, const std::string& unit,
+           const std::function<double()>& fn) {
+    if (!absl::StrContains(name, options_.filter)) {
+      return;
+    }
+    fn();
+    std::vector<double> samples;
+    for (int i = 0; i < options_.repetitions; ++i) {
+      samples.push_back(fn());
+    }
+    std::sort(samples.begin(), samples.end());
+    BenchmarkResult result;
+    result.name = name;
+    result.unit = unit;
+    result.median = samples[samples.size() / 2];
+    result.min = samples.front();
+    result.max = samples.back();
+    absl::PrintF("%s: %.3f %s (min %.3f, max %.3f)\n", result.name,
+                 result.median, result.unit, result.min, result.max);
+    results_.push_back(std::move(result));
+  }
+
+  void WriteJson() const {
+    if (options_.json_path.empty()) {
+      return;
+    }
+    std::string json = "{\n  \"context\": {\n";
+    absl::StrAppendFormat(&json, "    \"device\": \"%s\",\n", options_.device);
+    absl::StrAppendFormat(&json, "    \"host_cpus\": %d,\n",
+                          std::thread::hardware_concurrency());
+    absl::StrAppendFormat(&json, "    \"repetitions\": %d\n",
+                          options_.repetitions);
+    json += "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const BenchmarkResult& result = results_[i];
+      absl::StrAppendFormat(&json,
+                            "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", "
+                            "\"median\": %.3f, \"min\": %.3f, \"max\": %.3f}",
+                            i > 0 ? "," : "", result.name, result.unit,
+                            result.median, result.min, result.max);
+    }
+    json += "\n  ]\n}\n";
+    std::ofstream file(options_.json_path, std::ios::out | std::ios::trunc);
+    XLA_CHECK(file.good()) << "Unable to open " << options_.json_path;
+    file << json;
+  }
+
+ private:
+  BenchmarkOptions options_;
+  std::vector<BenchmarkResult> results_;
+};
+
+// Measures the cost of creating IR nodes, while nested within scope_depth IR
+// scopes. Nodes are kept alive until the end of the run, so that their
+// destruction is not accounted for.
+double BenchmarkNodeConstruction(size_t num_nodes, size_t scope_depth) {
+  std::vector<std::unique_ptr<ir::ScopePusher>> scopes;
+  for (size_t i = 0; i < scope_depth; ++i) {
+    scopes.emplace_back(new ir::ScopePusher(absl::StrCat("scope", i)));
+  }
+  ir::Value one = ir::MakeNode<ir::ops::Scalar>(1.0, xla::F32);
+  std::vector<ir::NodePtr> nodes;
+  nodes.reserve(num_nodes);
+  xla::int64 start = xla::sys_util::NowNs();
+  for (size_t i = 0; i < num_nodes; ++i) {
+    nodes.push_back(one + one);
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  nodes.clear();
+  while (!scopes.empty()) {
+    scopes.pop_back();
+  }
+  ir::ScopePusher::ResetScopes();
+  return static_cast<double>(elapsed) / num_nodes;
+}
+
+// Builds a chain of num_nodes additions over a F32[size] operand.
+ir::Value MakeChainGraph(size_t num_nodes, xla::int64 size) {
+  ir::Value one =
+      ir::MakeNode<ir::ops::Scalar>(1.0, xla::ShapeUtil::MakeShape(xla::F32,
+                                                                   {size}));
+  ir::Value value = one;
+  for (size_t i = 0; i < num_nodes; ++i) {
+    value = value + one;
+  }
+  return value;
+}
+
+// Measures the cost of computing the post order and the hash of a graph, like
+// XLATensor::SyncTensorsGraph() does to look up its compilation cache.
+double BenchmarkGraphHash(size_t num_nodes) {
+  const int kIterations = 10;
+  ir::Value root = MakeChainGraph(num_nodes, 16);
+  const ir::Node* roots[] = {root.node.get()};
+  size_t hash = 0;
+  xla::int64 start = xla::sys_util::NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    for (const ir::Node* node : ir::Util::ComputePostOrder(roots)) {
+      hash = xla::util::HashCombine(hash, node->hash());
+    }
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  result_sink = hash;
+  return static_cast<double>(elapsed) / (kIterations * num_nodes);
+}
+
+// Measures the cost of creating nodes whose shape needs to be inferred (if
+// cold is true), or can be found in the IR shape cache.
+double BenchmarkShapeInference(bool cold) {
+  const size_t kNumNodes = 1000;
+  // Every cold run needs shapes which have never been seen before.
+  static xla::int64 next_size = 1;
+  xla::int64 base_size = next_size;
+  if (cold) {
+    next_size += kNumNodes;
+  }
+  std::vector<ir::Value> operands;
+  operands.reserve(kNumNodes);
+  for (size_t i = 0; i < kNumNodes; ++i) {
+    operands.push_back(ir::MakeNode<ir::ops::Scalar>(
+        1.0, xla::ShapeUtil::MakeShape(
+                 xla::F32, {base_size + static_cast<xla::int64>(i)})));
+  }
+  std::vector<ir::NodePtr> nodes;
+  nodes.reserve(kNumNodes);
+  xla::int64 start = xla::sys_util::NowNs();
+  for (auto& operand : operands) {
+    nodes.push_back(operand + operand);
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return static_cast<double>(elapsed) / kNumNodes;
+}
+
+// Measures the cost of lowering a graph of num_nodes nodes to an XLA
+// computation.
+double BenchmarkLowering(size_t num_nodes) {
+  ir::Value root = MakeChainGraph(num_nodes, 16);
+  xla::int64 start = xla::sys_util::NowNs();
+  ir::LoweringContext lowering_ctx("Benchmark");
+  lowering_ctx.AddResult(lowering_ctx.GetOutputOp(ir::Output(root.node.get())));
+  ConsumeValue(lowering_ctx.Build());
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return static_cast<double>(elapsed) / num_nodes;
+}
+
+// Measures the cost of looking up hash keys within a cache of the same type
+// as the XLATensor computation cache, holding as many entries as its default
+// size, with the given hit ratio.
+double BenchmarkCacheLookup(double hit_ratio) {
+  const size_t kNumEntries = 1024;
+  const size_t kNumLookups = 100000;
+  // Leave headroom, so that the hit ratio does not depend on the eviction
+  // policy of a full cache.
+  xla::util::ShardedCache<size_t, std::string> cache("BenchmarkCache",
+                                                     2 * kNumEntries);
+  for (size_t i = 0; i < kNumEntries; ++i) {
+    cache.Add(xla::util::Hash(i), std::make_shared<std::string>("entry"));
+  }
+  std::vector<size_t> keys;
+  keys.reserve(kNumLookups);
+  size_t num_hits = static_cast<size_t>(kNumLookups * hit_ratio);
+  for (size_t i = 0; i < kNumLookups; ++i) {
+    keys.push_back(xla::util::Hash(i < num_hits ? i % kNumEntries
+                                                : kNumEntries + i));
+  }
+  size_t found = 0;
+  xla::int64 start = xla::sys_util::NowNs();
+  for (size_t key : keys) {
+    found += cache.Get(key) != nullptr ? 1 : 0;
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  XLA_CHECK_EQ(found, num_hits);
+  return static_cast<double>(elapsed) / kNumLookups;
+}
+
+// Measures the throughput (in GB/s, counting both reads and writes) of copying
+// a rows x cols F32 tensor into a literal of the given shape.
+double BenchmarkCopyTensor(xla::int64 rows, xla::int64 cols,
+                           const xla::Shape& shape) {
+  const int kIterations = 10;
+  at::Tensor tensor(std::vector<float>(rows * cols, 1.0f),
+                    {static_cast<int64_t>(rows), static_cast<int64_t>(cols)});
+  Device device(DeviceType::CPU, 0);
+  xla::int64 bytes = 0;
+  xla::int64 start = xla::sys_util::NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    xla::Literal literal = GetTensorLiteral(tensor, &shape, &device);
+    bytes += rows * cols * sizeof(float) + literal.size_bytes();
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return static_cast<double>(bytes) / elapsed;
+}
+
+// Measures the throughput (in GB/s, counting both reads and writes) of the
+// float <-> bfloat16 conversions.
+double BenchmarkBFloat16Conversion(xla::int64 n, bool to_bf16) {
+  const int kIterations = 10;
+  std::vector<float> floats(n, 1.5f);
+  std::vector<xla::uint16> bf16s(n);
+  FloatToBFloat16(floats.data(), bf16s.data(), n);
+  xla::int64 start = xla::sys_util::NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    if (to_bf16) {
+      FloatToBFloat16(floats.data(), bf16s.data(), n);
+    } else {
+      BFloat16ToFloat(bf16s.data(), floats.data(), n);
+    }
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return static_cast<double>(n) * (sizeof(float) + sizeof(xla::uint16)) *
+         kIterations / elapsed;
+}
+
+// Measures the latency (in microseconds) of a synchronous
+// XLATensor::SyncTensorsGraph() of a graph which hits the computation cache.
+double BenchmarkSyncTensorsGraph(const Device& device, size_t num_ops) {
+  const int kIterations = 20;
+  XLATensor input =
+      XLATensor::Create(at::Tensor(std::vector<float>(1024, 1.0f), {1024}),
+                        device);
+  xla::int64 elapsed = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    XLATensor result = input;
+    for (size_t j = 0; j < num_ops; ++j) {
+      result = XLATensor::add(result, input);
+    }
+    std::vector<XLATensor> tensors({result});
+    xla::int64 start = xla::sys_util::NowNs();
+    XLATensor::SyncTensorsGraph(&tensors, {}, /*wait=*/true,
+                                /*sync_xla_data=*/false);
+    elapsed += xla::sys_util::NowNs() - start;
+  }
+  return static_cast<double>(elapsed) / (kIterations * 1000.0);
+}
+
+// Measures the latency (in microseconds) of executing a graph op by op, once
+// the op computations have been compiled.
+double BenchmarkOpByOp(const Device& device, size_t num_ops) {
+  const int kIterations = 20;
+  XLATensor input =
+      XLATensor::Create(at::Tensor(std::vector<float>(1024, 1.0f), {1024}),
+                        device);
+  ir::Value root = input.GetIrValue();
+  for (size_t j = 0; j < num_ops; ++j) {
+    root = root + input.GetIrValue();
+  }
+  std::string device_string = device.ToString();
+  xla::int64 start = xla::sys_util::NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    OpByOpExecutor::Get()->Execute({root}, device_string, {});
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return static_cast<double>(elapsed) / (kIterations * 1000.0);
+}
+
+void RunNodeConstructionBenchmarks(BenchmarkRunner* runner) {
+  const size_t kNumNodes = 100000;
+  for (size_t scope_depth : {0, 1, 4, 16}) {
+    // The warm up run fills the shape cache, so that only the node
+    // construction is measured.
+    runner->Run(absl::StrCat("NodeConstruction/scope_depth=", scope_depth),
+                "ns/node", [&]() {
+                  return BenchmarkNodeConstruction(kNumNodes, scope_depth);
+                });
+  }
+  for (size_t num_nodes : {100, 10000}) {
+    runner->Run(absl::StrCat("GraphHash/nodes=", num_nodes), "ns/node",
+                [&]() { return BenchmarkGraphHash(num_nodes); });
+  }
+}
+
+void RunShapeInferenceBenchmarks(BenchmarkRunner* runner) {
+  runner->Run("ShapeInference/cold", "ns/node",
+              []() { return BenchmarkShapeInference(/*cold=*/true); });
+  runner->Run("ShapeInference/cached", "ns/node",
+              []() { return BenchmarkShapeInference(/*cold=*/false); });
+}
+
+void RunLoweringBenchmarks(BenchmarkRunner* runner) {
+  for (size_t num_nodes : {100, 1000}) {
+    runner->Run(absl::StrCat("Lowering/nodes=", num_nodes), "ns/node",
+                [&]() { return BenchmarkLowering(num_nodes); });
+  }
+}
+
+void RunCacheLookupBenchmarks(BenchmarkRunner* runner) {
+  for (double hit_ratio : {1.0, 0.5, 0.0}) {
+    runner->Run(absl::StrFormat("ComputationCache/hit_ratio=%.1f", hit_ratio),
+                "ns/lookup", [&]() { return BenchmarkCacheLookup(hit_ratio); });
+  }
+}
+
+void RunCopyTensorBenchmarks(BenchmarkRunner* runner) {
+  // A CHW <-> HWC plane of a 56x56 image with 64 channels.
+  const xla::int64 kRows = 64;
+  const xla::int64 kCols = 3136;
+  const struct {
+    const char* name;
+    xla::PrimitiveType type;
+    std::vector<xla::int64> minor_to_major;
+  } kLayouts[] = {
+      {"f32/row_major", xla::F32, {1, 0}},
+      {"f32/col_major", xla::F32, {0, 1}},
+      {"bf16/row_major", xla::BF16, {1, 0}},
+      {"bf16/col_major", xla::BF16, {0, 1}},
+  };
+  for (auto& layout : kLayouts) {
+    xla::Shape shape = xla::ShapeUtil::MakeShapeWithLayout(
+        layout.type, {kRows, kCols}, layout.minor_to_major);
+    runner->Run(
+        absl::StrCat("CopyTensor/", kRows, "x", kCols, "/", layout.name),
+        "GB/s", [&]() { return BenchmarkCopyTensor(kRows, kCols, shape); });
+  }
+}
+
+void RunBFloat16Benchmarks(BenchmarkRunner* runner) {
+  const xla::int64 kNumElements = 1 << 20;
+  runner->Run("BFloat16/to_bf16", "GB/s", [&]() {
+    return BenchmarkBFloat16Conversion(kNumElements, /*to_bf16=*/true);
+  });
+  runner->Run("BFloat16/to_f32", "GB/s", [&]() {
+    return BenchmarkBFloat16Conversion(kNumElements, /*to_bf16=*/false);
+  });
+}
+
+const char* TransposeKernelName(TransposeKernel kernel) {
+  switch (kernel) {
+    case TransposeKernel::kScalar:
+      return "scalar";
+    case TransposeKernel::kBlocked:
+      return "blocked";
+    case TransposeKernel::kBest:
+      return "best";
+  }
+  return "unknown";
+}
+
+// Measures the throughput (in GB/s, counting both reads and writes) of the
+// transposed copies of a rows x cols matrix of element_size bytes elements.
+double BenchmarkTranspose(xla::int64 rows, xla::int64 cols,
+                          size_t element_size, TransposeKernel kernel) {
+  const int kIterations = 20;
+  std::vector<uint8_t> src(rows * cols * element_size, 1);
+  std::vector<uint8_t> dest(src.size());
+  // Warm up the caches and the page tables.
+  TransposeCopy(src.data(), cols, dest.data(), rows, rows, cols, element_size,
+                kernel);
+  xla::int64 start = xla::sys_util::NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    TransposeCopy(src.data(), cols, dest.data(), rows, rows, cols,
+                  element_size, kernel);
+  }
+  xla::int64 elapsed = xla::sys_util::NowNs() - start;
+  return 2.0 * src.size() * kIterations / static_cast<double>(elapsed);
+}
+
+void RunTransposeBenchmarks(BenchmarkRunner* runner) {
+  // A CHW <-> HWC plane of a 56x56 image with 64 channels, and a square matrix.
+  const std::pair<xla::int64, xla::int64> kShapes[] = {{64, 3136},
+                                                        {1024, 1024}};
+  for (auto& shape : kShapes) {
+    for (size_t element_size : {1, 2, 4, 8}) {
+      for (TransposeKernel kernel :
+           {TransposeKernel::kScalar, TransposeKernel::kBlocked,
+            TransposeKernel::kBest}) {
+        runner->Run(
+            absl::StrCat("Transpose/", shape.first, "x", shape.second,
+                         "/element_size=", element_size, "/",
+                         TransposeKernelName(kernel)),
+            "GB/s", [&]() {
+              return BenchmarkTranspose(shape.first, shape.second,
+                                        element_size, kernel);
+            });
+      }
+    }
+  }
+}
+
+void RunDeviceBenchmarks(BenchmarkRunner* runner) {
+  const std::string& device_spec = runner->options().device;
+  if (device_spec.empty()) {
+    return;
+  }
+  Device device =
+      device_spec == "default" ? *GetDefaultDevice() : Device(device_spec);
+  bool op_by_op = xla::ComputationClient::Get()->SupportsExecuteChained();
+  if (!op_by_op) {
+    absl::PrintF("Skipping the OpByOp benchmarks, as the computation client "
+                 "does not support chained execution\n");
+  }
+  for (size_t num_ops : {1, 100}) {
+    // The warm up run compiles the computations, so that only cache hits are
+    // measured.
+    runner->Run(absl::StrCat("SyncTensorsGraph/cache_hit/ops=", num_ops),
+                "us/step",
+                [&]() { return BenchmarkSyncTensorsGraph(device, num_ops); });
+    if (op_by_op) {
+      runner->Run(absl::StrCat("OpByOp/ops=", num_ops), "us/step",
+                  [&]() { return BenchmarkOpByOp(device, num_ops); });
+    }
+  }
+}
+
+BenchmarkOptions ParseOptions(int argc, char** argv) {
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    size_t pos = arg.find('=');
+    std::string name = arg.substr(0, pos);
+    std::string value = pos != std::string::npos ? arg.substr(pos + 1) : "";
+    if (name == "--filter") {
+      options.filter = value;
+    } else if (name == "--repetitions") {
+      XLA_CHECK(absl::SimpleAtoi(value, &options.repetitions) &&
+                options.repetitions > 0)
+          << "Invalid repetitions: " << value;
+    } else if (name == "--json") {
+      options.json_path = value;
+    } else if (name == "--device") {
+      options.device = value;
+    } else {
+      XLA_ERROR() << "Unknown argument: " << arg;
+    }
+  }
+  return options;
+}
+
+}  // namespace
+}  // namespace swift_xla
+
+int main(int argc, char** argv) {
+  swift_xla::BenchmarkRunner runner(swift_xla::ParseOptions(argc, argv));
+  swift_xla::RunNodeConstructionBenchmarks(&runner);
+  swift_xla::RunShapeInferenceBenchmarks(&runner);
+  swift_xla::RunLoweringBenchmarks(&runner);
+  swift_xla::RunCacheLookupBenchmarks(&runner);
+  swift_xla::RunCopyTensorBenchmarks(&runner);
+  swift_xla::RunBFloat16Benchmarks(&runner);
+  swift_xla::RunTransposeBenchmarks(&runner);
+  swift_xla::RunDeviceBenchmarks(&runner);
+  runner.WriteJson();
+  return 0;
+}
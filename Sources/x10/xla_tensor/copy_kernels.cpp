@@ -0,0 +1,488 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/copy_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define X10_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace swift_xla {
+namespace {
+
+// Edge of the square blocks the matrices are walked by, in bytes of a row,
+// sized so that a source and a destination block fit in L1.
+constexpr xla::int64 kBlockBytes = 256;
+
+template <typename T>
+using TileFn = void (*)(const T* src, xla::int64 src_row_stride, T* dest,
+                        xla::int64 dest_col_stride);
+
+template <typename T>
+void TransposeScalar(const T* src, xla::int64 src_row_stride, T* dest,
+                     xla::int64 dest_col_stride, xla::int64 rows,
+                     xla::int64 cols) {
+  for (xla::int64 i = 0; i < rows; ++i) {
+    for (xla::int64 j = 0; j < cols; ++j) {
+      dest[j * dest_col_stride + i] = src[i * src_row_stride + j];
+    }
+  }
+}
+
+template <typename T, xla::int64 kTile>
+void TransposeTileScalar(const T* src, xla::int64 src_row_stride, T* dest,
+                         xla::int64 dest_col_stride) {
+  TransposeScalar(src, src_row_stride, dest, dest_col_stride, kTile, kTile);
+}
+
+// Walks the matrix in blocks of kBlockBytes x kBlockBytes bytes. Within a
+// block, full kTile x kTile tiles go through tile_fn, and the block edges
+// through the scalar loop.
+template <typename T, xla::int64 kTile>
+void TransposeBlocked(const T* src, xla::int64 src_row_stride, T* dest,
+                      xla::int64 dest_col_stride, xla::int64 rows,
+                      xla::int64 cols, TileFn<T> tile_fn) {
+  constexpr xla::int64 kBlock =
+      std::max<xla::int64>(kBlockBytes / sizeof(T) / kTile, 1) * kTile;
+  for (xla::int64 ib = 0; ib < rows; ib += kBlock) {
+    xla::int64 ie = std::min(ib + kBlock, rows);
+    xla::int64 it = ib + (ie - ib) / kTile * kTile;
+    for (xla::int64 jb = 0; jb < cols; jb += kBlock) {
+      xla::int64 je = std::min(jb + kBlock, cols);
+      xla::int64 jt = jb + (je - jb) / kTile * kTile;
+      for (xla::int64 i = ib; i < it; i += kTile) {
+        for (xla::int64 j = jb; j < jt; j += kTile) {
+          tile_fn(src + i * src_row_stride + j, src_row_stride,
+                  dest + j * dest_col_stride + i, dest_col_stride);
+        }
+      }
+      TransposeScalar(src + ib * src_row_stride + jt, src_row_stride,
+                      dest + jt * dest_col_stride + ib, dest_col_stride,
+                      it - ib, je - jt);
+      TransposeScalar(src + it * src_row_stride + jb, src_row_stride,
+                      dest + jb * dest_col_stride + it, dest_col_stride,
+                      ie - it, je - jb);
+    }
+  }
+}
+
+// The bit pattern of the quiet NaN tensorflow::bfloat16 converts NaNs to.
+constexpr uint16_t kBFloat16NaN = 0x7fc0;
+
+uint16_t FloatToBFloat16Scalar(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return kBFloat16NaN;
+  }
+  uint32_t lsb = (bits >> 16) & 1;
+  return static_cast<uint16_t>((bits + 0x7fff + lsb) >> 16);
+}
+
+float BFloat16ToFloatScalar(uint16_t value) {
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+#ifdef X10_X86_KERNELS
+
+// SSE2 is part of the x86-64 baseline, so it needs no runtime check.
+void TransposeTile8x8x16Sse2(const uint16_t* src, xla::int64 src_row_stride,
+                             uint16_t* dest, xla::int64 dest_col_stride) {
+  __m128i r[8];
+  for (int k = 0; k < 8; ++k) {
+    r[k] = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(src + k * src_row_stride));
+  }
+  __m128i b0 = _mm_unpacklo_epi16(r[0], r[1]);
+  __m128i b1 = _mm_unpackhi_epi16(r[0], r[1]);
+  __m128i b2 = _mm_unpacklo_epi16(r[2], r[3]);
+  __m128i b3 = _mm_unpackhi_epi16(r[2], r[3]);
+  __m128i b4 = _mm_unpacklo_epi16(r[4], r[5]);
+  __m128i b5 = _mm_unpackhi_epi16(r[4], r[5]);
+  __m128i b6 = _mm_unpacklo_epi16(r[6], r[7]);
+  __m128i b7 = _mm_unpackhi_epi16(r[6], r[7]);
+  __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+  __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+  __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+  __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+  __m128i c4 = _mm_unpacklo_epi32(b4, b6);
+  __m128i c5 = _mm_unpackhi_epi32(b4, b6);
+  __m128i c6 = _mm_unpacklo_epi32(b5, b7);
+  __m128i c7 = _mm_unpackhi_epi32(b5, b7);
+  r[0] = _mm_unpacklo_epi64(c0, c4);
+  r[1] = _mm_unpackhi_epi64(c0, c4);
+  r[2] = _mm_unpacklo_epi64(c1, c5);
+  r[3] = _mm_unpackhi_epi64(c1, c5);
+  r[4] = _mm_unpacklo_epi64(c2, c6);
+  r[5] = _mm_unpackhi_epi64(c2, c6);
+  r[6] = _mm_unpacklo_epi64(c3, c7);
+  r[7] = _mm_unpackhi_epi64(c3, c7);
+  for (int k = 0; k < 8; ++k) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + k * dest_col_stride),
+                     r[k]);
+  }
+}
+
+__attribute__((target("avx2"))) void TransposeTile8x8x32Avx2(
+    const uint32_t* src, xla::int64 src_row_stride, uint32_t* dest,
+    xla::int64 dest_col_stride) {
+  __m256 r[8];
+  for (int k = 0; k < 8; ++k) {
+    r[k] = _mm256_loadu_ps(
+        reinterpret_cast<const float*>(src + k * src_row_stride));
+  }
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+  __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+  __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+  __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+  for (int k = 0; k < 8; ++k) {
+    _mm256_storeu_ps(reinterpret_cast<float*>(dest + k * dest_col_stride),
+                     r[k]);
+  }
+}
+
+__attribute__((target("avx2"))) void TransposeTile4x4x64Avx2(
+    const uint64_t* src, xla::int64 src_row_stride, uint64_t* dest,
+    xla::int64 dest_col_stride) {
+  __m256d r[4];
+  for (int k = 0; k < 4; ++k) {
+    r[k] = _mm256_loadu_pd(
+        reinterpret_cast<const double*>(src + k * src_row_stride));
+  }
+  __m256d t0 = _mm256_unpacklo_pd(r[0], r[1]);
+  __m256d t1 = _mm256_unpackhi_pd(r[0], r[1]);
+  __m256d t2 = _mm256_unpacklo_pd(r[2], r[3]);
+  __m256d t3 = _mm256_unpackhi_pd(r[2], r[3]);
+  r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+  r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+  r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+  r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+  for (int k = 0; k < 4; ++k) {
+    _mm256_storeu_pd(reinterpret_cast<double*>(dest + k * dest_col_stride),
+                     r[k]);
+  }
+}
+
+__attribute__((target("avx512f"))) void TransposeTile8x8x64Avx512(
+    const uint64_t* src, xla::int64 src_row_stride, uint64_t* dest,
+    xla::int64 dest_col_stride) {
+  __m512i r[8];
+  for (int k = 0; k < 8; ++k) {
+    r[k] = _mm512_loadu_si512(src + k * src_row_stride);
+  }
+  // Interleave the pairs of rows, then merge 128 and 256 bit lanes.
+  __m512i t[8];
+  for (int k = 0; k < 4; ++k) {
+    t[2 * k] = _mm512_unpacklo_epi64(r[2 * k], r[2 * k + 1]);
+    t[2 * k + 1] = _mm512_unpackhi_epi64(r[2 * k], r[2 * k + 1]);
+  }
+  const __m512i lanes_lo = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+  const __m512i lanes_hi = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+  __m512i u[8];
+  for (int k = 0; k < 2; ++k) {
+    u[4 * k] = _mm512_permutex2var_epi64(t[4 * k], lanes_lo, t[4 * k + 2]);
+    u[4 * k + 1] =
+        _mm512_permutex2var_epi64(t[4 * k + 1], lanes_lo, t[4 * k + 3]);
+    u[4 * k + 2] = _mm512_permutex2var_epi64(t[4 * k], lanes_hi, t[4 * k + 2]);
+    u[4 * k + 3] =
+        _mm512_permutex2var_epi64(t[4 * k + 1], lanes_hi, t[4 * k + 3]);
+  }
+  const __m512i halves_lo = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+  const __m512i halves_hi = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+  for (int k = 0; k < 4; ++k) {
+    r[k] = _mm512_permutex2var_epi64(u[k], halves_lo, u[k + 4]);
+    r[k + 4] = _mm512_permutex2var_epi64(u[k], halves_hi, u[k + 4]);
+  }
+  for (int k = 0; k < 8; ++k) {
+    _mm512_storeu_si512(dest + k * dest_col_stride, r[k]);
+  }
+}
+
+// Rounds the float values (as 32 bit integers) to the nearest even bfloat16,
+// leaving the result in the low 16 bits of each lane.
+__m128i RoundToBFloat16Sse2(__m128 values) {
+  __m128i bits = _mm_castps_si128(values);
+  __m128i lsb = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+  __m128i rounded = _mm_srli_epi32(
+      _mm_add_epi32(bits, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff))), 16);
+  __m128i nans = _mm_castps_si128(_mm_cmpunord_ps(values, values));
+  return _mm_or_si128(_mm_andnot_si128(nans, rounded),
+                      _mm_and_si128(nans, _mm_set1_epi32(kBFloat16NaN)));
+}
+
+void FloatToBFloat16Sse2(const float* src, uint16_t* dest, xla::int64 n) {
+  xla::int64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo = RoundToBFloat16Sse2(_mm_loadu_ps(src + i));
+    __m128i hi = RoundToBFloat16Sse2(_mm_loadu_ps(src + i + 4));
+    // SSE2 has only a signed saturating pack, so sign extend the 16 bit values
+    // to have it keep them intact.
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_packs_epi32(lo, hi));
+  }
+  for (; i < n; ++i) {
+    dest[i] = FloatToBFloat16Scalar(src[i]);
+  }
+}
+
+void BFloat16ToFloatSse2(const uint16_t* src, float* dest, xla::int64 n) {
+  const __m128i zero = _mm_setzero_si128();
+  xla::int64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_unpacklo_epi16(zero, values));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 4),
+                     _mm_unpackhi_epi16(zero, values));
+  }
+  for (; i < n; ++i) {
+    dest[i] = BFloat16ToFloatScalar(src[i]);
+  }
+}
+
+__attribute__((target("avx2"))) __m256i RoundToBFloat16Avx2(__m256 values) {
+  __m256i bits = _mm256_castps_si256(values);
+  __m256i lsb =
+      _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+  __m256i rounded = _mm256_srli_epi32(
+      _mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))),
+      16);
+  __m256i nans =
+      _mm256_castps_si256(_mm256_cmp_ps(values, values, _CMP_UNORD_Q));
+  return _mm256_blendv_epi8(rounded, _mm256_set1_epi32(kBFloat16NaN), nans);
+}
+
+__attribute__((target("avx2"))) void FloatToBFloat16Avx2(const float* src,
+                                                         uint16_t* dest,
+                                                         xla::int64 n) {
+  xla::int64 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i lo = RoundToBFloat16Avx2(_mm256_loadu_ps(src + i));
+    __m256i hi = RoundToBFloat16Avx2(_mm256_loadu_ps(src + i + 8));
+    // The pack works within 128 bit lanes, so restore the element order.
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi),
+                                              _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), packed);
+  }
+  for (; i < n; ++i) {
+    dest[i] = FloatToBFloat16Scalar(src[i]);
+  }
+}
+
+__attribute__((target("avx2"))) void BFloat16ToFloatAvx2(const uint16_t* src,
+                                                         float* dest,
+                                                         xla::int64 n) {
+  xla::int64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i values = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_slli_epi32(values, 16));
+  }
+  for (; i < n; ++i) {
+    dest[i] = BFloat16ToFloatScalar(src[i]);
+  }
+}
+
+__attribute__((target("avx512f"))) void FloatToBFloat16Avx512(
+    const float* src, uint16_t* dest, xla::int64 n) {
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i bias = _mm512_set1_epi32(0x7fff);
+  const __m512i nan = _mm512_set1_epi32(kBFloat16NaN);
+  xla::int64 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 values = _mm512_loadu_ps(src + i);
+    __m512i bits = _mm512_castps_si512(values);
+    __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), one);
+    __m512i rounded = _mm512_srli_epi32(
+        _mm512_add_epi32(bits, _mm512_add_epi32(lsb, bias)), 16);
+    __mmask16 nans = _mm512_cmp_ps_mask(values, values, _CMP_UNORD_Q);
+    rounded = _mm512_mask_mov_epi32(rounded, nans, nan);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm512_cvtepi32_epi16(rounded));
+  }
+  for (; i < n; ++i) {
+    dest[i] = FloatToBFloat16Scalar(src[i]);
+  }
+}
+
+__attribute__((target("avx512f"))) void BFloat16ToFloatAvx512(
+    const uint16_t* src, float* dest, xla::int64 n) {
+  xla::int64 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i values = _mm512_cvtepu16_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+    _mm512_storeu_si512(dest + i, _mm512_slli_epi32(values, 16));
+  }
+  for (; i < n; ++i) {
+    dest[i] = BFloat16ToFloatScalar(src[i]);
+  }
+}
+
+bool HasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+bool HasAvx512() {
+  static const bool has_avx512 = __builtin_cpu_supports("avx512f");
+  return has_avx512;
+}
+
+#endif  // X10_X86_KERNELS
+
+template <typename T>
+void TransposeTyped(const void* src, xla::int64 src_row_stride, void* dest,
+                    xla::int64 dest_col_stride, xla::int64 rows,
+                    xla::int64 cols, TransposeKernel kernel) {
+  const T* typed_src = static_cast<const T*>(src);
+  T* typed_dest = static_cast<T*>(dest);
+  if (kernel == TransposeKernel::kScalar) {
+    TransposeScalar(typed_src, src_row_stride, typed_dest, dest_col_stride,
+                    rows, cols);
+  } else {
+    TransposeBlocked<T, 8>(typed_src, src_row_stride, typed_dest,
+                           dest_col_stride, rows, cols,
+                           TransposeTileScalar<T, 8>);
+  }
+}
+
+}  // namespace
+
+void TransposeCopy(const void* src, xla::int64 src_row_stride, void* dest,
+                   xla::int64 dest_col_stride, xla::int64 rows,
+                   xla::int64 cols, size_t element_size,
+                   TransposeKernel kernel) {
+#ifdef X10_X86_KERNELS
+  if (kernel == TransposeKernel::kBest) {
+    switch (element_size) {
+      case 2:
+        return TransposeBlocked<uint16_t, 8>(
+            static_cast<const uint16_t*>(src), src_row_stride,
+            static_cast<uint16_t*>(dest), dest_col_stride, rows, cols,
+            TransposeTile8x8x16Sse2);
+      case 4:
+        if (HasAvx2()) {
+          return TransposeBlocked<uint32_t, 8>(
+              static_cast<const uint32_t*>(src), src_row_stride,
+              static_cast<uint32_t*>(dest), dest_col_stride, rows, cols,
+              TransposeTile8x8x32Avx2);
+        }
+        break;
+      case 8:
+        if (HasAvx512()) {
+          return TransposeBlocked<uint64_t, 8>(
+              static_cast<const uint64_t*>(src), src_row_stride,
+              static_cast<uint64_t*>(dest), dest_col_stride, rows, cols,
+              TransposeTile8x8x64Avx512);
+        }
+        if (HasAvx2()) {
+          return TransposeBlocked<uint64_t, 4>(
+              static_cast<const uint64_t*>(src), src_row_stride,
+              static_cast<uint64_t*>(dest), dest_col_stride, rows, cols,
+              TransposeTile4x4x64Avx2);
+        }
+        break;
+    }
+  }
+#endif  // X10_X86_KERNELS
+  switch (element_size) {
+    case 1:
+      return TransposeTyped<uint8_t>(src, src_row_stride, dest,
+                                     dest_col_stride, rows, cols, kernel);
+    case 2:
+      return TransposeTyped<uint16_t>(src, src_row_stride, dest,
+                                      dest_col_stride, rows, cols, kernel);
+    case 4:
+      return TransposeTyped<uint32_t>(src, src_row_stride, dest,
+                                      dest_col_stride, rows, cols, kernel);
+    case 8:
+      return TransposeTyped<uint64_t>(src, src_row_stride, dest,
+                                      dest_col_stride, rows, cols, kernel);
+  }
+  // Other element sizes are copied byte by byte.
+  const char* byte_src = static_cast<const char*>(src);
+  char* byte_dest = static_cast<char*>(dest);
+  for (xla::int64 i = 0; i < rows; ++i) {
+    for (xla::int64 j = 0; j < cols; ++j) {
+      std::copy_n(byte_src + (i * src_row_stride + j) * element_size,
+                  element_size,
+                  byte_dest + (j * dest_col_stride + i) * element_size);
+    }
+  }
+}
+
+void FloatToBFloat16(const float* src, xla::uint16* dest, xla::int64 n) {
+#ifdef X10_X86_KERNELS
+  if (HasAvx512()) {
+    return FloatToBFloat16Avx512(src, dest, n);
+  }
+  if (HasAvx2()) {
+    return FloatToBFloat16Avx2(src, dest, n);
+  }
+  return FloatToBFloat16Sse2(src, dest, n);
+#else
+  for (xla::int64 i = 0; i < n; ++i) {
+    dest[i] = FloatToBFloat16Scalar(src[i]);
+  }
+#endif  // X10_X86_KERNELS
+}
+
+void BFloat16ToFloat(const xla::uint16* src, float* dest, xla::int64 n) {
+#ifdef X10_X86_KERNELS
+  if (HasAvx512()) {
+    return BFloat16ToFloatAvx512(src, dest, n);
+  }
+  if (HasAvx2()) {
+    return BFloat16ToFloatAvx2(src, dest, n);
+  }
+  return BFloat16ToFloatSse2(src, dest, n);
+#else
+  for (xla::int64 i = 0; i < n; ++i) {
+    dest[i] = BFloat16ToFloatScalar(src[i]);
+  }
+#endif  // X10_X86_KERNELS
+}
+
+}  // namespace swift_xla
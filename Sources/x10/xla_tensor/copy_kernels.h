@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "tensorflow/compiler/xla/types.h"
+
+namespace swift_xla {
+
+enum class TransposeKernel {
+  // Element by element copy, walking the destination with a stride.
+  kScalar,
+  // Copy in cache sized blocks, still element by element.
+  kBlocked,
+  // Cache blocked copy using the SIMD tile transposes supported by the host
+  // CPU (AVX-512, AVX2 or SSE2), if any for the element size.
+  kBest,
+};
+
+// Copies a rows x cols matrix whose rows are contiguous in src (with
+// src_row_stride elements between rows), into dest where the columns are
+// contiguous (with dest_col_stride elements between columns):
+//
+//   dest[j * dest_col_stride + i] = src[i * src_row_stride + j]
+//
+// Elements are element_size bytes, and the source and destination must not
+// overlap.
+void TransposeCopy(const void* src, xla::int64 src_row_stride, void* dest,
+                   xla::int64 dest_col_stride, xla::int64 rows,
+                   xla::int64 cols, size_t element_size,
+                   TransposeKernel kernel = TransposeKernel::kBest);
+
+// Converts n float values into bfloat16 ones (stored as their bit patterns),
+// rounding to the nearest even like tensorflow::bfloat16 does. NaN values
+// become the canonical bfloat16 quiet NaN.
+void FloatToBFloat16(const float* src, xla::uint16* dest, xla::int64 n);
+
+// Converts n bfloat16 values (stored as their bit patterns) into float ones.
+void BFloat16ToFloat(const xla::uint16* src, float* dest, xla::int64 n);
+
+}  // namespace swift_xla
@@ -0,0 +1,265 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/copy_kernels.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/lib/bfloat16/bfloat16.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+// Fills the padding bytes of the destinations, which the copies must not
+// touch.
+constexpr uint8_t kPadding = 0xa5;
+
+// Element by element reference of TransposeCopy().
+std::vector<uint8_t> ReferenceTranspose(const std::vector<uint8_t>& src,
+                                        xla::int64 src_row_stride,
+                                        xla::int64 dest_col_stride,
+                                        xla::int64 rows, xla::int64 cols,
+                                        size_t element_size) {
+  std::vector<uint8_t> dest(cols * dest_col_stride * element_size, kPadding);
+  for (xla::int64 i = 0; i < rows; ++i) {
+    for (xla::int64 j = 0; j < cols; ++j) {
+      for (size_t k = 0; k < element_size; ++k) {
+        dest[(j * dest_col_stride + i) * element_size + k] =
+            src[(i * src_row_stride + j) * element_size + k];
+      }
+    }
+  }
+  return dest;
+}
+
+void ExpectTransposeMatchesReference(xla::int64 rows, xla::int64 cols,
+                                     xla::int64 src_row_stride,
+                                     xla::int64 dest_col_stride,
+                                     size_t element_size) {
+  std::vector<uint8_t> src(rows * src_row_stride * element_size);
+  for (size_t i = 0; i < src.size(); ++i) {
+    // Distinct bytes within each element, and distinct elements, as long as
+    // the indices fit, so that swapped bytes or elements are caught.
+    src[i] = static_cast<uint8_t>(i * 7 + i / 251);
+  }
+  std::vector<uint8_t> expected = ReferenceTranspose(
+      src, src_row_stride, dest_col_stride, rows, cols, element_size);
+  for (TransposeKernel kernel :
+       {TransposeKernel::kScalar, TransposeKernel::kBlocked,
+        TransposeKernel::kBest}) {
+    std::vector<uint8_t> dest(expected.size(), kPadding);
+    TransposeCopy(src.data(), src_row_stride, dest.data(), dest_col_stride,
+                  rows, cols, element_size, kernel);
+    EXPECT_EQ(dest, expected)
+        << "kernel=" << static_cast<int>(kernel) << " rows=" << rows
+        << " cols=" << cols << " src_row_stride=" << src_row_stride
+        << " dest_col_stride=" << dest_col_stride
+        << " element_size=" << element_size;
+  }
+}
+
+TEST(CopyKernelsTest, TransposeCopyMatchesReference) {
+  // Shapes smaller than the tiles, multiple of the 4 and 8 element tiles,
+  // with partial tiles at the edges, and spanning more than one block.
+  std::vector<std::pair<xla::int64, xla::int64>> shapes = {
+      {1, 1},  {1, 17}, {17, 1},  {3, 5},   {4, 4},   {8, 8},
+      {7, 9},  {9, 7},  {16, 24}, {33, 65}, {64, 64}, {130, 67},
+      {67, 300}};
+  for (size_t element_size : {1, 2, 3, 4, 8, 16}) {
+    for (auto& shape : shapes) {
+      xla::int64 rows = shape.first;
+      xla::int64 cols = shape.second;
+      ExpectTransposeMatchesReference(rows, cols, cols, rows, element_size);
+      // Rows and columns not contiguous to each other.
+      ExpectTransposeMatchesReference(rows, cols, cols + 3, rows + 5,
+                                      element_size);
+    }
+  }
+}
+
+TEST(CopyKernelsTest, TransposeCopyEmpty) {
+  for (size_t element_size : {1, 2, 4, 8}) {
+    for (TransposeKernel kernel :
+         {TransposeKernel::kScalar, TransposeKernel::kBlocked,
+          TransposeKernel::kBest}) {
+      std::vector<uint8_t> dest(8 * element_size, kPadding);
+      TransposeCopy(nullptr, 0, dest.data(), 0, 0, 0, element_size, kernel);
+      TransposeCopy(nullptr, 8, dest.data(), 0, 0, 8, element_size, kernel);
+      TransposeCopy(nullptr, 0, dest.data(), 8, 8, 0, element_size, kernel);
+      EXPECT_EQ(dest, std::vector<uint8_t>(8 * element_size, kPadding));
+    }
+  }
+}
+
+uint32_t FloatBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float BitsToFloat(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+bool IsBFloat16NaN(xla::uint16 value) {
+  return (value & 0x7fff) > 0x7f80;
+}
+
+// Converts the values one at a time, which takes the scalar path of the
+// conversion kernels, and all at once at every offset and length up to
+// max_length, which takes the SIMD paths and their tails, and checks that all
+// the conversions agree.
+std::vector<xla::uint16> CheckedFloatToBFloat16(
+    const std::vector<float>& values, size_t max_length) {
+  std::vector<xla::uint16> result(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    FloatToBFloat16(&values[i], &result[i], 1);
+  }
+  std::vector<xla::uint16> all(values.size());
+  FloatToBFloat16(values.data(), all.data(), values.size());
+  EXPECT_EQ(all, result);
+  for (size_t offset = 0; offset < 3 && offset < values.size(); ++offset) {
+    for (size_t n = 0; n <= max_length && offset + n <= values.size(); ++n) {
+      std::vector<xla::uint16> part(n + 1, 0xdead);
+      FloatToBFloat16(values.data() + offset, part.data(), n);
+      EXPECT_EQ(part.back(), 0xdead) << n;
+      part.pop_back();
+      EXPECT_EQ(part, std::vector<xla::uint16>(result.begin() + offset,
+                                               result.begin() + offset + n))
+          << "offset=" << offset << " n=" << n;
+    }
+  }
+  return result;
+}
+
+TEST(CopyKernelsTest, BFloat16ToFloatIsExact) {
+  std::vector<xla::uint16> values(1 << 16);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<xla::uint16>(i);
+  }
+  std::vector<float> floats(values.size());
+  BFloat16ToFloat(values.data(), floats.data(), values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    ASSERT_EQ(FloatBits(floats[i]), static_cast<uint32_t>(values[i]) << 16)
+        << i;
+    tensorflow::bfloat16 expected;
+    expected.value = values[i];
+    if (!IsBFloat16NaN(values[i])) {
+      ASSERT_EQ(floats[i], static_cast<float>(expected)) << i;
+    }
+  }
+  // Tails of the SIMD loops.
+  for (size_t n = 0; n <= 40; ++n) {
+    std::vector<float> part(n + 1, -1.0f);
+    BFloat16ToFloat(values.data() + 0x3f80, part.data(), n);
+    EXPECT_EQ(part.back(), -1.0f);
+    part.pop_back();
+    EXPECT_EQ(part, std::vector<float>(floats.begin() + 0x3f80,
+                                       floats.begin() + 0x3f80 + n));
+  }
+}
+
+TEST(CopyKernelsTest, BFloat16RoundTrip) {
+  // All the bfloat16 values convert to floats which convert back to the same
+  // bfloat16 values, except for the NaNs, which become the canonical one.
+  std::vector<float> floats(1 << 16);
+  for (size_t i = 0; i < floats.size(); ++i) {
+    floats[i] = BitsToFloat(static_cast<uint32_t>(i) << 16);
+  }
+  std::vector<xla::uint16> values = CheckedFloatToBFloat16(floats, 40);
+  for (size_t i = 0; i < values.size(); ++i) {
+    xla::uint16 expected = static_cast<xla::uint16>(i);
+    if (IsBFloat16NaN(expected)) {
+      expected = 0x7fc0;
+    }
+    ASSERT_EQ(values[i], expected) << i;
+  }
+}
+
+TEST(CopyKernelsTest, FloatToBFloat16MatchesTensorflow) {
+  // For every bfloat16 value, the floats just above and below it and the
+  // halfway ones, whose rounding goes to the even neighbour.
+  std::vector<float> floats;
+  for (uint32_t high = 0; high < (1 << 16); ++high) {
+    for (uint32_t low : {0x0000, 0x0001, 0x7fff, 0x8000, 0x8001, 0xffff}) {
+      float value = BitsToFloat(high << 16 | low);
+      // Subnormals and NaNs are checked separately below.
+      if (std::isnan(value) || std::fpclassify(value) == FP_SUBNORMAL) {
+        continue;
+      }
+      floats.push_back(value);
+    }
+  }
+  std::vector<xla::uint16> values = CheckedFloatToBFloat16(floats, 40);
+  for (size_t i = 0; i < floats.size(); ++i) {
+    ASSERT_EQ(values[i], tensorflow::bfloat16(floats[i]).value)
+        << "float bits " << std::hex << FloatBits(floats[i]);
+  }
+
+  // Ties round to even, and the largest floats overflow to infinities.
+  EXPECT_EQ(CheckedFloatToBFloat16(
+                {BitsToFloat(0x3f808000), BitsToFloat(0x3f818000),
+                 std::numeric_limits<float>::max(),
+                 -std::numeric_limits<float>::max(),
+                 std::numeric_limits<float>::infinity(), -0.0f},
+                6),
+            std::vector<xla::uint16>(
+                {0x3f80, 0x3f82, 0x7f80, 0xff80, 0x7f80, 0x8000}));
+}
+
+TEST(CopyKernelsTest, FloatToBFloat16Subnormals) {
+  // Subnormals round to the nearest even subnormal bfloat16 like the normal
+  // values do.
+  EXPECT_EQ(
+      CheckedFloatToBFloat16(
+          {BitsToFloat(0x00000001), BitsToFloat(0x00008000),
+           BitsToFloat(0x00018000), BitsToFloat(0x00010001),
+           BitsToFloat(0x807fffff), std::numeric_limits<float>::denorm_min()},
+          6),
+      std::vector<xla::uint16>(
+          {0x0000, 0x0000, 0x0002, 0x0001, 0x8080, 0x0000}));
+}
+
+TEST(CopyKernelsTest, FloatToBFloat16NaNs) {
+  // Quiet and signaling NaNs of either sign, including the ones whose payload
+  // is in the bits dropped by the conversion, become the canonical NaN.
+  std::vector<float> nans;
+  for (uint32_t bits :
+       {0x7fc00000u, 0xffc00000u, 0x7f800001u, 0xff800001u, 0x7f80ffffu,
+        0x7fbfffffu, 0x7fffffffu, 0xffffffffu}) {
+    // Repeated to fill the SIMD lanes with NaNs of a kind.
+    for (int i = 0; i < 5; ++i) {
+      nans.push_back(BitsToFloat(bits));
+    }
+  }
+  nans.push_back(std::numeric_limits<float>::quiet_NaN());
+  nans.push_back(std::numeric_limits<float>::signaling_NaN());
+  std::vector<xla::uint16> values = CheckedFloatToBFloat16(nans, 40);
+  EXPECT_EQ(values, std::vector<xla::uint16>(nans.size(), 0x7fc0));
+
+  float converted;
+  BFloat16ToFloat(values.data(), &converted, 1);
+  EXPECT_TRUE(std::isnan(converted));
+}
+
+}  // namespace
+}  // namespace swift_xla
@@ -15,8 +15,12 @@
 #include "tensorflow/compiler/tf2xla/xla_tensor/cross_replica_reduces.h"
 
 #include <map>
+#include <numeric>
 
+#include "tensorflow/compiler/xla/xla_client/computation_client.h"
+#include "tensorflow/compiler/xla/xla_client/cpu_all_reduce.h"
 #include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/device.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/helpers.h"
@@ -80,6 +84,77 @@ xla::XlaComputation GetReduceComutation(AllReduceType reduce_type,
               << xla::util::GetEnumValue(reduce_type);
 }
 
+xla::cpu_all_reduce::ReduceKind GetCpuReduceKind(AllReduceType reduce_type) {
+  switch (reduce_type) {
+    case AllReduceType::kSum:
+      return xla::cpu_all_reduce::ReduceKind::kSum;
+    case AllReduceType::kMul:
+      return xla::cpu_all_reduce::ReduceKind::kMul;
+    case AllReduceType::kAnd:
+      return xla::cpu_all_reduce::ReduceKind::kAnd;
+    case AllReduceType::kOr:
+      return xla::cpu_all_reduce::ReduceKind::kOr;
+    case AllReduceType::kMin:
+      return xla::cpu_all_reduce::ReduceKind::kMin;
+    case AllReduceType::kMax:
+      return xla::cpu_all_reduce::ReduceKind::kMax;
+  }
+  XLA_ERROR() << "Invalid reduce type: "
+              << xla::util::GetEnumValue(reduce_type);
+}
+
+// The XLA CPU backend cannot run AllReduce across replicas, so for replicated
+// computations on the CPU devices of the local client, the reduction is routed
+// to the in-process runtime in cpu_all_reduce.h. Can be disabled by setting
+// XLA_CPU_ALL_REDUCE to false.
+bool UseCpuAllReduce() {
+  static const bool use_cpu_all_reduce =
+      xla::sys_util::GetEnvBool("XLA_CPU_ALL_REDUCE", true);
+  return use_cpu_all_reduce && xla::ComputationClient::IsLocal() &&
+         GetCurrentDevice().hw_type == DeviceType::CPU &&
+         xla::ComputationClient::Get()->GetReplicationDevices().size() > 1;
+}
+
+xla::XlaOp BuildCpuAllReduce(
+    AllReduceType reduce_type, const PerTypeContext& type_ctx,
+    xla::PrimitiveType type,
+    const std::vector<std::vector<xla::int64>>& groups) {
+  std::vector<std::vector<xla::int64>> replica_groups(groups);
+  if (replica_groups.empty()) {
+    size_t num_replicas =
+        xla::ComputationClient::Get()->GetReplicationDevices().size();
+    replica_groups.emplace_back(num_replicas);
+    std::iota(replica_groups.back().begin(), replica_groups.back().end(), 0);
+  }
+  std::vector<xla::int64> element_counts;
+  for (auto& shape : type_ctx.operand_shapes) {
+    element_counts.push_back(xla::ShapeUtil::ElementsIn(shape));
+  }
+  std::vector<xla::int64> descriptor = xla::cpu_all_reduce::EncodeDescriptor(
+      GetCpuReduceKind(reduce_type), type, element_counts, replica_groups);
+
+  xla::XlaBuilder* builder = type_ctx.ops.front().builder();
+  std::vector<xla::XlaOp> operands = {
+      xla::ConstantR1<xla::int64>(builder, descriptor),
+      xla::ReplicaId(builder)};
+  std::vector<xla::Shape> operand_shapes = {
+      xla::ShapeUtil::MakeShapeWithDescendingLayout(
+          xla::S64, {static_cast<xla::int64>(descriptor.size())}),
+      xla::ShapeUtil::MakeShapeWithDescendingLayout(xla::U32, {})};
+  operands.insert(operands.end(), type_ctx.ops.begin(), type_ctx.ops.end());
+  // The runtime works on flat arrays, so all the operands and results must
+  // share the same (descending) layout.
+  for (auto& shape : type_ctx.operand_shapes) {
+    operand_shapes.push_back(xla::ShapeUtil::MakeShapeWithDescendingLayout(
+        shape.element_type(), shape.dimensions()));
+  }
+  std::vector<xla::Shape> result_shapes(operand_shapes.begin() + 2,
+                                        operand_shapes.end());
+  return xla::CustomCallWithLayout(
+      builder, xla::cpu_all_reduce::kTarget, operands,
+      xla::ShapeUtil::MakeTupleShape(result_shapes), operand_shapes);
+}
+
 }  // namespace
 
 std::vector<xla::XlaOp> BuildAllReduce(
@@ -107,11 +182,16 @@ std::vector<xla::XlaOp> BuildAllReduce(
     type_ctx.second.operand_shapes.push_back(
         XlaHelpers::ShapeOfXlaOp(token_op));
 
-    xla::XlaOp reduce = xla::AllReduce(
-        xla::Tuple(operands[0].builder(), type_ctx.second.ops),
-        GetReduceComutation(reduce_type, type_ctx.first), reduce_groups,
-        /*channel_id=*/absl::nullopt,
-        MakeReduceShape(type_ctx.second.operand_shapes));
+    xla::XlaOp reduce =
+        UseCpuAllReduce()
+            ? BuildCpuAllReduce(reduce_type, type_ctx.second, type_ctx.first,
+                                groups)
+            : xla::AllReduce(
+                  xla::Tuple(operands[0].builder(), type_ctx.second.ops),
+                  GetReduceComutation(reduce_type, type_ctx.first),
+                  reduce_groups,
+                  /*channel_id=*/absl::nullopt,
+                  MakeReduceShape(type_ctx.second.operand_shapes));
     for (size_t i = 0; i < type_ctx.second.indices.size(); ++i) {
       size_t op_idx = type_ctx.second.indices[i];
       xla::XlaOp gte = xla::GetTupleElement(reduce, i);
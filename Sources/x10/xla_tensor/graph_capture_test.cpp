@@ -0,0 +1,164 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/tensor.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+XLATensor MakeTensor(std::vector<float> values) {
+  int64_t size = values.size();
+  return XLATensor::Create(at::Tensor(std::move(values), {size}),
+                           *GetDefaultDevice());
+}
+
+std::vector<float> TensorValues(XLATensor tensor) {
+  at::Tensor cpu_tensor = tensor.ToTensor();
+  absl::Span<const float> data = cpu_tensor.data<float>();
+  return std::vector<float>(data.begin(), data.end());
+}
+
+xla::int64 CounterValue(const std::string& name) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+// The step of the tests, computing x * w + w.
+std::vector<XLATensor> TraceStep(const XLATensor& x, const XLATensor& w) {
+  return {XLATensor::add(XLATensor::mul(x, w), w)};
+}
+
+TEST(GraphCaptureTest, CaptureAndReplay) {
+  XLATensor x = MakeTensor({1, 2});
+  XLATensor w = MakeTensor({10, 20});
+  std::vector<XLATensor> outputs = TraceStep(x, w);
+  auto graph = XLATensor::CaptureTensorsGraph(&outputs, {x, w}, nullptr);
+  ASSERT_NE(graph, nullptr);
+  ASSERT_EQ(outputs.size(), 1);
+  EXPECT_EQ(TensorValues(outputs[0]), std::vector<float>({20, 60}));
+
+  // The replays compute the step over the new inputs, without tracing it.
+  xla::int64 replays = CounterValue("GraphReplays");
+  std::vector<XLATensor> replayed;
+  ASSERT_TRUE(XLATensor::ReplayTensorsGraph(
+      graph.get(), {MakeTensor({3, 4}), MakeTensor({5, 6})}, &replayed));
+  ASSERT_EQ(replayed.size(), 1);
+  EXPECT_EQ(TensorValues(replayed[0]), std::vector<float>({20, 30}));
+  // The outputs of a replay can feed the next one.
+  XLATensor w2 = replayed[0];
+  ASSERT_TRUE(XLATensor::ReplayTensorsGraph(
+      graph.get(), {MakeTensor({1, 1}), w2}, &replayed));
+  EXPECT_EQ(TensorValues(replayed[0]), std::vector<float>({40, 60}));
+  EXPECT_EQ(CounterValue("GraphReplays"), replays + 2);
+
+  // Inputs which do not match the captured ones are refused.
+  std::vector<XLATensor> unchanged = replayed;
+  EXPECT_FALSE(XLATensor::ReplayTensorsGraph(
+      graph.get(), {MakeTensor({1, 2, 3}), MakeTensor({1, 2, 3})}, &replayed));
+  EXPECT_FALSE(
+      XLATensor::ReplayTensorsGraph(graph.get(), {MakeTensor({1, 2})},
+                                    &replayed));
+  EXPECT_EQ(replayed[0].GetUniqueId(), unchanged[0].GetUniqueId());
+}
+
+TEST(GraphCaptureTest, StaleTensorParameter) {
+  // The w tensor is read by the step, but not passed as input, so replays
+  // would keep using its captured value after it gets updated.
+  XLATensor x = MakeTensor({1, 2});
+  XLATensor w = MakeTensor({10, 20});
+  std::vector<XLATensor> outputs = TraceStep(x, w);
+  xla::int64 failures = CounterValue("GraphCaptureMutableParameter");
+  EXPECT_EQ(XLATensor::CaptureTensorsGraph(&outputs, {x}, nullptr), nullptr);
+  EXPECT_EQ(CounterValue("GraphCaptureMutableParameter"), failures + 1);
+  // The outputs are synced anyway.
+  EXPECT_EQ(TensorValues(outputs[0]), std::vector<float>({20, 60}));
+}
+
+TEST(GraphCaptureTest, StaleScalarParameter) {
+  // Non special scalars are uploaded through the device data cache, and a
+  // replay would keep using the captured value (like a learning rate which
+  // changes among steps).
+  XLATensor x = MakeTensor({1, 2});
+  std::vector<XLATensor> outputs = {XLATensor::mul(x, at::Scalar(2.5))};
+  xla::int64 failures = CounterValue("GraphCaptureMutableParameter");
+  EXPECT_EQ(XLATensor::CaptureTensorsGraph(&outputs, {x}, nullptr), nullptr);
+  EXPECT_EQ(CounterValue("GraphCaptureMutableParameter"), failures + 1);
+  EXPECT_EQ(TensorValues(outputs[0]), std::vector<float>({2.5, 5}));
+}
+
+TEST(GraphCaptureTest, StaleTensorOutput) {
+  // The w tensor is returned unchanged by the step, but not passed as input,
+  // so replays would keep returning its captured value after it gets updated.
+  XLATensor x = MakeTensor({1, 2});
+  XLATensor w = MakeTensor({10, 20});
+  std::vector<XLATensor> outputs = {XLATensor::mul(x, x), w};
+  xla::int64 failures = CounterValue("GraphCaptureMutableParameter");
+  EXPECT_EQ(XLATensor::CaptureTensorsGraph(&outputs, {x}, nullptr), nullptr);
+  EXPECT_EQ(CounterValue("GraphCaptureMutableParameter"), failures + 1);
+  EXPECT_EQ(TensorValues(outputs[0]), std::vector<float>({1, 4}));
+
+  // Passed as input, the output is bound to it.
+  outputs = {XLATensor::mul(x, x), w};
+  auto graph = XLATensor::CaptureTensorsGraph(&outputs, {x, w}, nullptr);
+  ASSERT_NE(graph, nullptr);
+  std::vector<XLATensor> replayed;
+  ASSERT_TRUE(XLATensor::ReplayTensorsGraph(
+      graph.get(), {MakeTensor({3, 4}), MakeTensor({5, 6})}, &replayed));
+  ASSERT_EQ(replayed.size(), 2);
+  EXPECT_EQ(TensorValues(replayed[0]), std::vector<float>({9, 16}));
+  EXPECT_EQ(TensorValues(replayed[1]), std::vector<float>({5, 6}));
+
+  // A validation trace returning another input has the same computation, but
+  // diverges in its outputs bindings.
+  xla::int64 diverged = CounterValue("GraphReplayDiverged");
+  outputs = {XLATensor::mul(x, x), x};
+  auto other = XLATensor::CaptureTensorsGraph(&outputs, {x, w}, graph.get());
+  ASSERT_NE(other, nullptr);
+  EXPECT_EQ(CounterValue("GraphReplayDiverged"), diverged + 1);
+  EXPECT_FALSE(XLATensor::ReplayTensorsGraph(graph.get(), {x, w}, &replayed));
+}
+
+TEST(GraphCaptureTest, DivergedGraphIsNotReplayed) {
+  XLATensor x = MakeTensor({1, 2});
+  XLATensor w = MakeTensor({10, 20});
+  std::vector<XLATensor> outputs = TraceStep(x, w);
+  auto graph = XLATensor::CaptureTensorsGraph(&outputs, {x, w}, nullptr);
+  ASSERT_NE(graph, nullptr);
+
+  // A validation trace of the same step keeps the graph replayable.
+  outputs = TraceStep(x, w);
+  auto validated =
+      XLATensor::CaptureTensorsGraph(&outputs, {x, w}, graph.get());
+  ASSERT_NE(validated, nullptr);
+  std::vector<XLATensor> replayed;
+  EXPECT_TRUE(XLATensor::ReplayTensorsGraph(graph.get(), {x, w}, &replayed));
+
+  // A validation trace of a different step makes it unusable.
+  xla::int64 diverged = CounterValue("GraphReplayDiverged");
+  outputs = {XLATensor::sub(XLATensor::mul(x, w), w, at::Scalar(1))};
+  auto other = XLATensor::CaptureTensorsGraph(&outputs, {x, w}, graph.get());
+  ASSERT_NE(other, nullptr);
+  EXPECT_EQ(CounterValue("GraphReplayDiverged"), diverged + 1);
+  EXPECT_FALSE(XLATensor::ReplayTensorsGraph(graph.get(), {x, w}, &replayed));
+  EXPECT_TRUE(XLATensor::ReplayTensorsGraph(other.get(), {x, w}, &replayed));
+  EXPECT_EQ(TensorValues(replayed[0]), std::vector<float>({0, 20}));
+}
+
+}  // namespace
+}  // namespace swift_xla
@@ -253,6 +253,11 @@ class XlaHelpers {
                                                           xla::int64 dim1,
                                                           xla::int64 rank);
 
+  // Returns the type both operands of an elementwise operation get promoted
+  // to, by PromoteValues().
+  static xla::PrimitiveType PromoteType(xla::PrimitiveType type1,
+                                        xla::PrimitiveType type2);
+
   // Performs type promotion to make sure both operations return the same type.
   static std::pair<xla::XlaOp, xla::XlaOp> PromoteValues(xla::XlaOp op1,
                                                          xla::XlaOp op2);
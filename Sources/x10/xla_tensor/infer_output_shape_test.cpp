@@ -0,0 +1,186 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/ops/infer_output_shape.h"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/elementwise.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/helpers.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace ir {
+namespace ops {
+namespace {
+
+using BinaryFn = std::function<xla::XlaOp(xla::XlaOp, xla::XlaOp)>;
+
+xla::int64 CounterValue(const std::string& name) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+// Checks that the registered shape function of op computes the same shape as
+// the XLA builder does for the lowering.
+void ExpectBuilderShape(OpKind op, std::vector<xla::Shape> input_shapes,
+                        const LowerForShapeFn& lowering_fn) {
+  const NativeShapeFn* native_shape_fn = GetNativeShapeFn(op);
+  ASSERT_NE(native_shape_fn, nullptr) << op;
+  xla::Shape native_shape = (*native_shape_fn)(input_shapes);
+  xla::Shape builder_shape = InferOutputShape(input_shapes, lowering_fn);
+  EXPECT_TRUE(xla::ShapeUtil::Compatible(native_shape, builder_shape))
+      << op << ": " << native_shape << " vs. " << builder_shape;
+}
+
+// The lowering of the ops built by the PTXLA_BINARY_OP() macro.
+LowerForShapeFn PromotedBinaryLowering(BinaryFn xla_fn) {
+  return [xla_fn](absl::Span<const xla::XlaOp> operands) {
+    auto promoted = XlaHelpers::Promote(operands[0], operands[1]);
+    return xla_fn(promoted.first, promoted.second);
+  };
+}
+
+xla::Shape F32Shape(absl::Span<const xla::int64> dimensions) {
+  return xla::ShapeUtil::MakeShape(xla::F32, dimensions);
+}
+
+TEST(InferOutputShapeTest, PromotedBinaryOps) {
+  std::vector<std::pair<c10::Symbol, BinaryFn>> ops = {
+      {at::aten::min,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Min(lhs, rhs); }},
+      {at::aten::max,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Max(lhs, rhs); }},
+      {at::aten::pow,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Pow(lhs, rhs); }},
+      {at::aten::fmod,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Rem(lhs, rhs); }},
+      {at::aten::atan2,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Atan2(lhs, rhs); }},
+      {at::aten::xla_rem,
+       [](xla::XlaOp lhs, xla::XlaOp rhs) { return xla::Rem(lhs, rhs); }},
+  };
+  std::vector<std::vector<xla::Shape>> input_shapes = {
+      {F32Shape({2, 3}), F32Shape({2, 3})},
+      // Broadcasts among ranks, and of the size one dimensions.
+      {F32Shape({4, 1, 3}), F32Shape({5, 1})},
+      {F32Shape({}), F32Shape({2, 3})},
+      // Element type promotion.
+      {xla::ShapeUtil::MakeShape(xla::S32, {3}), F32Shape({2, 3})},
+      {xla::ShapeUtil::MakeShape(xla::BF16, {3}), F32Shape({3})},
+  };
+  for (auto& op : ops) {
+    for (auto& shapes : input_shapes) {
+      ExpectBuilderShape(OpKind(op.first), shapes,
+                         PromotedBinaryLowering(op.second));
+    }
+  }
+  for (c10::Symbol kind : {at::aten::logical_and, at::aten::logical_or}) {
+    BinaryFn xla_fn = kind == at::aten::logical_and
+                          ? BinaryFn([](xla::XlaOp lhs, xla::XlaOp rhs) {
+                              return xla::And(lhs, rhs);
+                            })
+                          : BinaryFn([](xla::XlaOp lhs, xla::XlaOp rhs) {
+                              return xla::Or(lhs, rhs);
+                            });
+    ExpectBuilderShape(OpKind(kind),
+                       {xla::ShapeUtil::MakeShape(xla::PRED, {4, 1}),
+                        xla::ShapeUtil::MakeShape(xla::PRED, {3})},
+                       PromotedBinaryLowering(xla_fn));
+  }
+}
+
+TEST(InferOutputShapeTest, ComparisonOps) {
+  for (c10::Symbol kind : {at::aten::eq, at::aten::ne, at::aten::ge,
+                           at::aten::gt, at::aten::le, at::aten::lt}) {
+    LowerForShapeFn lowering_fn =
+        [kind](absl::Span<const xla::XlaOp> operands) {
+          return BuildComparisonOp(kind, operands[0], operands[1]);
+        };
+    ExpectBuilderShape(OpKind(kind), {F32Shape({2, 3}), F32Shape({2, 3})},
+                       lowering_fn);
+    ExpectBuilderShape(OpKind(kind), {F32Shape({4, 1}), F32Shape({3})},
+                       lowering_fn);
+    ExpectBuilderShape(OpKind(kind),
+                       {xla::ShapeUtil::MakeShape(xla::S32, {3}), F32Shape({})},
+                       lowering_fn);
+  }
+}
+
+TEST(InferOutputShapeTest, Relu) {
+  LowerForShapeFn lowering_fn = [](absl::Span<const xla::XlaOp> operands) {
+    return BuildRelu(operands[0]);
+  };
+  ExpectBuilderShape(OpKind(at::aten::relu), {F32Shape({2, 3})}, lowering_fn);
+  ExpectBuilderShape(OpKind(at::aten::relu),
+                     {xla::ShapeUtil::MakeShape(xla::S32, {})}, lowering_fn);
+}
+
+TEST(InferOutputShapeTest, Dot) {
+  LowerForShapeFn lowering_fn = [](absl::Span<const xla::XlaOp> operands) {
+    return xla::Dot(operands[0], operands[1]);
+  };
+  for (c10::Symbol kind : {at::aten::mm, at::aten::addmm}) {
+    ExpectBuilderShape(OpKind(kind), {F32Shape({2, 3}), F32Shape({3, 4})},
+                       lowering_fn);
+    ExpectBuilderShape(OpKind(kind), {F32Shape({3}), F32Shape({3, 4})},
+                       lowering_fn);
+    ExpectBuilderShape(OpKind(kind), {F32Shape({2, 3}), F32Shape({3})},
+                       lowering_fn);
+    ExpectBuilderShape(OpKind(kind), {F32Shape({3}), F32Shape({3})},
+                       lowering_fn);
+  }
+}
+
+TEST(InferOutputShapeTest, FallsBackToBuilder) {
+  LowerForShapeFn lowering_fn = [](absl::Span<const xla::XlaOp> operands) {
+    return xla::Max(operands[0], operands[1]);
+  };
+  // Ops without a native shape function.
+  EXPECT_EQ(GetNativeShapeFn(OpKind(at::aten::matmul)), nullptr);
+  xla::int64 native = CounterValue("NativeShapeInference");
+  xla::int64 builder = CounterValue("BuilderShapeInference");
+  xla::Shape shape =
+      InferOutputShape(OpKind(at::aten::matmul),
+                       {F32Shape({2}), F32Shape({2})}, lowering_fn);
+  EXPECT_TRUE(xla::ShapeUtil::Equal(shape, F32Shape({2})));
+  EXPECT_EQ(CounterValue("NativeShapeInference"), native);
+  EXPECT_EQ(CounterValue("BuilderShapeInference"), builder + 1);
+
+  // Dynamic input shapes, whose dynamic dimensions the native shape functions
+  // do not propagate.
+  xla::Shape dynamic_shape =
+      xla::ShapeUtil::MakeShape(xla::F32, {4, 3}, {true, false});
+  shape = InferOutputShape(OpKind(at::aten::max),
+                           {dynamic_shape, dynamic_shape}, lowering_fn);
+  EXPECT_TRUE(shape.is_dynamic_dimension(0));
+  EXPECT_EQ(CounterValue("NativeShapeInference"), native);
+  EXPECT_EQ(CounterValue("BuilderShapeInference"), builder + 2);
+
+  // Static input shapes take the native path.
+  shape = InferOutputShape(OpKind(at::aten::max),
+                           {F32Shape({4, 3}), F32Shape({4, 3})}, lowering_fn);
+  EXPECT_TRUE(xla::ShapeUtil::Equal(shape, F32Shape({4, 3})));
+  EXPECT_EQ(CounterValue("NativeShapeInference"), native + 1);
+}
+
+}  // namespace
+}  // namespace ops
+}  // namespace ir
+}  // namespace swift_xla
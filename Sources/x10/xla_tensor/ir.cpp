@@ -14,25 +14,70 @@
 
 #include "tensorflow/compiler/tf2xla/xla_tensor/ir.h"
 
+#include <deque>
 #include <functional>
+#include <limits>
+#include <mutex>
 #include <sstream>
 
 #include "absl/strings/str_cat.h"
 #include "tensorflow/compiler/xla/xla_client/cache.h"
 #include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
 #include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
+#include "tensorflow/compiler/xla/xla_client/xla_util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/lowering_context.h"
+#include "tensorflow/compiler/xla/shape_util.h"
 
 namespace swift_xla {
 namespace ir {
 namespace {
 
-using ShapeCache = xla::util::Cache<size_t, xla::Shape>;
+using ShapeCache = xla::util::ShardedCache<size_t, xla::Shape>;
+
+// Global interning table for the full scope names. Scope entry names are
+// numbered from one again at every step, so the number of distinct scope names
+// stays bounded by the ones appearing within a single step.
+class ScopeTable {
+ public:
+  static ScopeTable* Get() {
+    static ScopeTable* table = new ScopeTable();
+    return table;
+  }
+
+  uint32_t Intern(const std::string& scope) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = ids_.find(scope);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.push_back(scope);
+    ids_.emplace(scope, id);
+    XLA_COUNTER("IrScopeNames", 1);
+    return id;
+  }
+
+  const std::string& GetName(uint32_t id) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return names_.at(id);
+  }
+
+ private:
+  ScopeTable() : names_(1) {}
+
+  std::mutex lock_;
+  // The std::deque does not move its elements when growing, so the references
+  // returned by GetName() stay valid. The first entry is the empty scope.
+  std::deque<std::string> names_;
+  std::unordered_map<std::string, uint32_t> ids_;
+};
 
 struct ScapeEntry {
-  std::string name;
   size_t saved_next_id = 1;
+  // The interned ID of the full scope name, up to this entry.
+  uint32_t scope_id = 0;
 };
 
 struct ScopeContext {
@@ -43,9 +88,14 @@ struct ScopeContext {
 thread_local ScopeContext g_scope_context;
 
 void PushScope(const std::string& name) {
-  size_t id = g_scope_context.next_id;
+  ScopeTable* table = ScopeTable::Get();
+  std::string scope = absl::StrCat(name, ".", g_scope_context.next_id);
+  if (!g_scope_context.scopes.empty()) {
+    scope = absl::StrCat(
+        table->GetName(g_scope_context.scopes.back().scope_id), "/", scope);
+  }
   g_scope_context.scopes.push_back(
-      {absl::StrCat(name, ".", id), g_scope_context.next_id + 1});
+      {g_scope_context.next_id + 1, table->Intern(scope)});
   g_scope_context.next_id = 1;
 }
 
@@ -60,27 +110,59 @@ void ResetScopeContext() {
   g_scope_context.next_id = 1;
 }
 
-std::string GetCurrentScope() {
-  std::string scope;
-  for (auto& scope_entry : g_scope_context.scopes) {
-    if (scope.empty()) {
-      absl::StrAppend(&scope, scope_entry.name);
-    } else {
-      absl::StrAppend(&scope, "/", scope_entry.name);
-    }
-  }
-  return scope;
+uint32_t GetCurrentScopeId() {
+  return g_scope_context.scopes.empty()
+             ? 0
+             : g_scope_context.scopes.back().scope_id;
 }
 
 ShapeCache* GetShapeCache() {
   static xla::int64 shape_cache_size =
       xla::sys_util::GetEnvInt("XLA_IR_SHAPE_CACHE_SIZE", 131072);
-  thread_local ShapeCache* cache = new ShapeCache(shape_cache_size);
+  static ShapeCache* cache = new ShapeCache("IrShapeCache", shape_cache_size);
   return cache;
 }
 
+// Hashes an operand shape for the shape cache key. On top of what
+// xla::util::ShapeHash() covers, the dynamic dimension bits need to be part of
+// the key, as they propagate to the inferred shapes (operands coming from
+// masked_select or nonzero have the same static dimensions either way).
+size_t OperandShapeHash(const xla::Shape& shape) {
+  size_t hash = xla::util::ShapeHash(shape);
+  xla::ShapeUtil::ForEachSubshape(
+      shape, [&](const xla::Shape& subshape, const xla::ShapeIndex&) {
+        if (subshape.IsArray()) {
+          for (bool dynamic : subshape.dynamic_dimensions()) {
+            hash = xla::util::HashCombine(hash, dynamic);
+          }
+        }
+      });
+  return hash;
+}
+
+// Returns whether the node of the i-th operand is also the node of a previous
+// operand. Nodes have few operands, so a linear scan is cheaper than a set.
+bool IsDuplicateOperand(OpList operands, size_t i) {
+  for (size_t j = 0; j < i; ++j) {
+    if (operands[j].node == operands[i].node) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t SaturatingAdd(size_t a, size_t b) {
+  return a > std::numeric_limits<size_t>::max() - b
+             ? std::numeric_limits<size_t>::max()
+             : a + b;
+}
+
 }  // namespace
 
+const std::string& MetaData::scope() const {
+  return ScopeTable::Get()->GetName(scope_id);
+}
+
 size_t Output::Hasher::operator()(const Output& output) const {
   return xla::util::HashCombine(reinterpret_cast<std::ptrdiff_t>(output.node),
                                 output.index);
@@ -121,10 +203,14 @@ Node::Node(OpKind op, OpList operands, xla::Shape shape, size_t num_outputs,
       shape_(std::move(shape)),
       node_hash_(xla::util::HashCombine(op_.hash(), hash_seed)),
       hash_(node_hash_) {
-  metadata_.scope = GetCurrentScope();
-  for (auto& operand : operands) {
+  metadata_.scope_id = GetCurrentScopeId();
+  for (size_t i = 0; i < operands.size(); ++i) {
+    const Value& operand = operands[i];
     AddOperand(operand.node, operand.index);
     hash_ = xla::util::HashCombine(hash_, operand.hash());
+    if (!IsDuplicateOperand(operands, i)) {
+      graph_size_ = SaturatingAdd(graph_size_, operand->graph_size());
+    }
   }
 }
 
@@ -143,7 +229,7 @@ Node::Node(OpKind op, xla::Shape shape, size_t num_outputs, size_t hash_seed)
       shape_(std::move(shape)),
       node_hash_(GetOpHash(op_, shape_, hash_seed)),
       hash_(node_hash_) {
-  metadata_.scope = GetCurrentScope();
+  metadata_.scope_id = GetCurrentScopeId();
 }
 
 const xla::Shape& Node::shape(size_t output_index) const {
@@ -183,8 +269,8 @@ std::string Node::ToString() const {
   if (num_outputs() > 1) {
     ss << ", num_outputs=" << num_outputs();
   }
-  if (!metadata_.scope.empty()) {
-    ss << ", scope=" << metadata_.scope;
+  if (metadata_.scope_id != 0) {
+    ss << ", scope=" << metadata_.scope();
   }
   return ss.str();
 }
@@ -204,10 +290,20 @@ size_t Node::GetOpHash(OpKind op, const xla::Shape& shape, size_t hash_seed) {
 }
 
 xla::Shape Node::GetOpShape(const std::function<xla::Shape()>& shape_fn) const {
+  // The output shape only depends on the operation (whose parameters are
+  // captured by the node hash) and on the shapes of its operands, so the cache
+  // key does not need to include anything upstream of the operands.
+  size_t shape_key = node_hash();
+  for (auto& operand : operands()) {
+    shape_key =
+        xla::util::HashCombine(shape_key, OperandShapeHash(operand.shape()));
+  }
   ShapeCache* shape_cache = GetShapeCache();
-  auto shape = shape_cache->Get(hash());
+  auto shape = shape_cache->Get(shape_key);
   if (shape == nullptr) {
-    shape = shape_cache->Add(hash(), std::make_shared<xla::Shape>(shape_fn()));
+    XLA_TIMED("IrShapeInference");
+    shape =
+        shape_cache->Add(shape_key, std::make_shared<xla::Shape>(shape_fn()));
   }
   return *shape;
 }
@@ -28,6 +28,7 @@
 
 #include "absl/types/span.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/aten_compat.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir_arena.h"
 #include "tensorflow/compiler/xla/client/xla_builder.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 
@@ -48,7 +49,12 @@ struct UserMetaData {
 };
 
 struct MetaData {
-  std::string scope;
+  // Returns the name of the IR scope the node was created within, or an empty
+  // string if the node was created outside of any scope.
+  const std::string& scope() const;
+
+  // The interned ID of the scope name. Zero means no scope.
+  uint32_t scope_id = 0;
 };
 
 // Represents a specific output produced by a node. Since the output of a node
@@ -195,6 +201,12 @@ class Node {
 
   size_t hash() const { return hash_; }
 
+  // Returns the number of nodes of the graph rooted at this node, computed at
+  // construction time by summing the sizes of the (distinct) operands. Nodes
+  // reachable through more than one operand are counted multiple times, so the
+  // value is exact for trees, and an upper bound otherwise.
+  size_t graph_size() const { return graph_size_; }
+
   const MetaData& metadata() const { return metadata_; }
 
   virtual std::string ToString() const;
@@ -229,6 +241,8 @@ class Node {
   size_t node_hash_ = 0;
   // The hash value of the graph rooted at this node.
   size_t hash_ = 0;
+  // The (upper bound of the) size of the graph rooted at this node.
+  size_t graph_size_ = 1;
   // The IR specific metadata attached to the IR node.
   MetaData metadata_;
 };
@@ -250,6 +264,11 @@ inline std::ostream& operator<<(std::ostream& stream, const Node& node) {
 
 template <typename T, typename... Args>
 NodePtr MakeNode(Args&&... args) {
+  RecordNodeAllocation(sizeof(T));
+  if (NodeArena::Enabled()) {
+    return std::allocate_shared<T>(NodeAllocator<T>(),
+                                   std::forward<Args>(args)...);
+  }
   return std::make_shared<T>(std::forward<Args>(args)...);
 }
 
@@ -0,0 +1,165 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir_arena.h"
+
+#include <cstdint>
+#include <new>
+
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/mem.h"
+
+namespace swift_xla {
+namespace ir {
+namespace {
+
+constexpr size_t kSlabSize = 64 * 1024;
+constexpr size_t kSlabHeaderSize = 64;
+constexpr size_t kClassGranularity = 16;
+constexpr size_t kMaxClassSize = 1024;
+constexpr size_t kNumClasses = kMaxClassSize / kClassGranularity;
+
+size_t GetClassIndex(size_t size) {
+  return (size + kClassGranularity - 1) / kClassGranularity - 1;
+}
+
+size_t GetClassSize(size_t class_index) {
+  return (class_index + 1) * kClassGranularity;
+}
+
+struct StepStats {
+  size_t nodes = 0;
+  size_t bytes = 0;
+};
+
+thread_local StepStats g_step_stats;
+
+xla::metrics::Gauge* ArenaSlabBytesGauge() {
+  static xla::metrics::Gauge* gauge =
+      new xla::metrics::Gauge("IrNodeArenaSlabBytes");
+  return gauge;
+}
+
+}  // namespace
+
+struct NodeArena::Slab {
+  size_t class_index = 0;
+  size_t live_blocks = 0;
+};
+
+NodeArena::NodeArena() : classes_(kNumClasses) {}
+
+NodeArena* NodeArena::Get() {
+  static NodeArena* arena = new NodeArena();
+  return arena;
+}
+
+NodeArena::Slab* NodeArena::GetSlab(void* ptr) {
+  return reinterpret_cast<Slab*>(reinterpret_cast<std::uintptr_t>(ptr) &
+                                 ~static_cast<std::uintptr_t>(kSlabSize - 1));
+}
+
+void* NodeArena::Allocate(size_t size) {
+  if (size > kMaxClassSize) {
+    return ::operator new(size);
+  }
+  size_t class_index = GetClassIndex(size);
+  SizeClass& size_class = classes_[class_index];
+  std::lock_guard<std::mutex> lock(size_class.lock);
+  if (size_class.free_list == nullptr) {
+    AddSlab(class_index);
+  }
+  Block* block = size_class.free_list;
+  size_class.free_list = block->next;
+  GetSlab(block)->live_blocks += 1;
+  return block;
+}
+
+void NodeArena::Deallocate(void* ptr, size_t size) {
+  if (size > kMaxClassSize) {
+    ::operator delete(ptr);
+    return;
+  }
+  SizeClass& size_class = classes_[GetClassIndex(size)];
+  std::lock_guard<std::mutex> lock(size_class.lock);
+  Block* block = static_cast<Block*>(ptr);
+  block->next = size_class.free_list;
+  size_class.free_list = block;
+  GetSlab(block)->live_blocks -= 1;
+}
+
+void NodeArena::AddSlab(size_t class_index) {
+  void* memory = tensorflow::port::AlignedMalloc(kSlabSize, kSlabSize);
+  XLA_CHECK(memory != nullptr) << "Unable to allocate IR node arena slab";
+  Slab* slab = new (memory) Slab();
+  slab->class_index = class_index;
+
+  SizeClass& size_class = classes_[class_index];
+  size_t block_size = GetClassSize(class_index);
+  char* base = static_cast<char*>(memory);
+  for (size_t offset = kSlabHeaderSize; offset + block_size <= kSlabSize;
+       offset += block_size) {
+    Block* block = reinterpret_cast<Block*>(base + offset);
+    block->next = size_class.free_list;
+    size_class.free_list = block;
+  }
+  size_class.slabs.push_back(slab);
+  ArenaSlabBytesGauge()->AddValue(kSlabSize);
+}
+
+void NodeArena::ReleaseFreeSlabs() {
+  for (auto& size_class : classes_) {
+    std::lock_guard<std::mutex> lock(size_class.lock);
+    // Unlink all the blocks belonging to free slabs, then release the slabs.
+    Block** link = &size_class.free_list;
+    while (*link != nullptr) {
+      if (GetSlab(*link)->live_blocks == 0) {
+        *link = (*link)->next;
+      } else {
+        link = &(*link)->next;
+      }
+    }
+    size_t live_slabs = 0;
+    for (auto slab : size_class.slabs) {
+      if (slab->live_blocks == 0) {
+        slab->~Slab();
+        tensorflow::port::AlignedFree(slab);
+        ArenaSlabBytesGauge()->AddValue(-static_cast<xla::int64>(kSlabSize));
+      } else {
+        size_class.slabs[live_slabs++] = slab;
+      }
+    }
+    size_class.slabs.resize(live_slabs);
+  }
+}
+
+void RecordNodeAllocation(size_t size) {
+  g_step_stats.nodes += 1;
+  g_step_stats.bytes += size;
+}
+
+void MarkNodeAllocationStep() {
+  XLA_COUNTER("IrNodeAllocs", g_step_stats.nodes);
+  XLA_COUNTER("IrNodeAllocBytes", g_step_stats.bytes);
+  XLA_VALUE_METRIC("IrNodeAllocsPerStep", g_step_stats.nodes);
+  XLA_VALUE_METRIC("IrNodeAllocBytesPerStep", g_step_stats.bytes);
+  g_step_stats = StepStats();
+  if (NodeArena::Enabled()) {
+    NodeArena::Get()->ReleaseFreeSlabs();
+  }
+}
+
+}  // namespace ir
+}  // namespace swift_xla
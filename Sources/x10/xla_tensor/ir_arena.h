@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+
+namespace swift_xla {
+namespace ir {
+
+// Slab allocator for IR nodes. Allocations are rounded up to size classes,
+// each one served by a free list of blocks carved out of fixed size slabs, so
+// that tracing large graphs does not hit the system allocator for every node.
+// Nodes can outlive the step which created them (for example when held by
+// tensors which have not been synced), so blocks are returned individually,
+// and at step boundaries the slabs with no live blocks are released in bulk.
+class NodeArena {
+ public:
+  static NodeArena* Get();
+
+  // Whether IR nodes should be allocated from the arena, which is controlled
+  // by the XLA_IR_NODE_ARENA environment variable.
+  static bool Enabled() {
+    static const bool enabled =
+        xla::sys_util::GetEnvBool("XLA_IR_NODE_ARENA", false);
+    return enabled;
+  }
+
+  void* Allocate(size_t size);
+
+  void Deallocate(void* ptr, size_t size);
+
+  // Releases the slabs which have no live blocks.
+  void ReleaseFreeSlabs();
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  struct Slab;
+
+  struct SizeClass {
+    std::mutex lock;
+    Block* free_list = nullptr;
+    std::vector<Slab*> slabs;
+  };
+
+  NodeArena();
+
+  static Slab* GetSlab(void* ptr);
+
+  void AddSlab(size_t class_index);
+
+  std::vector<SizeClass> classes_;
+};
+
+// STL allocator adapter for the NodeArena, to be used with
+// std::allocate_shared() so that the node and its shared pointer control block
+// share the same arena block.
+template <typename T>
+struct NodeAllocator {
+  using value_type = T;
+
+  NodeAllocator() = default;
+  template <typename U>
+  NodeAllocator(const NodeAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(NodeArena::Get()->Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    NodeArena::Get()->Deallocate(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const NodeAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const NodeAllocator<U>&) const {
+    return false;
+  }
+};
+
+// Records the allocation of an IR node of the given size, within the per
+// thread step statistics.
+void RecordNodeAllocation(size_t size);
+
+// Publishes the IR node allocation statistics of the calling thread for the
+// step which just ended, and releases the unused arena memory.
+void MarkNodeAllocationStep();
+
+}  // namespace ir
+}  // namespace swift_xla
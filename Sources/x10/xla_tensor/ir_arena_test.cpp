@@ -0,0 +1,185 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir_arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace ir {
+namespace {
+
+xla::int64 SlabBytes() {
+  xla::metrics::CounterData* data =
+      xla::metrics::GetGauge("IrNodeArenaSlabBytes");
+  return data != nullptr ? data->Value() : 0;
+}
+
+// Releases the slabs left by the previous tests, so that the slab bytes of a
+// test start from a known state.
+xla::int64 ResetSlabBytes() {
+  NodeArena::Get()->ReleaseFreeSlabs();
+  return SlabBytes();
+}
+
+TEST(NodeArenaTest, AllocatesDistinctBlocks) {
+  NodeArena* arena = NodeArena::Get();
+  xla::int64 slab_bytes = ResetSlabBytes();
+  std::vector<void*> blocks;
+  std::set<std::uintptr_t> addresses;
+  for (size_t size : {1, 16, 17, 100, 1000, 1024}) {
+    for (int i = 0; i < 100; ++i) {
+      void* block = arena->Allocate(size);
+      ASSERT_NE(block, nullptr);
+      EXPECT_EQ(reinterpret_cast<std::uintptr_t>(block) % sizeof(void*), 0);
+      EXPECT_TRUE(addresses.insert(reinterpret_cast<std::uintptr_t>(block))
+                      .second);
+      // Blocks must not overlap, which the filled bytes check below catches.
+      std::memset(block, static_cast<int>(size & 0xff), size);
+      blocks.push_back(block);
+    }
+  }
+  EXPECT_GT(SlabBytes(), slab_bytes);
+  size_t index = 0;
+  for (size_t size : {1, 16, 17, 100, 1000, 1024}) {
+    for (int i = 0; i < 100; ++i, ++index) {
+      const unsigned char* data =
+          static_cast<const unsigned char*>(blocks[index]);
+      for (size_t j = 0; j < size; ++j) {
+        ASSERT_EQ(data[j], size & 0xff) << size;
+      }
+      arena->Deallocate(blocks[index], size);
+    }
+  }
+  arena->ReleaseFreeSlabs();
+  EXPECT_EQ(SlabBytes(), slab_bytes);
+}
+
+TEST(NodeArenaTest, ReusesFreedBlocks) {
+  NodeArena* arena = NodeArena::Get();
+  void* block = arena->Allocate(48);
+  arena->Deallocate(block, 48);
+  // Sizes within the same size class share the free list.
+  void* other = arena->Allocate(40);
+  EXPECT_EQ(other, block);
+  arena->Deallocate(other, 40);
+}
+
+TEST(NodeArenaTest, KeepsSlabsWithLiveBlocks) {
+  NodeArena* arena = NodeArena::Get();
+  xla::int64 slab_bytes = ResetSlabBytes();
+  void* live = arena->Allocate(64);
+  void* freed = arena->Allocate(64);
+  EXPECT_GT(SlabBytes(), slab_bytes);
+  std::memset(live, 0x5a, 64);
+  arena->Deallocate(freed, 64);
+  // A node outliving its step keeps its slab alive.
+  arena->ReleaseFreeSlabs();
+  EXPECT_GT(SlabBytes(), slab_bytes);
+  const unsigned char* data = static_cast<const unsigned char*>(live);
+  for (size_t i = 0; i < 64; ++i) {
+    ASSERT_EQ(data[i], 0x5a);
+  }
+  // The free blocks of the kept slab are still handed out.
+  void* reused = arena->Allocate(64);
+  EXPECT_EQ(reused, freed);
+  arena->Deallocate(reused, 64);
+  arena->Deallocate(live, 64);
+  arena->ReleaseFreeSlabs();
+  EXPECT_EQ(SlabBytes(), slab_bytes);
+}
+
+TEST(NodeArenaTest, LargeAllocationsBypassSlabs) {
+  NodeArena* arena = NodeArena::Get();
+  xla::int64 slab_bytes = ResetSlabBytes();
+  void* block = arena->Allocate(4096);
+  ASSERT_NE(block, nullptr);
+  std::memset(block, 0, 4096);
+  EXPECT_EQ(SlabBytes(), slab_bytes);
+  arena->Deallocate(block, 4096);
+}
+
+struct TestNode {
+  explicit TestNode(std::string name) : name(std::move(name)) {}
+
+  std::string name;
+  std::vector<int> operands;
+};
+
+TEST(NodeArenaTest, NodeAllocator) {
+  xla::int64 slab_bytes = ResetSlabBytes();
+  {
+    std::vector<std::shared_ptr<TestNode>> nodes;
+    for (int i = 0; i < 1000; ++i) {
+      nodes.push_back(std::allocate_shared<TestNode>(NodeAllocator<TestNode>(),
+                                                     std::to_string(i)));
+      nodes.back()->operands.assign(i % 8, i);
+    }
+    EXPECT_GT(SlabBytes(), slab_bytes);
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_EQ(nodes[i]->name, std::to_string(i));
+      EXPECT_EQ(nodes[i]->operands.size(), i % 8);
+    }
+  }
+  NodeArena::Get()->ReleaseFreeSlabs();
+  EXPECT_EQ(SlabBytes(), slab_bytes);
+}
+
+TEST(NodeArenaTest, ConcurrentAllocations) {
+  const int kNumThreads = 8;
+  const int kNumBlocks = 2000;
+  xla::int64 slab_bytes = ResetSlabBytes();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([t]() {
+      NodeArena* arena = NodeArena::Get();
+      std::vector<void*> blocks;
+      size_t size = 32 + 16 * (t % 4);
+      for (int i = 0; i < kNumBlocks; ++i) {
+        void* block = arena->Allocate(size);
+        std::memset(block, t, size);
+        blocks.push_back(block);
+        if (i % 3 == 0) {
+          arena->Deallocate(blocks.front(), size);
+          blocks.erase(blocks.begin());
+        }
+      }
+      for (void* block : blocks) {
+        const unsigned char* data = static_cast<const unsigned char*>(block);
+        for (size_t i = 0; i < size; ++i) {
+          ASSERT_EQ(data[i], t);
+        }
+        arena->Deallocate(block, size);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  NodeArena::Get()->ReleaseFreeSlabs();
+  EXPECT_EQ(SlabBytes(), slab_bytes);
+}
+
+}  // namespace
+}  // namespace ir
+}  // namespace swift_xla
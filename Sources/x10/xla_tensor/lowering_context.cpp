@@ -50,8 +50,8 @@ class HloMetadataSetter {
     xla::OpMetadata metadata;
     metadata.set_op_type(node->op().ToString());
     const ir::MetaData& nmeta = node->metadata();
-    if (!nmeta.scope.empty()) {
-      metadata.set_op_name(nmeta.scope);
+    if (nmeta.scope_id != 0) {
+      metadata.set_op_name(nmeta.scope());
     }
     loctx->builder()->SetOpMetadata(std::move(metadata));
   }
@@ -137,8 +137,8 @@ void LoweringContext::ReportBuilderError(const Node* node,
   }
   // TODO(asuhan): return status instead
   const ir::MetaData& nmeta = node->metadata();
-  if (!nmeta.scope.empty()) {
-    ss << "Scope: " << nmeta.scope << "\n";
+  if (nmeta.scope_id != 0) {
+    ss << "Scope: " << nmeta.scope() << "\n";
   }
   XLA_ERROR() << ss.str();
 }
@@ -93,7 +93,7 @@ size_t GetNodesKeySeed(const std::string& device,
 }  // namespace
 
 OpByOpExecutor::OpByOpExecutor(size_t compile_cache_size)
-    : compile_cache_(compile_cache_size) {}
+    : compile_cache_("OpByOpCompileCache", compile_cache_size) {}
 
 std::vector<xla::ComputationClient::ExecuteChainedOp> OpByOpExecutor::BuildOps(
     absl::Span<const ir::Value> roots, const std::string& device,
@@ -53,7 +53,7 @@ class OpByOpExecutor {
 
  private:
   using CompileCache =
-      xla::util::Cache<size_t, xla::ComputationClient::Computation>;
+      xla::util::ShardedCache<size_t, xla::ComputationClient::Computation>;
 
   explicit OpByOpExecutor(size_t compile_cache_size);
 
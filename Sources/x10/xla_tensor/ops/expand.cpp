@@ -15,6 +15,8 @@
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/expand.h"
 
 #include "absl/strings/str_join.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/data_ops.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/lowering_context.h"
@@ -31,7 +33,13 @@ xla::Shape NodeOutputShape(const Value& input,
       [&](absl::Span<const xla::XlaOp> operands) -> xla::XlaOp {
     return BuildExpand(operands[0], size);
   };
-  return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  auto native_shape_fn =
+      [&](absl::Span<const xla::Shape> input_shapes) -> xla::Shape {
+    XLA_CHECK_LE(input_shapes[0].rank(), static_cast<xla::int64>(size.size()));
+    return xla::ShapeUtil::MakeShape(input_shapes[0].element_type(), size);
+  };
+  return InferOutputShape({input.shape()}, native_shape_fn,
+                          lower_for_shape_fn);
 }
 
 }  // namespace
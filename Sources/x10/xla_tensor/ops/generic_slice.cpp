@@ -15,6 +15,8 @@
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/generic_slice.h"
 
 #include "absl/strings/str_join.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/data_ops.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/lowering_context.h"
@@ -33,7 +35,13 @@ xla::Shape NodeOutputShape(const Value& input,
       [&](absl::Span<const xla::XlaOp> operands) -> xla::XlaOp {
     return BuildSlice(operands[0], base_indices, sizes);
   };
-  return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  auto native_shape_fn =
+      [&](absl::Span<const xla::Shape> input_shapes) -> xla::Shape {
+    XLA_CHECK_EQ(input_shapes[0].rank(), static_cast<xla::int64>(sizes.size()));
+    return xla::ShapeUtil::MakeShape(input_shapes[0].element_type(), sizes);
+  };
+  return InferOutputShape({input.shape()}, native_shape_fn,
+                          lower_for_shape_fn);
 }
 
 }  // namespace
@@ -14,14 +14,103 @@
 
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/infer_output_shape.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/helpers.h"
 
 namespace swift_xla {
 namespace ir {
 namespace ops {
+namespace {
+
+struct OpKindHasher {
+  size_t operator()(const OpKind& op) const { return op.hash(); }
+};
+
+using ShapeFnRegistry =
+    absl::flat_hash_map<OpKind, NativeShapeFn, OpKindHasher>;
+
+// Shape of the XlaHelpers::Promote() based elementwise binary operations.
+xla::Shape PromotedBinaryShape(absl::Span<const xla::Shape> input_shapes) {
+  XLA_CHECK_EQ(input_shapes.size(), 2);
+  return xla::ShapeUtil::MakeShape(
+      XlaHelpers::PromoteType(input_shapes[0].element_type(),
+                              input_shapes[1].element_type()),
+      XlaHelpers::GetPromotedShape(input_shapes[0].dimensions(),
+                                   input_shapes[1].dimensions()));
+}
+
+xla::Shape ComparisonShape(absl::Span<const xla::Shape> input_shapes) {
+  XLA_CHECK_EQ(input_shapes.size(), 2);
+  return xla::ShapeUtil::MakeShape(
+      xla::PrimitiveType::PRED,
+      XlaHelpers::GetPromotedShape(input_shapes[0].dimensions(),
+                                   input_shapes[1].dimensions()));
+}
+
+xla::Shape ElementwiseShape(absl::Span<const xla::Shape> input_shapes) {
+  XLA_CHECK_EQ(input_shapes.size(), 1);
+  return input_shapes[0];
+}
+
+// Shape of xla::Dot() on vectors and matrices.
+xla::Shape DotShape(absl::Span<const xla::Shape> input_shapes) {
+  XLA_CHECK_EQ(input_shapes.size(), 2);
+  const xla::Shape& lhs = input_shapes[0];
+  const xla::Shape& rhs = input_shapes[1];
+  XLA_CHECK(lhs.rank() >= 1 && lhs.rank() <= 2 && rhs.rank() >= 1 &&
+            rhs.rank() <= 2)
+      << "Invalid dot operand shapes: " << lhs << " and " << rhs;
+  XLA_CHECK_EQ(lhs.dimensions(lhs.rank() - 1), rhs.dimensions(0))
+      << lhs << " and " << rhs;
+  std::vector<xla::int64> dimensions;
+  if (lhs.rank() == 2) {
+    dimensions.push_back(lhs.dimensions(0));
+  }
+  if (rhs.rank() == 2) {
+    dimensions.push_back(rhs.dimensions(1));
+  }
+  return xla::ShapeUtil::MakeShape(lhs.element_type(), dimensions);
+}
+
+const ShapeFnRegistry* CreateShapeFnRegistry() {
+  ShapeFnRegistry* registry = new ShapeFnRegistry();
+  for (auto kind : {at::aten::min, at::aten::max, at::aten::pow,
+                    at::aten::fmod, at::aten::atan2, at::aten::logical_and,
+                    at::aten::logical_or, at::aten::xla_rem}) {
+    registry->emplace(OpKind(kind), PromotedBinaryShape);
+  }
+  for (auto kind : {at::aten::eq, at::aten::ne, at::aten::ge, at::aten::gt,
+                    at::aten::le, at::aten::lt}) {
+    registry->emplace(OpKind(kind), ComparisonShape);
+  }
+  registry->emplace(OpKind(at::aten::relu), ElementwiseShape);
+  registry->emplace(OpKind(at::aten::mm), DotShape);
+  // The bias of addmm is broadcast to the dot result, and it is not part of
+  // the shape inference inputs.
+  registry->emplace(OpKind(at::aten::addmm), DotShape);
+  return registry;
+}
+
+bool AreStatic(absl::Span<const xla::Shape> shapes) {
+  for (auto& shape : shapes) {
+    if (!shape.is_static()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
 
 xla::Shape InferOutputShape(absl::Span<const xla::Shape> input_shapes,
                             const LowerForShapeFn& core_lowering_fn) {
+  XLA_COUNTER("BuilderShapeInference", 1);
   xla::XlaBuilder b("InferOutputShape");
   std::vector<xla::XlaOp> parameters;
   for (size_t parameter_number = 0; parameter_number < input_shapes.size();
@@ -34,6 +123,46 @@ xla::Shape InferOutputShape(absl::Span<const xla::Shape> input_shapes,
   return XlaHelpers::ShapeOfXlaOp(result);
 }
 
+xla::Shape InferOutputShape(absl::Span<const xla::Shape> input_shapes,
+                            const NativeShapeFn& native_shape_fn,
+                            const LowerForShapeFn& core_lowering_fn) {
+  static const bool check_shape_fns =
+      xla::sys_util::GetEnvBool("XLA_SHAPE_FN_CHECK", false);
+  if (!AreStatic(input_shapes)) {
+    return InferOutputShape(input_shapes, core_lowering_fn);
+  }
+  XLA_COUNTER("NativeShapeInference", 1);
+  xla::Shape shape = native_shape_fn(input_shapes);
+  if (check_shape_fns) {
+    xla::Shape builder_shape = InferOutputShape(input_shapes, core_lowering_fn);
+    XLA_CHECK(xla::ShapeUtil::Compatible(shape, builder_shape))
+        << "Native shape function mismatch: " << shape << " vs. "
+        << builder_shape << " (inputs: "
+        << absl::StrJoin(input_shapes, ", ",
+                         [](std::string* out, const xla::Shape& input_shape) {
+                           absl::StrAppend(out, input_shape.ToString());
+                         })
+        << ")";
+  }
+  return shape;
+}
+
+xla::Shape InferOutputShape(OpKind op,
+                            absl::Span<const xla::Shape> input_shapes,
+                            const LowerForShapeFn& core_lowering_fn) {
+  const NativeShapeFn* native_shape_fn = GetNativeShapeFn(op);
+  if (native_shape_fn == nullptr) {
+    return InferOutputShape(input_shapes, core_lowering_fn);
+  }
+  return InferOutputShape(input_shapes, *native_shape_fn, core_lowering_fn);
+}
+
+const NativeShapeFn* GetNativeShapeFn(OpKind op) {
+  static const ShapeFnRegistry* registry = CreateShapeFnRegistry();
+  auto it = registry->find(op);
+  return it != registry->end() ? &it->second : nullptr;
+}
+
 }  // namespace ops
 }  // namespace ir
 }  // namespace swift_xla
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "absl/types/span.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir.h"
 #include "tensorflow/compiler/xla/client/xla_builder.h"
 
 namespace swift_xla {
@@ -26,10 +27,33 @@ namespace ops {
 using LowerForShapeFn =
     std::function<xla::XlaOp(absl::Span<const xla::XlaOp> operands)>;
 
+// Computes the output shape of an operation from its input shapes, without
+// building it.
+using NativeShapeFn =
+    std::function<xla::Shape(absl::Span<const xla::Shape> input_shapes)>;
+
 // Compute the output shape for the given input shapes and lowering.
 xla::Shape InferOutputShape(absl::Span<const xla::Shape> input_shapes,
                             const LowerForShapeFn& core_lowering_fn);
 
+// Computes the output shape with native_shape_fn, instead of building an XLA
+// computation, if all the input shapes are static. Setting the
+// XLA_SHAPE_FN_CHECK environment variable cross-checks the native result
+// against the one inferred from core_lowering_fn.
+xla::Shape InferOutputShape(absl::Span<const xla::Shape> input_shapes,
+                            const NativeShapeFn& native_shape_fn,
+                            const LowerForShapeFn& core_lowering_fn);
+
+// Same as above, with the native shape function looked up from the registry of
+// the operations whose output shape only depends on the input shapes. Falls
+// back to core_lowering_fn if op has no registered shape function.
+xla::Shape InferOutputShape(OpKind op,
+                            absl::Span<const xla::Shape> input_shapes,
+                            const LowerForShapeFn& core_lowering_fn);
+
+// Returns the registered native shape function for op, or nullptr if none.
+const NativeShapeFn* GetNativeShapeFn(OpKind op);
+
 }  // namespace ops
 }  // namespace ir
 }  // namespace swift_xla
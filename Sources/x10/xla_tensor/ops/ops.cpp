@@ -81,7 +81,8 @@ std::string ToQualString(at::aten::SymbolKind kind) {
     return GenericOp(                                                          \
         OpKind(sym), OpList{input0, input1},                                   \
         [&]() {                                                                \
-          return InferOutputShape({input0.shape(), input1.shape()}, shape_fn); \
+          return InferOutputShape(OpKind(sym),                                 \
+                                  {input0.shape(), input1.shape()}, shape_fn); \
         },                                                                     \
         std::move(lower_fn));                                                  \
   }
@@ -182,7 +183,10 @@ NodePtr ReluOp(const Value& input) {
   };
   return GenericOp(
       OpKind(at::aten::relu), OpList{input},
-      [&]() { return InferOutputShape({input.shape()}, lower_for_shape_fn); },
+      [&]() {
+        return InferOutputShape(OpKind(at::aten::relu), {input.shape()},
+                                lower_for_shape_fn);
+      },
       std::move(lower_fn));
 }
 
@@ -280,7 +284,8 @@ NodePtr AddMatMulOp(const Value& input, const Value& weight,
   };
   return GenericOp(OpKind(at::aten::addmm), OpList{input, weight, bias},
                    [&]() {
-                     return InferOutputShape({input.shape(), weight.shape()},
+                     return InferOutputShape(OpKind(at::aten::addmm),
+                                             {input.shape(), weight.shape()},
                                              lower_for_shape_fn);
                    },
                    std::move(lower_fn));
@@ -306,7 +311,8 @@ NodePtr Dot(const Value& input, const Value& weight) {
   };
   return GenericOp(OpKind(at::aten::mm), OpList{input, weight},
                    [&]() {
-                     return InferOutputShape({input.shape(), weight.shape()},
+                     return InferOutputShape(OpKind(at::aten::mm),
+                                             {input.shape(), weight.shape()},
                                              lower_for_shape_fn);
                    },
                    std::move(lower_fn));
@@ -369,7 +375,8 @@ NodePtr ComparisonOp(c10::Symbol kind, const Value& input, const Value& other) {
   };
   return GenericOp(OpKind(kind), {input, other},
                    [&]() {
-                     return InferOutputShape({input.shape(), other.shape()},
+                     return InferOutputShape(OpKind(kind),
+                                             {input.shape(), other.shape()},
                                              lower_for_shape_fn);
                    },
                    std::move(lower_fn));
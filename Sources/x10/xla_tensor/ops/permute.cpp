@@ -32,7 +32,12 @@ xla::Shape NodeOutputShape(const Value& input,
     XLA_CHECK_EQ(operands.size(), 1);
     return xla::Transpose(operands[0], dims);
   };
-  return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  auto native_shape_fn =
+      [dims](absl::Span<const xla::Shape> input_shapes) -> xla::Shape {
+    return Permute::MakePermuteShape(input_shapes[0], dims);
+  };
+  return InferOutputShape({input.shape()}, native_shape_fn,
+                          lower_for_shape_fn);
 }
 
 }  // namespace
@@ -14,6 +14,7 @@
 
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/squeeze.h"
 
+#include "tensorflow/compiler/xla/shape_util.h"
 #include "tensorflow/compiler/xla/xla_client/debug_macros.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/data_ops.h"
@@ -39,7 +40,21 @@ xla::Shape NodeOutputShape(const Value& input, int dim) {
     XLA_CHECK_EQ(operands.size(), 1);
     return LowerSqueeze(operands[0], dim);
   };
-  return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  auto native_shape_fn =
+      [dim](absl::Span<const xla::Shape> input_shapes) -> xla::Shape {
+    const xla::Shape& input_shape = input_shapes[0];
+    if (dim >= 0) {
+      XLA_CHECK_LT(dim, input_shape.rank());
+      if (input_shape.dimensions(dim) != 1) {
+        return input_shape;
+      }
+    }
+    return xla::ShapeUtil::MakeShape(
+        input_shape.element_type(),
+        BuildSqueezedDimensions(input_shape.dimensions(), dim));
+  };
+  return InferOutputShape({input.shape()}, native_shape_fn,
+                          lower_for_shape_fn);
 }
 
 }  // namespace
@@ -14,7 +14,10 @@
 
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/sum.h"
 
+#include <algorithm>
+
 #include "absl/strings/str_join.h"
+#include "tensorflow/compiler/xla/shape_util.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/convert_ops.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/helpers.h"
@@ -43,7 +46,28 @@ xla::Shape NodeOutputShape(const Value& input,
       [&](absl::Span<const xla::XlaOp> operands) -> xla::XlaOp {
     return LowerSum(operands[0], dimensions, keep_reduced_dimensions, dtype);
   };
-  return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  // The conversions done by CastToScalarType() depend on the device, so only
+  // the summations which keep the input type have a native shape function.
+  if (dtype || input.shape().element_type() == xla::PrimitiveType::PRED) {
+    return InferOutputShape({input.shape()}, lower_for_shape_fn);
+  }
+  auto native_shape_fn =
+      [&](absl::Span<const xla::Shape> input_shapes) -> xla::Shape {
+    const xla::Shape& input_shape = input_shapes[0];
+    std::vector<xla::int64> output_dimensions;
+    for (xla::int64 i = 0; i < input_shape.rank(); ++i) {
+      if (std::find(dimensions.begin(), dimensions.end(), i) ==
+          dimensions.end()) {
+        output_dimensions.push_back(input_shape.dimensions(i));
+      } else if (keep_reduced_dimensions) {
+        output_dimensions.push_back(1);
+      }
+    }
+    return xla::ShapeUtil::MakeShape(input_shape.element_type(),
+                                     output_dimensions);
+  };
+  return InferOutputShape({input.shape()}, native_shape_fn,
+                          lower_for_shape_fn);
 }
 
 }  // namespace
@@ -0,0 +1,127 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests of the parameter plans, which bind the device data leaves of the IR
+// graphs hitting the compilation cache to the computation parameters, without
+// traversing the graphs.
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/tensor.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+XLATensor MakeTensor(std::vector<float> values) {
+  int64_t size = values.size();
+  return XLATensor::Create(at::Tensor(std::move(values), {size}),
+                           *GetDefaultDevice());
+}
+
+std::vector<float> TensorValues(XLATensor tensor) {
+  at::Tensor cpu_tensor = tensor.ToTensor();
+  absl::Span<const float> data = cpu_tensor.data<float>();
+  return std::vector<float>(data.begin(), data.end());
+}
+
+xla::int64 CounterValue(const std::string& name) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+void Sync(std::vector<XLATensor>* tensors) {
+  XLATensor::SyncTensorsGraph(tensors, /*devices=*/{}, /*wait=*/true,
+                              /*sync_xla_data=*/true);
+}
+
+// A step reading its inputs in a non commutative way, so that parameters
+// bound in the wrong order give wrong results: (x - y) * y and x - z.
+std::vector<XLATensor> RunStep(const XLATensor& x, const XLATensor& y,
+                               const XLATensor& z) {
+  std::vector<XLATensor> outputs = {
+      XLATensor::mul(XLATensor::sub(x, y, at::Scalar(1)), y),
+      XLATensor::sub(x, z, at::Scalar(1))};
+  Sync(&outputs);
+  return outputs;
+}
+
+TEST(ParameterPlanTest, BindsParametersWithoutTraversal) {
+  // The first step compiles, and the second one builds the plan.
+  RunStep(MakeTensor({1, 2, 3}), MakeTensor({4, 5, 6}),
+          MakeTensor({7, 8, 9}));
+  RunStep(MakeTensor({1, 2, 3}), MakeTensor({4, 5, 6}),
+          MakeTensor({7, 8, 9}));
+
+  xla::int64 avoided = CounterValue("AvoidedGraphTraversals");
+  xla::int64 mismatches = CounterValue("ParameterPlanMismatch");
+  for (float i = 0; i < 3; ++i) {
+    std::vector<XLATensor> outputs =
+        RunStep(MakeTensor({10 + i, 20, 30}), MakeTensor({1, 2 + i, 3}),
+                MakeTensor({5, 5, 5 + i}));
+    EXPECT_EQ(TensorValues(outputs[0]),
+              std::vector<float>({9 + i, (18 - i) * (2 + i), 81}));
+    EXPECT_EQ(TensorValues(outputs[1]),
+              std::vector<float>({5 + i, 15, 25 - i}));
+  }
+  EXPECT_EQ(CounterValue("AvoidedGraphTraversals"), avoided + 3);
+  EXPECT_EQ(CounterValue("ParameterPlanMismatch"), mismatches);
+}
+
+TEST(ParameterPlanTest, SharedInputMatchesPlan) {
+  // The same tensor read through two different paths of the graph is bound to
+  // a single parameter.
+  XLATensor y = MakeTensor({2, 3});
+  RunStep(MakeTensor({1, 1}), y, y);
+  RunStep(MakeTensor({1, 1}), y, y);
+
+  xla::int64 avoided = CounterValue("AvoidedGraphTraversals");
+  XLATensor other_y = MakeTensor({4, 5});
+  std::vector<XLATensor> outputs = RunStep(MakeTensor({6, 7}), other_y,
+                                           other_y);
+  EXPECT_EQ(TensorValues(outputs[0]), std::vector<float>({8, 10}));
+  EXPECT_EQ(TensorValues(outputs[1]), std::vector<float>({2, 2}));
+  EXPECT_EQ(CounterValue("AvoidedGraphTraversals"), avoided + 1);
+}
+
+TEST(ParameterPlanTest, MismatchFallsBackToTraversal) {
+  // Non special scalars are device data leaves as well, which the device data
+  // cache deduplicates by value. Equal scalars are bound to a single
+  // parameter, while the plan built with different ones binds two, so the
+  // plan does not match, and neither does the cached computation.
+  auto step = [](float a, float b) {
+    XLATensor x = MakeTensor({1, 2, 3, 4});
+    std::vector<XLATensor> outputs = {XLATensor::add(
+        XLATensor::mul(x, at::Scalar(a)), at::Scalar(b), at::Scalar(1))};
+    Sync(&outputs);
+    return TensorValues(outputs[0]);
+  };
+  step(2.5, 3.5);
+  step(4.5, 5.5);
+
+  xla::int64 mismatches = CounterValue("ParameterPlanMismatch");
+  xla::int64 param_mismatches = CounterValue("CachedCompileParamMismatch");
+  EXPECT_EQ(step(7.5, 7.5), std::vector<float>({15, 22.5, 30, 37.5}));
+  EXPECT_EQ(CounterValue("ParameterPlanMismatch"), mismatches + 1);
+  EXPECT_EQ(CounterValue("CachedCompileParamMismatch"),
+            param_mismatches + 1);
+  // The plans of the recompiled graph bind the right data.
+  EXPECT_EQ(step(2.5, 2.5), std::vector<float>({5, 7.5, 10, 12.5}));
+  EXPECT_EQ(step(1.5, 1.5), std::vector<float>({3, 4.5, 6, 7.5}));
+}
+
+}  // namespace
+}  // namespace swift_xla
@@ -0,0 +1,424 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/recompile_diagnostics.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/sys_util.h"
+#include "tensorflow/compiler/xla/xla_client/tf_logging.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir_util.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+
+namespace swift_xla {
+namespace {
+
+using Cause = RecompileDiagnostics::Cause;
+
+constexpr size_t kNumCauses = static_cast<size_t>(Cause::kPendingCompile) + 1;
+
+// An operand or root, as the post-order position of the node producing it,
+// and the output index within the node.
+using OutputRef = std::pair<size_t, size_t>;
+
+struct NodeFingerprint {
+  ir::OpKind op;
+  xla::Shape shape;
+  // Covers the op, the shape and the op specific attributes (like the values
+  // of constants).
+  size_t node_hash = 0;
+  std::vector<OutputRef> operands;
+  ir::MetaData metadata;
+};
+
+struct GraphFingerprint {
+  size_t hash = 0;
+  std::string device;
+  std::vector<NodeFingerprint> nodes;
+  std::vector<OutputRef> roots;
+};
+
+struct Explanation {
+  Cause cause;
+  std::string description;
+};
+
+GraphFingerprint CreateFingerprint(absl::Span<const ir::Value> roots,
+                                   size_t hash, const std::string& device) {
+  std::vector<const ir::Node*> root_nodes;
+  for (auto& root : roots) {
+    root_nodes.push_back(root.node.get());
+  }
+  std::vector<const ir::Node*> post_order =
+      ir::Util::ComputePostOrder(root_nodes);
+  std::unordered_map<const ir::Node*, size_t> positions;
+  GraphFingerprint graph;
+  graph.hash = hash;
+  graph.device = device;
+  graph.nodes.reserve(post_order.size());
+  for (const ir::Node* node : post_order) {
+    NodeFingerprint node_fingerprint;
+    node_fingerprint.op = node->op();
+    node_fingerprint.shape = node->shape();
+    node_fingerprint.node_hash = node->node_hash();
+    node_fingerprint.metadata = node->metadata();
+    for (auto& operand : node->operands()) {
+      node_fingerprint.operands.emplace_back(positions.at(operand.node),
+                                             operand.index);
+    }
+    positions.emplace(node, graph.nodes.size());
+    graph.nodes.push_back(std::move(node_fingerprint));
+  }
+  for (auto& root : roots) {
+    graph.roots.emplace_back(positions.at(root.node.get()), root.index);
+  }
+  return graph;
+}
+
+bool SameNode(const NodeFingerprint& node1, const NodeFingerprint& node2) {
+  return node1.node_hash == node2.node_hash && node1.op == node2.op &&
+         xla::ShapeUtil::Equal(node1.shape, node2.shape) &&
+         node1.operands == node2.operands;
+}
+
+// Whether the nodes have the same op and operands, which is the case for the
+// nodes downstream of a changed one (which can get different shapes).
+bool SameStructure(const NodeFingerprint& node1, const NodeFingerprint& node2) {
+  return node1.op == node2.op && node1.operands == node2.operands;
+}
+
+// How much a graph matches a compiled one, comparing the nodes at the same
+// post-order positions.
+struct GraphMatch {
+  // The number of nodes with the same structure.
+  size_t structure_matches = 0;
+  // The number of identical nodes.
+  size_t node_matches = 0;
+  // The position of the first node which is not identical.
+  size_t first_difference = 0;
+  // The difference among the graph sizes.
+  size_t size_delta = 0;
+
+  bool IsCloserThan(const GraphMatch& other) const {
+    if (structure_matches != other.structure_matches) {
+      return structure_matches > other.structure_matches;
+    }
+    if (node_matches != other.node_matches) {
+      return node_matches > other.node_matches;
+    }
+    return size_delta < other.size_delta;
+  }
+};
+
+GraphMatch MatchGraphs(const GraphFingerprint& graph,
+                       const GraphFingerprint& base) {
+  size_t size = std::min(graph.nodes.size(), base.nodes.size());
+  GraphMatch match;
+  match.first_difference = size;
+  for (size_t i = 0; i < size; ++i) {
+    if (SameStructure(graph.nodes[i], base.nodes[i])) {
+      match.structure_matches += 1;
+    }
+    if (SameNode(graph.nodes[i], base.nodes[i])) {
+      match.node_matches += 1;
+    } else if (match.first_difference == size) {
+      match.first_difference = i;
+    }
+  }
+  match.size_delta = graph.nodes.size() > base.nodes.size()
+                         ? graph.nodes.size() - base.nodes.size()
+                         : base.nodes.size() - graph.nodes.size();
+  return match;
+}
+
+std::string NodeInfo(const NodeFingerprint& node) {
+  std::string info = absl::StrCat(node.op.ToString(), " ",
+                                  xla::ShapeUtil::HumanString(node.shape));
+  const std::string& scope = node.metadata.scope();
+  if (!scope.empty()) {
+    absl::StrAppend(&info, ", scope=", scope);
+  }
+  return info;
+}
+
+// Explains the difference of the graph from the base one, where prefix is the
+// post-order position of the first node which differs.
+Explanation ExplainDifference(const GraphFingerprint& graph,
+                              const GraphFingerprint& base, size_t prefix) {
+  std::string base_info = absl::StrCat("compiled graph hash ", base.hash, " (",
+                                       base.nodes.size(), " nodes)");
+  if (prefix == graph.nodes.size() && prefix == base.nodes.size()) {
+    if (graph.roots != base.roots) {
+      return {Cause::kGraphCutChange,
+              absl::StrCat("syncs ", graph.roots.size(),
+                           " tensors of the same IR nodes as ", base_info,
+                           ", which syncs ", base.roots.size())};
+    }
+    if (base.hash == graph.hash) {
+      return {Cause::kCacheEviction, "evicted from the cache since compiled"};
+    }
+    // The graph hash also covers the device and the sync configuration.
+    return {Cause::kCacheEviction,
+            absl::StrCat("same IR graph as ", base_info,
+                         ", compiled on device ", base.device,
+                         " or with a different sync config")};
+  }
+  if (prefix == base.nodes.size()) {
+    return {Cause::kGraphCutChange,
+            absl::StrCat("extends ", base_info, " with ",
+                         graph.nodes.size() - prefix,
+                         " more nodes, starting with ",
+                         NodeInfo(graph.nodes[prefix]))};
+  }
+  if (prefix == graph.nodes.size()) {
+    return {Cause::kGraphCutChange,
+            absl::StrCat("stops ", base.nodes.size() - prefix,
+                         " nodes before the end of ", base_info,
+                         ", whose next node is ",
+                         NodeInfo(base.nodes[prefix]))};
+  }
+  const NodeFingerprint& node = graph.nodes[prefix];
+  const NodeFingerprint& base_node = base.nodes[prefix];
+  std::string change = absl::StrCat(" at node ", prefix, " with respect to ",
+                                    base_info, ": ", NodeInfo(base_node),
+                                    " -> ", NodeInfo(node));
+  if (node.op != base_node.op) {
+    return {Cause::kOpChange, absl::StrCat("op change", change)};
+  }
+  if (node.operands != base_node.operands) {
+    return {Cause::kOperandChange, absl::StrCat("operand change", change)};
+  }
+  if (!xla::ShapeUtil::Equal(node.shape, base_node.shape)) {
+    if (xla::ShapeUtil::EqualIgnoringElementType(node.shape,
+                                                 base_node.shape)) {
+      return {Cause::kDTypeChange, absl::StrCat("element type change", change)};
+    }
+    return {Cause::kShapeChange, absl::StrCat("shape change", change)};
+  }
+  if (node.op == ir::OpKind(at::prim::Constant)) {
+    return {Cause::kConstantChange, absl::StrCat("constant change", change)};
+  }
+  return {Cause::kOpAttributeChange, absl::StrCat("attribute change", change)};
+}
+
+xla::metrics::Counter* CauseCounter(Cause cause) {
+  static xla::metrics::Counter** counters = []() {
+    xla::metrics::Counter** counters = new xla::metrics::Counter*[kNumCauses];
+    for (size_t i = 0; i < kNumCauses; ++i) {
+      counters[i] = new xla::metrics::Counter(absl::StrCat(
+          "RecompileCause",
+          RecompileDiagnostics::CauseName(static_cast<Cause>(i))));
+    }
+    return counters;
+  }();
+  return counters[static_cast<size_t>(cause)];
+}
+
+class MissRecorder {
+ public:
+  static MissRecorder* Get() {
+    static MissRecorder* recorder = new MissRecorder();
+    return recorder;
+  }
+
+  Explanation RecordCacheMiss(GraphFingerprint graph, bool parameter_mismatch) {
+    std::lock_guard<std::mutex> lock(lock_);
+    Explanation explanation;
+    if (!parameter_mismatch && FindGraph(pending_, graph.hash) != nullptr) {
+      explanation = {Cause::kPendingCompile,
+                     "the same graph is still being compiled"};
+    } else {
+      explanation = Explain(graph, parameter_mismatch);
+    }
+    CauseStats& stats = stats_[static_cast<size_t>(explanation.cause)];
+    stats.count += 1;
+    stats.last_example = absl::StrCat("graph hash ", graph.hash, " (",
+                                      graph.nodes.size(), " nodes) on ",
+                                      graph.device, ": ",
+                                      explanation.description);
+    if (explanation.cause != Cause::kPendingCompile) {
+      AddGraph(&pending_, std::move(graph));
+    }
+    return explanation;
+  }
+
+  void RecordCompilation(size_t hash, bool compiled) {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+      if (it->hash == hash) {
+        if (compiled) {
+          AddGraph(&graphs_, std::move(*it));
+        }
+        pending_.erase(it);
+        break;
+      }
+    }
+  }
+
+  std::string CreateReport() {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::stringstream ss;
+    for (size_t i = 0; i < kNumCauses; ++i) {
+      if (stats_[i].count == 0) {
+        continue;
+      }
+      ss << "RecompileCause: "
+         << RecompileDiagnostics::CauseName(static_cast<Cause>(i)) << std::endl;
+      ss << "  Count: " << stats_[i].count << std::endl;
+      ss << "  LastExample: " << stats_[i].last_example << std::endl;
+    }
+    return ss.str();
+  }
+
+ private:
+  struct CauseStats {
+    size_t count = 0;
+    std::string last_example;
+  };
+
+  static size_t MaxGraphs() {
+    static const size_t max_graphs = xla::sys_util::GetEnvInt(
+        "XLA_RECOMPILE_DIAGNOSTICS_MAX_GRAPHS", 64);
+    return max_graphs;
+  }
+
+  static const GraphFingerprint* FindGraph(
+      const std::deque<GraphFingerprint>& graphs, size_t hash) {
+    for (auto& graph : graphs) {
+      if (graph.hash == hash) {
+        return &graph;
+      }
+    }
+    return nullptr;
+  }
+
+  // Adds the graph, replacing the one with the same hash, and drops the
+  // oldest ones above the XLA_RECOMPILE_DIAGNOSTICS_MAX_GRAPHS limit.
+  static void AddGraph(std::deque<GraphFingerprint>* graphs,
+                       GraphFingerprint graph) {
+    for (auto it = graphs->begin(); it != graphs->end(); ++it) {
+      if (it->hash == graph.hash) {
+        graphs->erase(it);
+        break;
+      }
+    }
+    graphs->push_back(std::move(graph));
+    while (graphs->size() > MaxGraphs()) {
+      graphs->pop_front();
+    }
+  }
+
+  // Must be called with lock_ held.
+  Explanation Explain(const GraphFingerprint& graph, bool parameter_mismatch) {
+    if (parameter_mismatch) {
+      return {Cause::kParameterMismatch,
+              "the cached computation takes a different number of parameters"};
+    }
+    // The most similar graph is the one with the most nodes of the same
+    // structure at the same post-order positions. Those are not required to
+    // form a prefix, as the leaves come first, and a change (like the shape of
+    // an input) propagates to the nodes downstream.
+    const GraphFingerprint* base = nullptr;
+    GraphMatch base_match;
+    for (auto it = graphs_.rbegin(); it != graphs_.rend(); ++it) {
+      GraphMatch match = MatchGraphs(graph, *it);
+      if (base == nullptr || match.IsCloserThan(base_match)) {
+        base = &*it;
+        base_match = match;
+      }
+    }
+    if (base == nullptr || (base_match.structure_matches == 0 &&
+                            base_match.node_matches == 0)) {
+      return {Cause::kNewGraph,
+              absl::StrCat("no similar graph among the last ", graphs_.size(),
+                           " compiled ones")};
+    }
+    return ExplainDifference(graph, *base, base_match.first_difference);
+  }
+
+  std::mutex lock_;
+  // The graphs which missed the cache, and are being compiled.
+  std::deque<GraphFingerprint> pending_;
+  // The most recently compiled graphs.
+  std::deque<GraphFingerprint> graphs_;
+  CauseStats stats_[kNumCauses];
+};
+
+}  // namespace
+
+bool RecompileDiagnostics::Enabled() {
+  static const bool enabled =
+      xla::sys_util::GetEnvBool("XLA_RECOMPILE_DIAGNOSTICS", false);
+  return enabled;
+}
+
+void RecompileDiagnostics::RecordCacheMiss(absl::Span<const ir::Value> roots,
+                                           size_t hash,
+                                           const std::string& device,
+                                           bool parameter_mismatch) {
+  Explanation explanation = MissRecorder::Get()->RecordCacheMiss(
+      CreateFingerprint(roots, hash, device), parameter_mismatch);
+  CauseCounter(explanation.cause)->AddValue(1);
+  TF_LOG(INFO) << "Compilation cache miss for IR graph hash " << hash
+               << " on device " << device << ", "
+               << CauseName(explanation.cause) << ": "
+               << explanation.description;
+}
+
+void RecompileDiagnostics::RecordCompilation(size_t hash, bool compiled) {
+  MissRecorder::Get()->RecordCompilation(hash, compiled);
+}
+
+std::string RecompileDiagnostics::CreateReport() {
+  return MissRecorder::Get()->CreateReport();
+}
+
+const char* RecompileDiagnostics::CauseName(Cause cause) {
+  switch (cause) {
+    case Cause::kNewGraph:
+      return "NewGraph";
+    case Cause::kShapeChange:
+      return "ShapeChange";
+    case Cause::kDTypeChange:
+      return "DTypeChange";
+    case Cause::kConstantChange:
+      return "ConstantChange";
+    case Cause::kOpAttributeChange:
+      return "OpAttributeChange";
+    case Cause::kOpChange:
+      return "OpChange";
+    case Cause::kOperandChange:
+      return "OperandChange";
+    case Cause::kGraphCutChange:
+      return "GraphCutChange";
+    case Cause::kParameterMismatch:
+      return "ParameterMismatch";
+    case Cause::kCacheEviction:
+      return "CacheEviction";
+    case Cause::kPendingCompile:
+      return "PendingCompile";
+  }
+  XLA_ERROR() << "Invalid recompile cause: " << static_cast<int>(cause);
+}
+
+}  // namespace swift_xla
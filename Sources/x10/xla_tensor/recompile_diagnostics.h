@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "absl/types/span.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ir.h"
+
+namespace swift_xla {
+
+// Explains why IR graphs miss the compilation cache. When enabled (via the
+// XLA_RECOMPILE_DIAGNOSTICS environment variable), a structural fingerprint of
+// every graph which misses the cache is taken: its nodes in post-order, with
+// their op kinds, shapes, hashes and operands. The graph is compared with the
+// most similar of the recently compiled ones, and the first differing node
+// tells the cause of the recompilation. The fingerprint joins the compiled
+// ones only once the graph has been compiled.
+class RecompileDiagnostics {
+ public:
+  enum class Cause {
+    // No similar graph was compiled before.
+    kNewGraph,
+    // A node has the same op, but a different shape.
+    kShapeChange,
+    // A node has the same op and dimensions, but a different element type.
+    kDTypeChange,
+    // A constant node has a different value.
+    kConstantChange,
+    // A node has the same op and shape, but different attributes.
+    kOpAttributeChange,
+    // A node has a different op.
+    kOpChange,
+    // A node has different operands.
+    kOperandChange,
+    // The graph is the same up to a point, but has more or less nodes, or it
+    // syncs a different set of tensors.
+    kGraphCutChange,
+    // The cached graph takes a different number of parameters.
+    kParameterMismatch,
+    // The same graph was compiled before, but was evicted from the cache (or
+    // has been compiled for a different device).
+    kCacheEviction,
+    // The same graph missed the cache before, and is still being compiled
+    // (like with XLA_BACKGROUND_COMPILE).
+    kPendingCompile,
+  };
+
+  static bool Enabled();
+
+  // Records the cache miss of the graph rooted at roots, whose hash is given,
+  // and logs its cause. The parameter_mismatch argument tells whether the
+  // graph hit the cache, but with a different number of parameters.
+  static void RecordCacheMiss(absl::Span<const ir::Value> roots, size_t hash,
+                              const std::string& device,
+                              bool parameter_mismatch);
+
+  // Records the end of the compilation of the graph with the given hash, which
+  // missed the cache. If compiled is true, the graph is added to the compiled
+  // ones that the following misses are compared with.
+  static void RecordCompilation(size_t hash, bool compiled);
+
+  // Creates a report with the recorded cache misses, aggregated by cause.
+  static std::string CreateReport();
+
+  static const char* CauseName(Cause cause);
+};
+
+}  // namespace swift_xla
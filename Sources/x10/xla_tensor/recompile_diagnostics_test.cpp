@@ -0,0 +1,150 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/recompile_diagnostics.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ops/arithmetic_ir_ops.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/ops/scalar.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+using Cause = RecompileDiagnostics::Cause;
+
+const char* kDevice = "CPU:0";
+
+xla::int64 CauseCount(Cause cause) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(
+      absl::StrCat("RecompileCause", RecompileDiagnostics::CauseName(cause)));
+  return data != nullptr ? data->Value() : 0;
+}
+
+// Records a cache miss, and returns whether it was counted under the expected
+// cause.
+bool MissHasCause(const std::vector<ir::Value>& roots, size_t hash,
+                  Cause cause, bool parameter_mismatch = false) {
+  xla::int64 count = CauseCount(cause);
+  RecompileDiagnostics::RecordCacheMiss(roots, hash, kDevice,
+                                        parameter_mismatch);
+  return CauseCount(cause) == count + 1;
+}
+
+// The leaves of the test graphs: two scalars broadcasted to the given shape.
+struct Leaves {
+  Leaves(xla::PrimitiveType type, absl::Span<const xla::int64> dimensions)
+      : a(ir::MakeNode<ir::ops::Scalar>(
+            1.0, xla::ShapeUtil::MakeShape(type, dimensions))),
+        b(ir::MakeNode<ir::ops::Scalar>(
+            2.0, xla::ShapeUtil::MakeShape(type, dimensions))) {}
+
+  ir::Value a;
+  ir::Value b;
+};
+
+std::vector<ir::Value> AddGraph(xla::PrimitiveType type,
+                                absl::Span<const xla::int64> dimensions) {
+  Leaves leaves(type, dimensions);
+  return {leaves.a + leaves.b};
+}
+
+std::vector<ir::Value> MulGraph(xla::PrimitiveType type,
+                                absl::Span<const xla::int64> dimensions) {
+  Leaves leaves(type, dimensions);
+  return {leaves.a * leaves.b};
+}
+
+std::vector<ir::Value> SubGraph(xla::PrimitiveType type,
+                                absl::Span<const xla::int64> dimensions) {
+  Leaves leaves(type, dimensions);
+  return {leaves.a - leaves.b};
+}
+
+// The recorded graphs are global, so the tests use distinct hashes, and the
+// compiled graphs of a test are candidates for the misses of the next ones.
+
+TEST(RecompileDiagnosticsTest, Causes) {
+  Leaves leaves(xla::F32, {2, 3});
+  std::vector<ir::Value> graph = {leaves.a + leaves.b};
+  EXPECT_TRUE(MissHasCause(graph, 100, Cause::kNewGraph));
+  // The same graph misses again while being compiled.
+  EXPECT_TRUE(MissHasCause(graph, 100, Cause::kPendingCompile));
+  RecompileDiagnostics::RecordCompilation(100, /*compiled=*/true);
+  EXPECT_TRUE(MissHasCause(graph, 100, Cause::kCacheEviction));
+  RecompileDiagnostics::RecordCompilation(100, /*compiled=*/true);
+  // The same IR graph under another hash, like on a different device.
+  EXPECT_TRUE(MissHasCause(graph, 101, Cause::kCacheEviction));
+  RecompileDiagnostics::RecordCompilation(101, /*compiled=*/false);
+  EXPECT_TRUE(MissHasCause(graph, 100, Cause::kParameterMismatch,
+                           /*parameter_mismatch=*/true));
+  RecompileDiagnostics::RecordCompilation(100, /*compiled=*/true);
+
+  EXPECT_TRUE(
+      MissHasCause(AddGraph(xla::F32, {4, 3}), 102, Cause::kShapeChange));
+  RecompileDiagnostics::RecordCompilation(102, /*compiled=*/false);
+  EXPECT_TRUE(
+      MissHasCause(AddGraph(xla::F64, {2, 3}), 103, Cause::kDTypeChange));
+  // A failed compilation is not compared with, and a new miss of the graph is
+  // explained again.
+  RecompileDiagnostics::RecordCompilation(103, /*compiled=*/false);
+  EXPECT_TRUE(
+      MissHasCause(AddGraph(xla::F64, {2, 3}), 103, Cause::kDTypeChange));
+  RecompileDiagnostics::RecordCompilation(103, /*compiled=*/false);
+
+  // Syncing one more tensor of the same IR nodes.
+  EXPECT_TRUE(MissHasCause({graph[0], leaves.a}, 104, Cause::kGraphCutChange));
+  RecompileDiagnostics::RecordCompilation(104, /*compiled=*/false);
+  // Extending the graph with more nodes.
+  EXPECT_TRUE(
+      MissHasCause({graph[0] + graph[0]}, 105, Cause::kGraphCutChange));
+  RecompileDiagnostics::RecordCompilation(105, /*compiled=*/false);
+
+  std::string report = RecompileDiagnostics::CreateReport();
+  EXPECT_TRUE(absl::StrContains(report, "RecompileCause: ShapeChange"));
+  EXPECT_TRUE(absl::StrContains(report, "RecompileCause: PendingCompile"));
+}
+
+TEST(RecompileDiagnosticsTest, ComparesWithClosestGraph) {
+  RecompileDiagnostics::RecordCacheMiss(AddGraph(xla::F32, {5, 7}), 200,
+                                        kDevice, /*parameter_mismatch=*/false);
+  RecompileDiagnostics::RecordCompilation(200, /*compiled=*/true);
+  RecompileDiagnostics::RecordCacheMiss(MulGraph(xla::F32, {6, 7}), 201,
+                                        kDevice, /*parameter_mismatch=*/false);
+  RecompileDiagnostics::RecordCompilation(201, /*compiled=*/true);
+
+  // The add graph has the same leaves, and differs only by its last op. But
+  // the mul graph has the same op at every node, and only the shapes of its
+  // leaves changed (which propagates to all the nodes downstream). The graph
+  // with the most nodes of the same structure is the closest one, so the miss
+  // is a shape change rather than an op change.
+  EXPECT_TRUE(
+      MissHasCause(MulGraph(xla::F32, {5, 7}), 202, Cause::kShapeChange));
+  RecompileDiagnostics::RecordCompilation(202, /*compiled=*/false);
+
+  // The add and the mul graphs have the same number of nodes of the same
+  // structure, the leaves, but only the ones of the add graph are identical.
+  // The mul graph is compared first, being the most recently compiled one.
+  EXPECT_TRUE(MissHasCause(SubGraph(xla::F32, {5, 7}), 203, Cause::kOpChange));
+  RecompileDiagnostics::RecordCompilation(203, /*compiled=*/false);
+}
+
+}  // namespace
+}  // namespace swift_xla
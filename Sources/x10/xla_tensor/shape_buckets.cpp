@@ -0,0 +1,169 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/shape_buckets.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/compiler/xla/xla_client/util.h"
+
+namespace swift_xla {
+namespace {
+
+class BucketRegistry {
+ public:
+  static BucketRegistry* Get() {
+    static BucketRegistry* registry = new BucketRegistry();
+    return registry;
+  }
+
+  void SetDimensionBuckets(xla::int64 dim, std::vector<xla::int64> sizes) {
+    for (auto size : sizes) {
+      XLA_CHECK_GT(size, 0) << "Invalid bucket size for dimension " << dim;
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    std::lock_guard<std::mutex> lock(lock_);
+    if (sizes.empty()) {
+      buckets_.erase(dim);
+    } else {
+      buckets_[dim] = std::move(sizes);
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(lock_);
+    buckets_.clear();
+  }
+
+  std::vector<xla::int64> GetPaddedDimensions(
+      absl::Span<const xla::int64> dims) {
+    std::vector<xla::int64> padded_dims(dims.begin(), dims.end());
+    std::lock_guard<std::mutex> lock(lock_);
+    xla::int64 rank = padded_dims.size();
+    for (auto& dim_sizes : buckets_) {
+      xla::int64 dim =
+          dim_sizes.first < 0 ? dim_sizes.first + rank : dim_sizes.first;
+      if (dim < 0 || dim >= rank) {
+        continue;
+      }
+      const std::vector<xla::int64>& sizes = dim_sizes.second;
+      auto it = std::lower_bound(sizes.begin(), sizes.end(), padded_dims[dim]);
+      if (it == sizes.end()) {
+        GetCounter(dim_sizes.first, -1)->AddValue(1);
+      } else {
+        GetCounter(dim_sizes.first, *it)->AddValue(1);
+        padded_dims[dim] = *it;
+      }
+    }
+    return padded_dims;
+  }
+
+ private:
+  // Returns the counter of the hits of a bucket, or of the overflows of a
+  // dimension if size is negative. Must be called with lock_ held.
+  xla::metrics::Counter* GetCounter(xla::int64 dim, xla::int64 size) {
+    std::pair<xla::int64, xla::int64> key(dim, size);
+    return xla::util::MapInsert(&counters_, key, [&]() {
+             std::string name =
+                 dim < 0 ? absl::StrCat("ShapeBucketDimMinus", -dim)
+                         : absl::StrCat("ShapeBucketDim", dim);
+             absl::StrAppend(&name, size < 0 ? std::string("Overflow")
+                                             : absl::StrCat("Size", size));
+             return std::make_shared<xla::metrics::Counter>(std::move(name));
+           })
+        .get();
+  }
+
+  std::mutex lock_;
+  std::map<xla::int64, std::vector<xla::int64>> buckets_;
+  std::map<std::pair<xla::int64, xla::int64>,
+           std::shared_ptr<xla::metrics::Counter>>
+      counters_;
+};
+
+}  // namespace
+
+void ShapeBuckets::SetDimensionBuckets(xla::int64 dim,
+                                       std::vector<xla::int64> sizes) {
+  BucketRegistry::Get()->SetDimensionBuckets(dim, std::move(sizes));
+}
+
+void ShapeBuckets::ClearDimensionBuckets() { BucketRegistry::Get()->Clear(); }
+
+std::vector<xla::int64> ShapeBuckets::GetPaddedDimensions(
+    absl::Span<const xla::int64> dims) {
+  return BucketRegistry::Get()->GetPaddedDimensions(dims);
+}
+
+void ShapeBuckets::PadData(const void* src, absl::Span<const xla::int64> dims,
+                           void* dest, absl::Span<const xla::int64> padded_dims,
+                           size_t element_size) {
+  XLA_CHECK_EQ(dims.size(), padded_dims.size());
+  xla::int64 num_elements = xla::util::Multiply<xla::int64>(dims);
+  xla::int64 padded_num_elements =
+      xla::util::Multiply<xla::int64>(padded_dims);
+  XLA_COUNTER("ShapeBucketPaddedBytes",
+              (padded_num_elements - num_elements) * element_size);
+  if (padded_num_elements > 0) {
+    XLA_VALUE_METRIC("ShapeBucketPaddingFraction",
+                     static_cast<double>(padded_num_elements - num_elements) /
+                         padded_num_elements);
+  }
+  std::memset(dest, 0, padded_num_elements * element_size);
+  if (num_elements == 0) {
+    return;
+  }
+  if (dims.empty()) {
+    std::memcpy(dest, src, element_size);
+    return;
+  }
+  // Copies the source rows (along the minor dimension) one by one, tracking
+  // the multi-dimensional index of the current row.
+  size_t rank = dims.size();
+  size_t row_bytes = dims[rank - 1] * element_size;
+  std::vector<xla::int64> padded_strides(rank, 1);
+  for (size_t i = rank - 1; i > 0; --i) {
+    XLA_CHECK_LE(dims[i], padded_dims[i]);
+    padded_strides[i - 1] = padded_strides[i] * padded_dims[i];
+  }
+  XLA_CHECK_LE(dims[0], padded_dims[0]);
+  std::vector<xla::int64> index(rank, 0);
+  const char* src_row = static_cast<const char*>(src);
+  char* dest_data = static_cast<char*>(dest);
+  for (xla::int64 row = 0; row < num_elements / dims[rank - 1]; ++row) {
+    xla::int64 offset = 0;
+    for (size_t i = 0; i + 1 < rank; ++i) {
+      offset += index[i] * padded_strides[i];
+    }
+    std::memcpy(dest_data + offset * element_size, src_row, row_bytes);
+    src_row += row_bytes;
+    for (size_t i = rank - 1; i > 0; --i) {
+      if (++index[i - 1] < dims[i - 1]) {
+        break;
+      }
+      index[i - 1] = 0;
+    }
+  }
+}
+
+}  // namespace swift_xla
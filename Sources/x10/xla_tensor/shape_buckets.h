@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 TensorFlow Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "tensorflow/compiler/xla/types.h"
+
+namespace swift_xla {
+
+// Bounds the number of distinct shapes (and hence of compiled graphs) produced
+// by variable size inputs, like the sequence lengths of a text model or the
+// last partial batch of an epoch. Input dimensions with registered bucket
+// sizes are padded up to the smallest bucket size which fits them.
+class ShapeBuckets {
+ public:
+  // Registers the bucket sizes of the dim dimension of the bucketed tensors.
+  // Negative dimensions count from the last one (-1). An empty list of sizes
+  // removes the bucketing of the dimension.
+  static void SetDimensionBuckets(xla::int64 dim,
+                                  std::vector<xla::int64> sizes);
+
+  static void ClearDimensionBuckets();
+
+  // Returns the dimensions padded up to their bucket sizes. Dimensions larger
+  // than the largest bucket size of their dimension are left unpadded.
+  static std::vector<xla::int64> GetPaddedDimensions(
+      absl::Span<const xla::int64> dims);
+
+  // Copies the row-major src data of the given dimensions into dest, whose
+  // (row-major) padded_dims must be not smaller than the source ones. The
+  // padding is filled with zeros.
+  static void PadData(const void* src, absl::Span<const xla::int64> dims,
+                      void* dest, absl::Span<const xla::int64> padded_dims,
+                      size_t element_size);
+};
+
+}  // namespace swift_xla
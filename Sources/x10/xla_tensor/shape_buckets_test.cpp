@@ -0,0 +1,150 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/shape_buckets.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+xla::int64 CounterValue(const std::string& name) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+xla::int64 NumElements(const std::vector<xla::int64>& dims) {
+  xla::int64 num_elements = 1;
+  for (xla::int64 dim : dims) {
+    num_elements *= dim;
+  }
+  return num_elements;
+}
+
+// Element by element reference of ShapeBuckets::PadData(): walks the padded
+// indices, and copies the source element of the indices within the source
+// dimensions.
+std::vector<uint8_t> ReferencePad(const std::vector<uint8_t>& src,
+                                  const std::vector<xla::int64>& dims,
+                                  const std::vector<xla::int64>& padded_dims,
+                                  size_t element_size) {
+  std::vector<uint8_t> dest(NumElements(padded_dims) * element_size, 0);
+  std::vector<xla::int64> index(dims.size(), 0);
+  for (xla::int64 i = 0; i < NumElements(padded_dims); ++i) {
+    xla::int64 src_offset = 0;
+    bool in_source = true;
+    for (size_t d = 0; d < dims.size(); ++d) {
+      in_source = in_source && index[d] < dims[d];
+      src_offset = src_offset * dims[d] + index[d];
+    }
+    if (in_source) {
+      for (size_t k = 0; k < element_size; ++k) {
+        dest[i * element_size + k] = src[src_offset * element_size + k];
+      }
+    }
+    for (size_t d = dims.size(); d > 0; --d) {
+      if (++index[d - 1] < padded_dims[d - 1]) {
+        break;
+      }
+      index[d - 1] = 0;
+    }
+  }
+  return dest;
+}
+
+void ExpectPadMatchesReference(const std::vector<xla::int64>& dims,
+                               const std::vector<xla::int64>& padded_dims,
+                               size_t element_size) {
+  std::vector<uint8_t> src(NumElements(dims) * element_size);
+  for (size_t i = 0; i < src.size(); ++i) {
+    // Never zero, so that elements left as padding are caught.
+    src[i] = static_cast<uint8_t>(i % 255 + 1);
+  }
+  // The padding is written over whatever the destination held.
+  std::vector<uint8_t> dest(NumElements(padded_dims) * element_size, 0xff);
+  xla::int64 padded_bytes = CounterValue("ShapeBucketPaddedBytes");
+  ShapeBuckets::PadData(src.data(), dims, dest.data(), padded_dims,
+                        element_size);
+  EXPECT_EQ(dest, ReferencePad(src, dims, padded_dims, element_size))
+      << "rank=" << dims.size() << " element_size=" << element_size;
+  EXPECT_EQ(CounterValue("ShapeBucketPaddedBytes"),
+            padded_bytes + (NumElements(padded_dims) - NumElements(dims)) *
+                               element_size);
+}
+
+TEST(ShapeBucketsTest, PadData) {
+  std::vector<std::vector<std::vector<xla::int64>>> cases = {
+      // Scalars.
+      {{}, {}},
+      {{5}, {5}},
+      {{5}, {8}},
+      {{3, 4}, {3, 4}},
+      {{3, 4}, {8, 4}},
+      {{3, 4}, {3, 16}},
+      {{3, 4}, {4, 5}},
+      {{2, 3, 5}, {4, 3, 8}},
+      {{2, 1, 3, 2}, {2, 4, 4, 3}},
+      // Empty sources leave all zeros.
+      {{0}, {4}},
+      {{3, 0}, {4, 2}},
+      {{0, 5}, {2, 8}},
+  };
+  for (auto& dims_case : cases) {
+    for (size_t element_size : {1, 2, 4, 8}) {
+      ExpectPadMatchesReference(dims_case[0], dims_case[1], element_size);
+    }
+  }
+}
+
+TEST(ShapeBucketsTest, GetPaddedDimensions) {
+  ShapeBuckets::ClearDimensionBuckets();
+  ShapeBuckets::SetDimensionBuckets(0, {32, 8, 16, 8});
+  ShapeBuckets::SetDimensionBuckets(-1, {128, 64});
+  xla::int64 size8 = CounterValue("ShapeBucketDim0Size8");
+  xla::int64 size32 = CounterValue("ShapeBucketDim0Size32");
+  xla::int64 overflow = CounterValue("ShapeBucketDim0Overflow");
+  xla::int64 last_size64 = CounterValue("ShapeBucketDimMinus1Size64");
+
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({5, 10}),
+            std::vector<xla::int64>({8, 64}));
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({8, 3, 64}),
+            std::vector<xla::int64>({8, 3, 64}));
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({17, 100}),
+            std::vector<xla::int64>({32, 128}));
+  // Dimensions larger than the largest bucket size are left unpadded.
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({33, 129}),
+            std::vector<xla::int64>({33, 129}));
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({}),
+            std::vector<xla::int64>());
+  EXPECT_EQ(CounterValue("ShapeBucketDim0Size8"), size8 + 2);
+  EXPECT_EQ(CounterValue("ShapeBucketDim0Size32"), size32 + 1);
+  EXPECT_EQ(CounterValue("ShapeBucketDim0Overflow"), overflow + 1);
+  EXPECT_EQ(CounterValue("ShapeBucketDimMinus1Size64"), last_size64 + 2);
+
+  // An empty list of sizes removes the bucketing of the dimension.
+  ShapeBuckets::SetDimensionBuckets(0, {});
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({5, 10}),
+            std::vector<xla::int64>({5, 64}));
+  ShapeBuckets::ClearDimensionBuckets();
+  EXPECT_EQ(ShapeBuckets::GetPaddedDimensions({5, 10}),
+            std::vector<xla::int64>({5, 10}));
+}
+
+}  // namespace
+}  // namespace swift_xla
@@ -18,11 +18,15 @@
 #include <atomic>
 #include <cmath>
 #include <condition_variable>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <limits>
 #include <mutex>
 #include <set>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_join.h"
@@ -31,6 +35,7 @@
 #include "tensorflow/compiler/xla/xla_client/metrics.h"
 #include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/thread_pool.h"
+#include "tensorflow/compiler/xla/xla_client/trace_events.h"
 #include "tensorflow/compiler/xla/xla_client/unique.h"
 #include "tensorflow/compiler/xla/xla_client/xla_util.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/debug_util.h"
@@ -44,6 +49,7 @@
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/ops.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/view.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/ops/xla_ops.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/recompile_diagnostics.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/tensor_util.h"
 #include "tensorflow/compiler/xla/literal_util.h"
 #include "tensorflow/compiler/xla/shape_util.h"
@@ -173,32 +179,53 @@ std::vector<xla::util::ExceptionCleanup> LockDevices(
   return unlocker;
 }
 
+// Marks the device data held by the device data cache, which is shared by all
+// the uploads of the same value (so it cannot be bound to a captured graph).
+struct CachedDeviceDataInfo : public xla::ComputationClient::Data::Info {};
+
 class XlaDataCacheArena {
  public:
-  struct TensorHasher {
-    size_t operator()(const at::Tensor& tensor) const {
-      return xla::util::HashCombine(
-          xla::util::GetEnumValue(tensor.scalar_type()), TensorHash(tensor));
-    };
+  // The cache key carries the tensor hash, so that it is computed only once
+  // per upload, rather than every time the cache (or its shard maps) need it.
+  struct TensorKey {
+    explicit TensorKey(at::Tensor tensor)
+        : tensor(std::move(tensor)),
+          hash(xla::util::HashCombine(
+              xla::util::GetEnumValue(this->tensor.scalar_type()),
+              TensorHash(this->tensor))) {}
+
+    at::Tensor tensor;
+    size_t hash = 0;
+  };
+
+  struct TensorKeyHasher {
+    size_t operator()(const TensorKey& key) const { return key.hash; }
   };
-  struct TensorComparer {
-    bool operator()(const at::Tensor& tensor1,
-                    const at::Tensor& tensor2) const {
-      return tensor1.scalar_type() == tensor2.scalar_type() &&
-             tensor1.equal(tensor2);
+  struct TensorKeyComparer {
+    bool operator()(const TensorKey& key1, const TensorKey& key2) const {
+      return key1.hash == key2.hash &&
+             key1.tensor.scalar_type() == key2.tensor.scalar_type() &&
+             key1.tensor.equal(key2.tensor);
     }
   };
 
   using XlaDataCache =
-      xla::util::Cache<at::Tensor, xla::ComputationClient::Data, TensorHasher,
-                       TensorComparer>;
+      xla::util::ShardedCache<TensorKey, xla::ComputationClient::Data,
+                              TensorKeyHasher, TensorKeyComparer>;
 
-  explicit XlaDataCacheArena(size_t max_cache_size)
+  XlaDataCacheArena(size_t max_cache_size, xla::int64 max_cache_bytes)
       : max_cache_size_(max_cache_size) {
+    auto cost_fn = [](const TensorKey& key,
+                      const xla::ComputationClient::Data&) {
+      return static_cast<xla::int64>(
+          key.tensor.buffer().size() *
+          at::internal::GetSizeof(key.tensor.scalar_type()));
+    };
     for (const std::string& device_string :
          xla::ComputationClient::Get()->GetAllDevices()) {
       swift_xla::Device device(device_string);
-      std::unique_ptr<XlaDataCache> cache(new XlaDataCache(max_cache_size_));
+      std::unique_ptr<XlaDataCache> cache(new XlaDataCache(
+          "DeviceDataCache", max_cache_size_, max_cache_bytes, cost_fn));
       device_caches_.emplace(device, std::move(cache));
     }
   }
@@ -219,17 +246,22 @@ class XlaDataCacheArena {
 XlaDataCacheArena::XlaDataCache* GetXlaDataCache(const Device& device) {
   static const size_t kMaxCacheSize =
       xla::sys_util::GetEnvInt("XLA_DEVDATA_CACHE_SIZE", 128);
-  static XlaDataCacheArena* arena = new XlaDataCacheArena(kMaxCacheSize);
+  static const xla::int64 kMaxCacheBytes =
+      xla::sys_util::GetEnvInt("XLA_DEVDATA_CACHE_BYTES", 0);
+  static XlaDataCacheArena* arena =
+      new XlaDataCacheArena(kMaxCacheSize, kMaxCacheBytes);
   return arena->Get(device);
 }
 
 xla::ComputationClient::DataPtr GetDeviceData(const at::Tensor& tensor,
                                               const Device& device) {
   XlaDataCacheArena::XlaDataCache* cache = GetXlaDataCache(device);
-  xla::ComputationClient::DataPtr device_data = cache->Get(tensor);
+  XlaDataCacheArena::TensorKey key(tensor.dup());
+  xla::ComputationClient::DataPtr device_data = cache->Get(key);
   if (device_data == nullptr) {
     device_data = TensorToXlaData(tensor, device);
-    cache->Add(tensor.dup(), device_data);
+    device_data->SetInfo(std::make_shared<CachedDeviceDataInfo>());
+    cache->Add(std::move(key), device_data);
   }
   return device_data;
 }
@@ -271,6 +303,31 @@ bool ShouldSyncIrValue(const ir::Value& ir_value) {
   return ir_value->op() != ir::ops::xla_not_supported;
 }
 
+// Tracks the graph hashes whose compilation is in flight in background, so
+// that every graph gets submitted for compilation only once.
+class PendingCompilations {
+ public:
+  static PendingCompilations* Get() {
+    static PendingCompilations* pending = new PendingCompilations();
+    return pending;
+  }
+
+  // Returns true if the hash was not already pending.
+  bool Add(size_t hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hashes_.insert(hash).second;
+  }
+
+  void Remove(size_t hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hashes_.erase(hash);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_set<size_t> hashes_;
+};
+
 }  // namespace
 
 // The DeviceContextArena holds per device live information and statistics,
@@ -395,6 +452,7 @@ XLATensor::Async::Async(
       unlocker(std::move(coll->unlocker)),
       parameters_data(std::move(parameters_data)),
       device(std::move(coll->device)),
+      hash(coll->hash),
       cached_computation(std::move(cached_computation)),
       tensors_data(std::move(tensors_data)) {}
 
@@ -625,12 +683,22 @@ void XLATensor::TryLimitGraphSize() {
       xla::sys_util::GetEnvInt("TRIM_GRAPH_CHECK_FREQUENCY", 5000);
   static const size_t kMaxPendingGraphSize =
       xla::sys_util::GetEnvInt("TRIM_GRAPH_SIZE", 100000);
-  if (data()->ir_value && ++g_tls_data.trim_counter % kCheckFrequency == 0) {
-    size_t graph_size = ir::Util::GetGraphSize({data()->ir_value.node.get()});
-    if (graph_size > kMaxPendingGraphSize) {
-      XLA_COUNTER("TrimIrGraph", 1);
-      ApplyPendingGraph();
-    }
+  // The node level graph size is exact for trees, and an upper bound for
+  // graphs with shared subgraphs, so only when it goes above the limit we need
+  // to walk the graph to get the real size. As such walks are expensive, they
+  // are sampled every kCheckFrequency updates, with the first one happening
+  // right away, so that tree graphs get cut exactly at the limit.
+  if (!data()->ir_value ||
+      data()->ir_value->graph_size() <= kMaxPendingGraphSize ||
+      g_tls_data.trim_counter++ % kCheckFrequency != 0) {
+    return;
+  }
+  XLA_COUNTER("TrimIrGraphCheck", 1);
+  size_t graph_size = ir::Util::GetGraphSize({data()->ir_value.node.get()});
+  if (graph_size > kMaxPendingGraphSize) {
+    XLA_COUNTER("TrimIrGraph", 1);
+    ApplyPendingGraph();
+    g_tls_data.trim_counter = 0;
   }
 }
 
@@ -780,7 +848,8 @@ at::Tensor XLATensor::ToTensor() {
     // is available on the tensor.
     std::vector<xla::Literal> literals =
         xla::ComputationClient::Get()->TransferFromServer({GetXlaData()});
-    tensor_data = MakeTensorFromXlaLiteral(literals.front(), dtype());
+    tensor_data =
+        MakeTensorFromXlaLiteral(std::move(literals.front()), dtype());
     SetTensorData(*tensor_data);
   }
   return *tensor_data;
@@ -881,8 +950,8 @@ std::vector<at::Tensor> XLATensor::GetTensorsOpByOp(
       results.push_back(*tensor_data);
     } else {
       XLA_CHECK_LT(literals_index, literals.size());
-      results.push_back(MakeTensorFromXlaLiteral(literals[literals_index],
-                                                 (*tensors)[i].dtype()));
+      results.push_back(MakeTensorFromXlaLiteral(
+          std::move(literals[literals_index]), (*tensors)[i].dtype()));
       ++literals_index;
     }
   }
@@ -921,8 +990,8 @@ std::vector<at::Tensor> XLATensor::GetTensorsFused(
       results.push_back(*tensor_data);
     } else {
       XLA_CHECK_LT(literals_index, literals.size());
-      results.push_back(MakeTensorFromXlaLiteral(literals[literals_index],
-                                                 (*tensors)[i].dtype()));
+      results.push_back(MakeTensorFromXlaLiteral(
+          std::move(literals[literals_index]), (*tensors)[i].dtype()));
       ++literals_index;
     }
   }
@@ -1075,6 +1144,28 @@ XLATensor::SyncTensorCollection XLATensor::CollectSyncTensors(
   return coll;
 }
 
+void XLATensor::RecordCacheMiss(const std::vector<XLATensor>& tensors,
+                                size_t hash, absl::Span<const size_t> indices,
+                                bool parameter_mismatch) {
+  if (!RecompileDiagnostics::Enabled()) {
+    return;
+  }
+  std::vector<ir::Value> roots;
+  roots.reserve(indices.size());
+  for (auto index : indices) {
+    roots.push_back(tensors[index].CurrentIrValue());
+  }
+  RecompileDiagnostics::RecordCacheMiss(
+      roots, hash, tensors[indices.front()].GetDevice().ToString(),
+      parameter_mismatch);
+}
+
+void XLATensor::RecordCompilation(size_t hash, bool compiled) {
+  if (RecompileDiagnostics::Enabled()) {
+    RecompileDiagnostics::RecordCompilation(hash, compiled);
+  }
+}
+
 XLATensor::ComputationCache::TypePtr XLATensor::LookupCachedCompile(
     const std::vector<XLATensor>& tensors, size_t hash,
     absl::Span<const size_t> indices,
@@ -1083,17 +1174,31 @@ XLATensor::ComputationCache::TypePtr XLATensor::LookupCachedCompile(
       GetComputationCache()->Get(hash);
   if (cached_computation == nullptr) {
     XLA_COUNTER("UncachedCompile", 1);
+    RecordCacheMiss(tensors, hash, indices, /*parameter_mismatch=*/false);
     return nullptr;
   }
-  size_t graph_size;
-  *parameters_data = FetchParameters(tensors, indices, &graph_size);
-  if (cached_computation->num_parameters != parameters_data->size()) {
-    XLA_COUNTER("CachedCompileParamMismatch", 1);
-    GetComputationCache()->Erase(hash);
-    return nullptr;
+  std::shared_ptr<const ParameterPlan> plan =
+      std::atomic_load(&cached_computation->parameter_plan);
+  if (plan != nullptr &&
+      FetchParametersWithPlan(*plan, tensors, indices, parameters_data)) {
+    XLA_COUNTER("AvoidedGraphTraversals", 1);
+  } else {
+    if (plan != nullptr) {
+      XLA_COUNTER("ParameterPlanMismatch", 1);
+    }
+    size_t graph_size;
+    *parameters_data = FetchParameters(tensors, indices, &graph_size);
+    if (cached_computation->num_parameters != parameters_data->size()) {
+      XLA_COUNTER("CachedCompileParamMismatch", 1);
+      RecordCacheMiss(tensors, hash, indices, /*parameter_mismatch=*/true);
+      GetComputationCache()->Erase(hash);
+      return nullptr;
+    }
+    XLA_VALUE_METRIC("TensorsGraphSize", graph_size);
+    TF_VLOG(5) << "TensorsGraphSize=" << graph_size;
+    std::atomic_store(&cached_computation->parameter_plan,
+                      BuildParameterPlan(tensors, indices, *parameters_data));
   }
-  XLA_VALUE_METRIC("TensorsGraphSize", graph_size);
-  TF_VLOG(5) << "TensorsGraphSize=" << graph_size;
 
   XLA_COUNTER("CachedCompile", 1);
   return cached_computation;
@@ -1114,10 +1219,134 @@ std::shared_ptr<XLATensor::Async> XLATensor::TryRunCachedSync(
 XLATensor::ComputationCache* XLATensor::GetComputationCache() {
   static const size_t kMaxCacheSize =
       xla::sys_util::GetEnvInt("XLA_COMPILATION_CACHE_SIZE", 1024);
-  static ComputationCache* cache = new ComputationCache(kMaxCacheSize);
+  static const xla::int64 kMaxCacheBytes =
+      xla::sys_util::GetEnvInt("XLA_COMPILATION_CACHE_BYTES", 0);
+  // The compiled executables are opaque, so the size of the HLO module proto
+  // is used as proxy for their memory cost.
+  auto cost_fn = [](const size_t&, const CachedComputation& computation) {
+    return static_cast<xla::int64>(
+        computation.computation->computation().proto().ByteSizeLong());
+  };
+  static ComputationCache* cache = new ComputationCache(
+      "CompilationCache", kMaxCacheSize, kMaxCacheBytes, cost_fn);
   return cache;
 }
 
+struct XLATensor::ParameterPlan {
+  struct Leaf {
+    // The index, within the sync indices, of the tensor whose IR graph the
+    // leaf is reached from.
+    size_t root = 0;
+    // The operand indices to follow, starting from the root node.
+    std::vector<uint32_t> path;
+    // The computation parameter the leaf device data is bound to. Multiple
+    // leaves can be bound to the same parameter.
+    size_t parameter_index = 0;
+  };
+
+  std::vector<Leaf> leaves;
+  size_t num_parameters = 0;
+};
+
+std::shared_ptr<const XLATensor::ParameterPlan> XLATensor::BuildParameterPlan(
+    const std::vector<XLATensor>& tensors, absl::Span<const size_t> indices,
+    absl::Span<const xla::ComputationClient::DataPtr> parameters_data) {
+  std::unordered_map<xla::ComputationClient::Data::OpaqueHandle, size_t>
+      parameter_indices;
+  for (size_t i = 0; i < parameters_data.size(); ++i) {
+    parameter_indices.emplace(parameters_data[i]->GetOpaqueHandle(), i);
+  }
+  // Breadth first visit of the graphs, so that leaves get the shortest paths.
+  // For the root nodes, the parent is kNoParent and the operand field holds
+  // the root index.
+  static const size_t kNoParent = std::numeric_limits<size_t>::max();
+  struct Visit {
+    const ir::Node* node;
+    size_t parent;
+    uint32_t operand;
+  };
+  std::vector<Visit> visits;
+  std::unordered_set<const ir::Node*> visited;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const ir::Node* node = tensors.at(indices[i]).CurrentIrValue().node.get();
+    if (visited.insert(node).second) {
+      visits.push_back({node, kNoParent, static_cast<uint32_t>(i)});
+    }
+  }
+  auto plan = std::make_shared<ParameterPlan>();
+  plan->num_parameters = parameters_data.size();
+  for (size_t i = 0; i < visits.size(); ++i) {
+    const ir::Node* node = visits[i].node;
+    const ir::ops::DeviceData* device_data = ir::ops::DeviceData::Cast(node);
+    if (device_data != nullptr) {
+      auto it = parameter_indices.find(device_data->data()->GetOpaqueHandle());
+      XLA_CHECK(it != parameter_indices.end())
+          << "Device data leaf not found among parameters: " << *node;
+      ParameterPlan::Leaf leaf;
+      leaf.parameter_index = it->second;
+      size_t current = i;
+      for (; visits[current].parent != kNoParent;
+           current = visits[current].parent) {
+        leaf.path.push_back(visits[current].operand);
+      }
+      leaf.root = visits[current].operand;
+      std::reverse(leaf.path.begin(), leaf.path.end());
+      plan->leaves.push_back(std::move(leaf));
+    }
+    const auto& operands = node->operands();
+    for (size_t j = 0; j < operands.size(); ++j) {
+      if (visited.insert(operands[j].node).second) {
+        visits.push_back({operands[j].node, i, static_cast<uint32_t>(j)});
+      }
+    }
+  }
+  return plan;
+}
+
+bool XLATensor::FetchParametersWithPlan(
+    const ParameterPlan& plan, const std::vector<XLATensor>& tensors,
+    absl::Span<const size_t> indices,
+    std::vector<xla::ComputationClient::DataPtr>* parameters_data) {
+  std::vector<const ir::Node*> roots;
+  roots.reserve(indices.size());
+  for (auto index : indices) {
+    roots.push_back(tensors.at(index).CurrentIrValue().node.get());
+  }
+  std::vector<xla::ComputationClient::DataPtr> data(plan.num_parameters);
+  std::unordered_set<xla::ComputationClient::Data::OpaqueHandle> data_handles;
+  for (auto& leaf : plan.leaves) {
+    const ir::Node* node = roots.at(leaf.root);
+    for (auto operand_index : leaf.path) {
+      if (operand_index >= node->operands().size()) {
+        return false;
+      }
+      node = node->operand(operand_index).node;
+    }
+    const ir::ops::DeviceData* device_data = ir::ops::DeviceData::Cast(node);
+    if (device_data == nullptr) {
+      return false;
+    }
+    // The leaves bound to the same parameter must still share the same device
+    // data, and the ones bound to different parameters must not.
+    xla::ComputationClient::DataPtr& parameter = data[leaf.parameter_index];
+    xla::ComputationClient::Data::OpaqueHandle handle =
+        device_data->data()->GetOpaqueHandle();
+    if (parameter == nullptr) {
+      if (!data_handles.insert(handle).second) {
+        return false;
+      }
+      parameter = device_data->data();
+    } else if (parameter->GetOpaqueHandle() != handle) {
+      return false;
+    }
+  }
+  if (data_handles.size() != plan.num_parameters) {
+    return false;
+  }
+  *parameters_data = std::move(data);
+  return true;
+}
+
 std::vector<xla::ComputationClient::DataPtr> XLATensor::FetchParameters(
     const std::vector<XLATensor>& tensors, absl::Span<const size_t> indices,
     size_t* graph_size) {
@@ -1194,6 +1423,7 @@ std::shared_ptr<XLATensor::Async> XLATensor::ScheduleSyncTensorsGraph(
       std::move(cached_computation));
 
   auto syncfn = [async, hash = coll->hash]() {
+    xla::trace_events::TraceScope trace("ExecuteComputation", hash);
     xla::ComputationClient::ExecuteComputationOptions options;
     try {
       TF_VLOG(3) << "Executing IR graph hash " << hash << " on device "
@@ -1274,8 +1504,10 @@ void XLATensor::SyncLiveTensorsGraph(const Device* device,
 
 void XLATensor::MarkStep(const Device* device) {
   XLA_COUNTER("MarkStep", 1);
+  xla::trace_events::MarkStep();
   DeviceContextArena::Get()->ClearProfileData(device);
   ir::ScopePusher::ResetScopes();
+  ir::MarkNodeAllocationStep();
   g_tls_data.Reset();
 }
 
@@ -1387,11 +1619,11 @@ void XLATensor::BuildInputOutputAliases(const std::vector<XLATensor>& tensors,
   XLA_VALUE_METRIC("InputOutputAliasCount", alias_map.size());
 }
 
-XLATensor::CompilationResult XLATensor::Compile(
-    const std::vector<XLATensor>& tensors,
-    absl::Span<const std::string> devices, const SyncTensorCollection& coll) {
+XLATensor::LoweringResult XLATensor::Lower(
+    const std::vector<XLATensor>& tensors, const SyncTensorCollection& coll) {
   static const bool enable_aliasing =
       xla::sys_util::GetEnvBool("XLA_ENABLE_PARAM_ALIASING", false);
+  xla::trace_events::TraceScope trace("LowerTensorsGraph", coll.hash);
   xla::util::Unique<Device> unique_device;
   ir::LoweringContext lowering_ctx("SyncTensorsGraph");
   for (auto index : coll.indices) {
@@ -1429,32 +1661,132 @@ XLATensor::CompilationResult XLATensor::Compile(
   }
 
   xla::XlaComputation computation = ConsumeValue(lowering_ctx.Build());
+  std::vector<xla::ComputationClient::DataPtr> parameters_data =
+      lowering_ctx.GetParametersData();
+  XLA_CHECK_EQ(ConsumeValue(computation.GetProgramShape()).parameters_size(),
+               parameters_data.size());
+
+  return {/*device=*/*unique_device,
+          /*emitted_nodes=*/lowering_ctx.GetEmittedNodeCount(),
+          /*computation=*/std::move(computation),
+          /*parameters_data=*/std::move(parameters_data)};
+}
+
+std::shared_ptr<xla::ComputationClient::Computation> XLATensor::CompileLowered(
+    xla::XlaComputation computation, const Device& device,
+    absl::Span<const std::string> devices, size_t hash) {
+  xla::trace_events::TraceScope trace("CompileTensorsGraph", hash);
   xla::ProgramShape program_shape = ConsumeValue(computation.GetProgramShape());
   xla::Shape shape =
-      MakeShapeWithDeviceLayout(program_shape.result(), unique_device->hw_type);
+      MakeShapeWithDeviceLayout(program_shape.result(), device.hw_type);
 
   std::vector<xla::ComputationClient::CompileInstance> instances;
-  instances.push_back({std::move(computation), unique_device->ToString(),
+  instances.push_back({std::move(computation), device.ToString(),
                        xla::ComputationClient::Get()->GetCompilationDevices(
-                           unique_device->ToString(), devices),
+                           device.ToString(), devices),
                        &shape});
+  instances.back().graph_hash = hash;
 
-  TF_VLOG(3) << "Compiling IR graph hash " << coll.hash << " on device "
-             << coll.device << " ...";
+  TF_VLOG(3) << "Compiling IR graph hash " << hash << " on device "
+             << device.ToString() << " ...";
   std::vector<std::shared_ptr<xla::ComputationClient::Computation>>
       computations =
           xla::ComputationClient::Get()->Compile(std::move(instances));
-  TF_VLOG(3) << "Compiling IR graph hash " << coll.hash << " on device "
-             << coll.device << " done!";
+  TF_VLOG(3) << "Compiling IR graph hash " << hash << " on device "
+             << device.ToString() << " done!";
+  return std::move(computations.front());
+}
 
-  std::vector<xla::ComputationClient::DataPtr> parameters_data =
-      lowering_ctx.GetParametersData();
-  XLA_CHECK_EQ(program_shape.parameters_size(), parameters_data.size());
+XLATensor::CompilationResult XLATensor::Compile(
+    const std::vector<XLATensor>& tensors,
+    absl::Span<const std::string> devices, const SyncTensorCollection& coll) {
+  LoweringResult lowering = Lower(tensors, coll);
+  auto computation = CompileLowered(std::move(lowering.computation),
+                                    lowering.device, devices, coll.hash);
+  return {/*device=*/std::move(lowering.device),
+          /*emitted_nodes=*/lowering.emitted_nodes,
+          /*computation=*/std::move(computation),
+          /*parameters_data=*/std::move(lowering.parameters_data)};
+}
 
-  return {/*device=*/*unique_device,
-          /*emitted_nodes=*/lowering_ctx.GetEmittedNodeCount(),
-          /*computation=*/std::move(computations.front()),
-          /*parameters_data=*/std::move(parameters_data)};
+std::shared_ptr<XLATensor::Async> XLATensor::SyncTensorsGraphWhileCompiling(
+    std::vector<XLATensor>* tensors, absl::Span<const std::string> devices,
+    SyncTensorCollection* coll) {
+  if (PendingCompilations::Get()->Add(coll->hash)) {
+    XLA_COUNTER("BackgroundCompile", 1);
+    // The lowering needs to happen here, as the IR graphs rooted at the
+    // tensors can change as soon as we return. Only the actual compilation is
+    // moved to the background.
+    auto lowering = std::make_shared<LoweringResult>(Lower(*tensors, *coll));
+    size_t num_parameters = lowering->parameters_data.size();
+    lowering->parameters_data.clear();
+    auto compilefn = [lowering, num_parameters,
+                      devices = xla::util::ToVector<std::string>(devices),
+                      hash = coll->hash]() {
+      XLA_TIMED("BackgroundCompileTime");
+      try {
+        auto computation = CompileLowered(std::move(lowering->computation),
+                                          lowering->device, devices, hash);
+        GetComputationCache()->Add(
+            hash, std::make_shared<CachedComputation>(std::move(computation),
+                                                      num_parameters));
+        RecordCompilation(hash, /*compiled=*/true);
+      } catch (const std::exception& ex) {
+        // The hash is left out of the cache, so the next miss will retry (and
+        // surface the error if the synchronous path is used).
+        TF_LOG(ERROR) << "Background compilation of IR graph hash " << hash
+                      << " failed: " << ex.what();
+        XLA_COUNTER("BackgroundCompileFailed", 1);
+        RecordCompilation(hash, /*compiled=*/false);
+      }
+      PendingCompilations::Get()->Remove(hash);
+    };
+    xla::env::ScheduleCompileClosure(std::move(compilefn));
+  }
+
+  // While the compilation is in flight, execute the graph op-by-op. The
+  // op-by-op executor has its own cache of single node computations, which
+  // become hot quickly.
+  XLA_COUNTER("BackgroundCompileOpByOpSync", 1);
+  std::vector<ir::Value> roots = CollectRoots(*tensors, coll->indices);
+  auto tensors_data = FetchTensorData(tensors, coll->config, coll->indices);
+  std::shared_ptr<Async> async =
+      std::make_shared<Async>(coll, /*parameters_data=*/
+                              std::vector<xla::ComputationClient::DataPtr>(),
+                              std::move(tensors_data),
+                              /*cached_computation=*/nullptr);
+
+  auto syncfn = [async, roots = std::move(roots),
+                 devices = xla::util::ToVector<std::string>(devices),
+                 hash = coll->hash]() {
+    xla::trace_events::TraceScope trace("ExecuteOpByOp", hash);
+    try {
+      TF_VLOG(3) << "Executing (OpByOp) IR graph hash " << hash
+                 << " on device " << async->device << " ...";
+      std::vector<xla::ComputationClient::DataPtr> results =
+          OpByOpExecutor::Get()->Execute(roots, async->device, devices);
+      TF_VLOG(3) << "Executing (OpByOp) IR graph hash " << hash
+                 << " on device " << async->device << " done!";
+
+      for (size_t i = 0; i < results.size(); ++i) {
+        if (async->tensors_data[i] != nullptr) {
+          async->tensors_data[i]->Assign(*results[i]);
+        } else {
+          async->tensors_data[i] = std::move(results[i]);
+        }
+      }
+    } catch (...) {
+      // See comment in ScheduleSyncTensorsGraph() about exceptions surfacing.
+      std::exception_ptr exptr = std::current_exception();
+      for (auto& unlocker : async->unlocker) {
+        unlocker.SetStatus(exptr);
+      }
+      throw;
+    }
+  };
+
+  xla::env::ScheduleIoClosure(async->mwait.Completer(std::move(syncfn)));
+  return async;
 }
 
 std::shared_ptr<XLATensor::Async> XLATensor::SyncTensorsGraphInternal(
@@ -1464,6 +1796,7 @@ std::shared_ptr<XLATensor::Async> XLATensor::SyncTensorsGraphInternal(
   if (coll.indices.empty()) {
     return nullptr;
   }
+  xla::trace_events::TraceScope trace("SyncTensorsGraph", coll.hash);
   DebugUtil::SaveTensorsGraphInfo("ScheduleSyncTensorsGraph", *tensors,
                                   &coll.indices);
 
@@ -1471,8 +1804,29 @@ std::shared_ptr<XLATensor::Async> XLATensor::SyncTensorsGraphInternal(
   if (async != nullptr) {
     return async;
   }
+  // The steps run while compiling need the op-by-op executor, hence the
+  // chained execution support of the computation client.
+  static const bool background_compile = []() {
+    if (!xla::sys_util::GetEnvBool("XLA_BACKGROUND_COMPILE", false)) {
+      return false;
+    }
+    if (!xla::ComputationClient::Get()->SupportsExecuteChained()) {
+      TF_LOG(WARNING) << "XLA_BACKGROUND_COMPILE ignored, as the computation "
+                         "client does not support chained execution";
+      return false;
+    }
+    return true;
+  }();
+  if (background_compile) {
+    return SyncTensorsGraphWhileCompiling(tensors, devices, &coll);
+  }
 
+  xla::util::ExceptionCleanup compile_failed(
+      [hash = coll.hash](std::exception_ptr) {
+        RecordCompilation(hash, /*compiled=*/false);
+      });
   CompilationResult compile_result = Compile(*tensors, devices, coll);
+  compile_failed.Release();
 
   XLA_VALUE_METRIC("TensorsGraphSize", compile_result.emitted_nodes);
   TF_VLOG(5) << "TensorsGraphSize=" << compile_result.emitted_nodes;
@@ -1481,10 +1835,302 @@ std::shared_ptr<XLATensor::Async> XLATensor::SyncTensorsGraphInternal(
       std::move(compile_result.computation),
       compile_result.parameters_data.size());
   GetComputationCache()->Add(coll.hash, cached_computation);
+  RecordCompilation(coll.hash, /*compiled=*/true);
 
   return ScheduleSyncTensorsGraph(
       tensors, &coll, std::move(compile_result.parameters_data),
       compile_result.device.ToString(), std::move(cached_computation));
 }
 
+struct XLATensor::CapturedGraph {
+  // Tells where the data of a replayed output tensor comes from: a result of
+  // the computation, an input tensor, or the device data captured with the
+  // graph (in this order of precedence).
+  struct OutputBinding {
+    ssize_t result_index = -1;
+    ssize_t input_index = -1;
+    xla::ComputationClient::DataPtr data;
+    xla::Shape result_shape;
+    c10::optional<at::ScalarType> logical_element_type;
+  };
+
+  size_t hash = 0;
+  Device device;
+  ComputationCache::TypePtr cached_computation;
+  // For every computation parameter, the index of the input tensor feeding it,
+  // or -1 if it is fed by the captured parameters_data entry.
+  std::vector<ssize_t> parameter_inputs;
+  std::vector<xla::ComputationClient::DataPtr> parameters_data;
+  std::vector<xla::Shape> input_shapes;
+  std::vector<at::ScalarType> input_types;
+  std::vector<OutputBinding> outputs;
+  std::vector<size_t> result_outputs;
+  std::atomic<size_t> replays{0};
+  // Set once a later capture diverged from this graph, which must not be
+  // replayed anymore.
+  std::atomic<bool> diverged{false};
+};
+
+xla::ComputationClient::DataPtr XLATensor::GetCapturedGraphData(
+    const XLATensor& tensor) {
+  ir::Value ir_value = tensor.CurrentIrValue();
+  if (ir_value) {
+    const ir::ops::DeviceData* device_data =
+        ir::ops::DeviceData::Cast(ir_value.node.get());
+    return device_data != nullptr ? device_data->data() : nullptr;
+  }
+  return tensor.CurrentXlaData();
+}
+
+std::shared_ptr<XLATensor::CapturedGraph> XLATensor::CaptureTensorsGraph(
+    std::vector<XLATensor>* outputs, const std::vector<XLATensor>& inputs,
+    CapturedGraph* previous) {
+  // The inputs data needs to be fetched before the sync, which replaces the
+  // data of the inputs tensors which are outputs as well.
+  std::vector<xla::ComputationClient::DataPtr> inputs_data;
+  inputs_data.reserve(inputs.size());
+  for (auto& input : inputs) {
+    inputs_data.push_back(GetCapturedGraphData(input));
+  }
+  SyncTensorsConfig config;
+  std::shared_ptr<Async> async = SyncTensorsGraphInternal(outputs, {}, config);
+  if (async == nullptr) {
+    XLA_COUNTER("GraphCaptureFailed", 1);
+    TF_VLOG(3) << "No graph to capture";
+    return nullptr;
+  }
+  async->mwait.Wait();
+  if (async->cached_computation == nullptr) {
+    XLA_COUNTER("GraphCaptureFailed", 1);
+    TF_VLOG(3) << "Graph hash " << async->hash << " is being compiled";
+    return nullptr;
+  }
+  const xla::ComputationClient::Computation& computation =
+      *async->cached_computation->computation;
+  if (computation.computation().proto().input_output_alias().entries_size() >
+      0) {
+    // Aliased parameters are donated to the results, which would leave the
+    // inputs tensors of a replay without data.
+    XLA_COUNTER("GraphCaptureFailed", 1);
+    TF_VLOG(3) << "Graph hash " << async->hash
+               << " aliases parameters with results";
+    return nullptr;
+  }
+
+  auto graph = std::make_shared<CapturedGraph>();
+  graph->hash = async->hash;
+  graph->device = Device(async->device);
+  graph->cached_computation = async->cached_computation;
+  // Only immutable device data can stay bound to the graph. The data of
+  // tensors (like weights updated every step) and the device data cache
+  // entries (like scalars whose value changes among steps) would go stale.
+  auto refuse_mutable_data = [&](const char* kind, size_t index,
+                                 const xla::ComputationClient::Data& data) {
+    XLA_COUNTER("GraphCaptureFailed", 1);
+    XLA_COUNTER("GraphCaptureMutableParameter", 1);
+    bool tensor_data = dynamic_cast<DeviceDataInfo*>(data.info()) != nullptr;
+    TF_LOG(WARNING) << kind << " " << index << " of graph hash " << graph->hash
+                    << " is bound to "
+                    << (tensor_data ? "the data of a tensor" : "a scalar")
+                    << " (" << data.shape()
+                    << "), which needs to be passed as input for the graph to "
+                       "be captured";
+  };
+  // Handles are fetched only now that the sync completed, as inputs data can
+  // be the placeholders of a previous asynchronous sync.
+  std::unordered_map<xla::ComputationClient::Data::OpaqueHandle, size_t>
+      input_indices;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs_data[i] == nullptr) {
+      XLA_COUNTER("GraphCaptureFailed", 1);
+      TF_VLOG(3) << "Input " << i << " of graph hash " << graph->hash
+                 << " is defined by pending IR operations";
+      return nullptr;
+    }
+    input_indices.emplace(inputs_data[i]->GetOpaqueHandle(), i);
+    graph->input_shapes.push_back(inputs_data[i]->shape());
+    graph->input_types.push_back(inputs[i].dtype());
+  }
+  graph->parameters_data = async->parameters_data;
+  graph->parameter_inputs.assign(graph->parameters_data.size(), -1);
+  for (size_t i = 0; i < graph->parameters_data.size(); ++i) {
+    auto it =
+        input_indices.find(graph->parameters_data[i]->GetOpaqueHandle());
+    if (it != input_indices.end()) {
+      graph->parameter_inputs[i] = it->second;
+      // Do not keep the inputs data alive with the graph.
+      graph->parameters_data[i] = nullptr;
+    } else if (graph->parameters_data[i]->info() != nullptr) {
+      refuse_mutable_data("Parameter", i, *graph->parameters_data[i]);
+      return nullptr;
+    }
+  }
+  std::unordered_map<size_t, size_t> result_indices;
+  for (size_t i = 0; i < async->indices.size(); ++i) {
+    result_indices.emplace(async->indices[i], i);
+  }
+  graph->result_outputs.resize(async->indices.size());
+  for (size_t i = 0; i < outputs->size(); ++i) {
+    const XLATensor& output = (*outputs)[i];
+    CapturedGraph::OutputBinding binding;
+    binding.logical_element_type = output.data()->logical_element_type;
+    auto it = result_indices.find(i);
+    if (it != result_indices.end()) {
+      binding.result_index = it->second;
+      binding.result_shape = async->tensors_data[it->second]->shape();
+      graph->result_outputs[it->second] = i;
+    } else {
+      binding.data = GetCapturedGraphData(output);
+      XLA_CHECK(binding.data != nullptr)
+          << "Output " << i << " of graph hash " << graph->hash
+          << " has not been synced";
+      auto input_it = input_indices.find(binding.data->GetOpaqueHandle());
+      if (input_it != input_indices.end()) {
+        binding.input_index = input_it->second;
+        binding.data = nullptr;
+      } else if (binding.data->info() != nullptr) {
+        // Like a weight the step returns unchanged, which the replays would
+        // keep returning after it gets updated outside of the graph.
+        refuse_mutable_data("Output", i, *binding.data);
+        return nullptr;
+      }
+    }
+    graph->outputs.push_back(std::move(binding));
+  }
+  XLA_COUNTER("GraphCaptures", 1);
+  TF_VLOG(3) << "Captured graph hash " << graph->hash << " with "
+             << inputs.size() << " inputs and " << outputs->size()
+             << " outputs";
+
+  if (previous != nullptr) {
+    // Parameters not fed by inputs must still be fed by the same device data,
+    // otherwise the replays would have used stale values.
+    bool diverged = previous->hash != graph->hash ||
+                    previous->parameter_inputs != graph->parameter_inputs;
+    for (size_t i = 0; !diverged && i < graph->parameters_data.size(); ++i) {
+      diverged = graph->parameters_data[i] != nullptr &&
+                 graph->parameters_data[i]->GetOpaqueHandle() !=
+                     previous->parameters_data[i]->GetOpaqueHandle();
+    }
+    // And outputs must still be bound to the same results, inputs or device
+    // data.
+    diverged = diverged || previous->outputs.size() != graph->outputs.size();
+    for (size_t i = 0; !diverged && i < graph->outputs.size(); ++i) {
+      const CapturedGraph::OutputBinding& binding = graph->outputs[i];
+      const CapturedGraph::OutputBinding& previous_binding =
+          previous->outputs[i];
+      diverged =
+          binding.result_index != previous_binding.result_index ||
+          binding.input_index != previous_binding.input_index ||
+          (binding.data == nullptr) != (previous_binding.data == nullptr) ||
+          (binding.data != nullptr &&
+           binding.data->GetOpaqueHandle() !=
+               previous_binding.data->GetOpaqueHandle());
+    }
+    if (diverged) {
+      XLA_COUNTER("GraphReplayDiverged", 1);
+      TF_LOG(WARNING) << "Traced graph hash " << graph->hash
+                      << " diverged from the replayed graph hash "
+                      << previous->hash
+                      << ", replays since its last validation might have "
+                         "produced wrong results";
+      previous->diverged = true;
+    } else {
+      XLA_COUNTER("GraphReplayValidated", 1);
+    }
+  }
+  return graph;
+}
+
+bool XLATensor::ReplayTensorsGraph(CapturedGraph* graph,
+                                   const std::vector<XLATensor>& inputs,
+                                   std::vector<XLATensor>* outputs) {
+  static const size_t validate_steps =
+      xla::sys_util::GetEnvInt("XLA_GRAPH_REPLAY_VALIDATE_STEPS", 100);
+  xla::trace_events::TraceScope trace("ReplayTensorsGraph", graph->hash);
+  if (graph->diverged) {
+    XLA_COUNTER("GraphReplayRejected", 1);
+    TF_VLOG(3) << "Graph hash " << graph->hash << " diverged from the trace";
+    return false;
+  }
+  if (inputs.size() != graph->input_shapes.size()) {
+    XLA_COUNTER("GraphReplayInputMismatch", 1);
+    TF_VLOG(3) << "Graph hash " << graph->hash << " expects "
+               << graph->input_shapes.size() << " inputs, got "
+               << inputs.size();
+    return false;
+  }
+  std::vector<xla::ComputationClient::DataPtr> inputs_data;
+  inputs_data.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    XLATensor input = inputs[i];
+    if (input.GetDevice() != graph->device) {
+      XLA_COUNTER("GraphReplayInputMismatch", 1);
+      TF_VLOG(3) << "Input " << i << " of graph hash " << graph->hash
+                 << " is on device " << input.GetDevice() << ", expected "
+                 << graph->device;
+      return false;
+    }
+    xla::ComputationClient::DataPtr data = GetCapturedGraphData(input);
+    if (data == nullptr) {
+      XLA_COUNTER("GraphReplayInputSyncs", 1);
+      data = input.GetXlaData();
+    }
+    if (!xla::ShapeUtil::Equal(data->shape(), graph->input_shapes[i]) ||
+        input.dtype() != graph->input_types[i]) {
+      XLA_COUNTER("GraphReplayInputMismatch", 1);
+      TF_VLOG(3) << "Input " << i << " of graph hash " << graph->hash
+                 << " has shape " << data->shape() << ", expected "
+                 << graph->input_shapes[i];
+      return false;
+    }
+    inputs_data.push_back(std::move(data));
+  }
+  // Every validate_steps replays, the caller traces the step, so that the
+  // capture can check whether the graph diverged from the replayed one.
+  if (validate_steps > 0 &&
+      (graph->replays.fetch_add(1) + 1) % validate_steps == 0) {
+    XLA_COUNTER("GraphReplayValidations", 1);
+    return false;
+  }
+
+  std::vector<xla::ComputationClient::DataPtr> parameters_data =
+      graph->parameters_data;
+  for (size_t i = 0; i < parameters_data.size(); ++i) {
+    if (graph->parameter_inputs[i] >= 0) {
+      parameters_data[i] = inputs_data[graph->parameter_inputs[i]];
+    }
+  }
+  SyncTensorCollection coll;
+  coll.hash = graph->hash;
+  coll.device = graph->device.ToString();
+  coll.indices = graph->result_outputs;
+  {
+    XLA_TIMED("DeviceLockWait");
+    coll.unlocker = LockDevices({graph->device});
+  }
+  std::vector<xla::ComputationClient::DataPtr> tensors_data(
+      graph->result_outputs.size());
+  std::vector<XLATensor> replayed;
+  replayed.reserve(graph->outputs.size());
+  for (auto& binding : graph->outputs) {
+    xla::ComputationClient::DataPtr data;
+    if (binding.result_index >= 0) {
+      data = xla::ComputationClient::Get()->CreateDataPlaceholder(
+          coll.device, binding.result_shape);
+      tensors_data[binding.result_index] = data;
+    } else if (binding.input_index >= 0) {
+      data = inputs_data[binding.input_index];
+    } else {
+      data = binding.data;
+    }
+    replayed.push_back(Create(std::move(data), binding.logical_element_type));
+  }
+  XLA_COUNTER("GraphReplays", 1);
+  ScheduleSyncTensorsGraph(&coll, std::move(parameters_data),
+                           std::move(tensors_data), graph->cached_computation);
+  *outputs = std::move(replayed);
+  return true;
+}
+
 }  // namespace swift_xla
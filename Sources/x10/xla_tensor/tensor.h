@@ -174,6 +174,37 @@ class XLATensor {
   // If devices is empty, the wait will happen for all local devices.
   static void WaitDeviceOps(absl::Span<const std::string> devices);
 
+  // A step graph captured by CaptureTensorsGraph(). Defined in tensor.cpp.
+  struct CapturedGraph;
+
+  // Synchronously syncs the outputs tensors like SyncTensorsGraph(), and
+  // captures the executed computation, together with the bindings of its
+  // parameters to the device data of the inputs tensors, and of its results to
+  // the outputs tensors. Parameters not fed by any of the inputs, and outputs
+  // which are neither results nor inputs, keep the device data they had at
+  // capture time, which must be immutable: graphs reading or returning the
+  // data of tensors which are not among the inputs, or non special scalar
+  // values (which need to be passed as scalar tensors), are not captured.
+  // Returns nullptr if the graph cannot be captured (the outputs are synced
+  // anyway), like in those cases, when its computation is still being compiled
+  // in background, or when it aliases parameters with results.
+  // If previous is not null, the capture validates the step (the parameters
+  // and outputs bindings) against it, and if the traced graph diverged from the
+  // replayed one, previous is marked so that it will not be replayed anymore.
+  static std::shared_ptr<CapturedGraph> CaptureTensorsGraph(
+      std::vector<XLATensor>* outputs, const std::vector<XLATensor>& inputs,
+      CapturedGraph* previous);
+
+  // Runs a captured graph over new inputs tensors without tracing the step,
+  // storing into outputs the tensors whose data is asynchronously computed.
+  // Returns false if the inputs diverge from the captured ones (in number,
+  // device, shape or type), if the graph diverged from a later trace, or if
+  // the step is due for validation, in which case the caller needs to trace
+  // the step and capture it again.
+  static bool ReplayTensorsGraph(CapturedGraph* graph,
+                                 const std::vector<XLATensor>& inputs,
+                                 std::vector<XLATensor>* outputs);
+
   // Retrieves the CPU tensors behind the XLA tensors IR operations. All the
   // tensors must be on the same device.
   static std::vector<at::Tensor> GetTensors(std::vector<XLATensor>* tensors);
@@ -1194,6 +1225,18 @@ class XLATensor {
     std::vector<xla::ComputationClient::DataPtr> parameters_data;
   };
 
+  struct LoweringResult {
+    Device device;
+    size_t emitted_nodes = 0;
+    xla::XlaComputation computation;
+    std::vector<xla::ComputationClient::DataPtr> parameters_data;
+  };
+
+  // Describes where the device data leaves feeding the parameters of a cached
+  // computation are within the IR graphs, so that they can be fetched without
+  // walking the graphs. Defined in tensor.cpp.
+  struct ParameterPlan;
+
   struct CachedComputation {
     CachedComputation(
         std::shared_ptr<xla::ComputationClient::Computation> computation,
@@ -1202,9 +1245,12 @@ class XLATensor {
 
     std::shared_ptr<xla::ComputationClient::Computation> computation;
     size_t num_parameters;
+    // Built at the first cache hit. Must be accessed with std::atomic_load()
+    // and std::atomic_store(), as cached computations are shared by threads.
+    std::shared_ptr<const ParameterPlan> parameter_plan;
   };
 
-  using ComputationCache = xla::util::Cache<size_t, CachedComputation>;
+  using ComputationCache = xla::util::ShardedCache<size_t, CachedComputation>;
 
   struct Async {
     Async(SyncTensorCollection* coll,
@@ -1219,6 +1265,7 @@ class XLATensor {
     std::vector<xla::util::ExceptionCleanup> unlocker;
     std::vector<xla::ComputationClient::DataPtr> parameters_data;
     std::string device;
+    size_t hash = 0;
     ComputationCache::TypePtr cached_computation;
     std::vector<xla::ComputationClient::DataPtr> tensors_data;
   };
@@ -1374,6 +1421,27 @@ class XLATensor {
       const std::vector<XLATensor>& tensors, absl::Span<const size_t> indices,
       size_t* graph_size);
 
+  static std::shared_ptr<const ParameterPlan> BuildParameterPlan(
+      const std::vector<XLATensor>& tensors, absl::Span<const size_t> indices,
+      absl::Span<const xla::ComputationClient::DataPtr> parameters_data);
+
+  // Fetches the parameters by following the plan. Returns false if the IR
+  // graphs do not match the plan, in which case the parameters need to be
+  // fetched with FetchParameters().
+  static bool FetchParametersWithPlan(
+      const ParameterPlan& plan, const std::vector<XLATensor>& tensors,
+      absl::Span<const size_t> indices,
+      std::vector<xla::ComputationClient::DataPtr>* parameters_data);
+
+  // Feeds the compilation cache misses to the RecompileDiagnostics, if enabled.
+  static void RecordCacheMiss(const std::vector<XLATensor>& tensors,
+                              size_t hash, absl::Span<const size_t> indices,
+                              bool parameter_mismatch);
+
+  // Feeds the end of the compilation of a graph which missed the cache to the
+  // RecompileDiagnostics, if enabled.
+  static void RecordCompilation(size_t hash, bool compiled);
+
   static ComputationCache::TypePtr LookupCachedCompile(
       const std::vector<XLATensor>& tensors, size_t hash,
       absl::Span<const size_t> indices,
@@ -1386,14 +1454,37 @@ class XLATensor {
                                       absl::Span<const size_t> indices,
                                       ir::LoweringContext* lowering_ctx);
 
+  // Lowers the IR graphs rooted at the tensors selected by coll into an XLA
+  // computation.
+  static LoweringResult Lower(const std::vector<XLATensor>& tensors,
+                              const SyncTensorCollection& coll);
+
+  static std::shared_ptr<xla::ComputationClient::Computation> CompileLowered(
+      xla::XlaComputation computation, const Device& device,
+      absl::Span<const std::string> devices, size_t hash);
+
   static CompilationResult Compile(const std::vector<XLATensor>& tensors,
                                    absl::Span<const std::string> devices,
                                    const SyncTensorCollection& coll);
 
+  // Used on compilation cache misses when XLA_BACKGROUND_COMPILE is set. The
+  // graph compilation is scheduled in background (if not already pending),
+  // and the current sync is run using the op-by-op executor. Once the
+  // compilation completes, the computation is added to the compilation cache
+  // and the following syncs will pick it up.
+  static std::shared_ptr<Async> SyncTensorsGraphWhileCompiling(
+      std::vector<XLATensor>* tensors, absl::Span<const std::string> devices,
+      SyncTensorCollection* coll);
+
   static std::shared_ptr<Async> SyncTensorsGraphInternal(
       std::vector<XLATensor>* tensors, absl::Span<const std::string> devices,
       const SyncTensorsConfig& config);
 
+  // Retrieves the device data a captured graph binds to the tensor, which is
+  // nullptr if the tensor value is defined by pending IR operations.
+  static xla::ComputationClient::DataPtr GetCapturedGraphData(
+      const XLATensor& tensor);
+
   static xla::int64 GetNextTensorId();
 
   std::shared_ptr<Data> data_;
@@ -19,15 +19,20 @@
 #include <list>
 #include <numeric>
 #include <thread>
+#include <type_traits>
 
+#include "absl/memory/memory.h"
 #include "tensorflow/compiler/xla/xla_client/debug_macros.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
 #include "tensorflow/compiler/xla/xla_client/multi_wait.h"
 #include "tensorflow/compiler/xla/xla_client/sys_util.h"
 #include "tensorflow/compiler/xla/xla_client/tf_logging.h"
 #include "tensorflow/compiler/xla/xla_client/thread_pool.h"
 #include "tensorflow/compiler/xla/xla_client/util.h"
+#include "tensorflow/compiler/tf2xla/xla_tensor/copy_kernels.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/helpers.h"
 #include "tensorflow/compiler/tf2xla/xla_tensor/layout_manager.h"
+#include "tensorflow/compiler/xla/layout_util.h"
 #include "tensorflow/compiler/xla/literal_util.h"
 #include "tensorflow/compiler/xla/shape_util.h"
 #include "tensorflow/core/lib/bfloat16/bfloat16.h"
@@ -152,6 +157,20 @@ struct NeedCast<at::BFloat16> {
   static constexpr bool value = true;
 };
 
+// Whether values can be moved from S to D by copying their bits.
+template <typename S, typename D>
+struct SameRepresentation {
+  static constexpr bool value = std::is_same<S, D>::value;
+};
+template <>
+struct SameRepresentation<tensorflow::bfloat16, at::BFloat16> {
+  static constexpr bool value = true;
+};
+template <>
+struct SameRepresentation<at::BFloat16, tensorflow::bfloat16> {
+  static constexpr bool value = true;
+};
+
 template <bool CAST>
 struct CopyType {
   using type = CopyDirect;
@@ -189,6 +208,24 @@ void CopyData<tensorflow::bfloat16, at::BFloat16>(tensorflow::bfloat16* dest,
                 "Mismatching size for bfloat16 types");
   std::memcpy(dest, source, n * sizeof(at::BFloat16));
 }
+// The float <-> bfloat16 conversions are the most common casts (with
+// XLA_USE_BF16), so they go through the vectorized kernels.
+template <>
+void CopyData<tensorflow::bfloat16, float>(tensorflow::bfloat16* dest,
+                                           const float* source, xla::int64 n,
+                                           const CopyCasted&) {
+  static_assert(sizeof(tensorflow::bfloat16) == sizeof(xla::uint16),
+                "Unexpected size for bfloat16 type");
+  FloatToBFloat16(source, reinterpret_cast<xla::uint16*>(dest), n);
+}
+template <>
+void CopyData<float, tensorflow::bfloat16>(float* dest,
+                                           const tensorflow::bfloat16* source,
+                                           xla::int64 n, const CopyCasted&) {
+  static_assert(sizeof(tensorflow::bfloat16) == sizeof(xla::uint16),
+                "Unexpected size for bfloat16 type");
+  BFloat16ToFloat(reinterpret_cast<const xla::uint16*>(source), dest, n);
+}
 
 std::vector<xla::int64> GetIterationDimensions(const xla::Shape& shape) {
   // We want to favor the most minor dimension as core iteration dimension, as
@@ -267,8 +304,9 @@ void SlicedCopy(absl::Span<const xla::int64> dimensions, const SType* src_data,
   std::vector<xla::int64> indices(part.base);
   xla::int64 inner_src_stride = src_strides[iter_dims.front()];
   xla::int64 inner_dest_stride = dest_strides[iter_dims.front()];
+  xla::int64 num_dims = indices.size();
   xla::int64 n = 0;
-  while (n < indices.size()) {
+  while (n < num_dims) {
     StridedCopy(dest_data + GetFlatTensorOffset(dest_strides, indices),
                 inner_dest_stride,
                 src_data + GetFlatTensorOffset(src_strides, indices),
@@ -284,6 +322,39 @@ void SlicedCopy(absl::Span<const xla::int64> dimensions, const SType* src_data,
   }
 }
 
+// Copies the partition as a batch of 2D transposes, for source and destination
+// layouts whose most minor dimensions (src_minor and dest_minor) differ. Only
+// valid for types with the same representation.
+template <typename SType, typename DType>
+void TransposedCopy(const SType* src_data,
+                    absl::Span<const xla::int64> src_strides, DType* dest_data,
+                    absl::Span<const xla::int64> dest_strides,
+                    xla::int64 src_minor, xla::int64 dest_minor,
+                    const CopyPartition& part) {
+  static_assert(sizeof(SType) == sizeof(DType), "Mismatching type sizes");
+  std::vector<xla::int64> indices(part.base);
+  xla::int64 rows = part.limit[dest_minor] - part.base[dest_minor];
+  xla::int64 cols = part.limit[src_minor] - part.base[src_minor];
+  xla::int64 num_dims = indices.size();
+  xla::int64 n = 0;
+  while (n < num_dims) {
+    TransposeCopy(src_data + GetFlatTensorOffset(src_strides, indices),
+                  src_strides[dest_minor],
+                  dest_data + GetFlatTensorOffset(dest_strides, indices),
+                  dest_strides[src_minor], rows, cols, sizeof(DType));
+    for (n = 0; n < num_dims; ++n) {
+      if (n == src_minor || n == dest_minor) {
+        continue;
+      }
+      indices[n] += 1;
+      if (indices[n] < part.limit[n]) {
+        break;
+      }
+      indices[n] = part.base[n];
+    }
+  }
+}
+
 template <typename SType, typename DType>
 void CopyTensors(const void* src_buffer, const xla::Shape& src_shape,
                  void* dest_buffer, size_t dest_buffer_size,
@@ -310,11 +381,25 @@ void CopyTensors(const void* src_buffer, const xla::Shape& src_shape,
     std::vector<xla::int64> iter_dims = GetIterationDimensions(dest_shape);
     std::vector<CopyPartition> parts =
         CreateCopyPartitions(dest_shape.dimensions(), iter_dims.front());
+    // When the two layouts have different minor dimensions, and no value
+    // conversion is needed, the copy is a batch of transposes which the cache
+    // blocked (and SIMD) kernels handle much faster than strided loops.
+    xla::int64 src_minor = src_shape.layout().minor_to_major(0);
+    xla::int64 dest_minor = dest_shape.layout().minor_to_major(0);
+    bool transposed =
+        SameRepresentation<SType, DType>::value && src_minor != dest_minor;
     xla::util::MultiWait mwait(parts.size());
     for (size_t i = 0; i < parts.size(); ++i) {
       auto copy_fn = [&, i]() {
-        SlicedCopy<SType, DType>(dest_shape.dimensions(), src_data, src_strides,
-                                 dest_data, dest_strides, iter_dims, parts[i]);
+        if (transposed) {
+          TransposedCopy<SType, DType>(src_data, src_strides, dest_data,
+                                       dest_strides, src_minor, dest_minor,
+                                       parts[i]);
+        } else {
+          SlicedCopy<SType, DType>(dest_shape.dimensions(), src_data,
+                                   src_strides, dest_data, dest_strides,
+                                   iter_dims, parts[i]);
+        }
       };
       xla::env::ScheduleClosure(mwait.Completer(std::move(copy_fn)));
     }
@@ -435,6 +520,7 @@ at::Tensor XlaLiteralToTensor(const xla::Literal& literal,
   xla::int64 total_elements = xla::ShapeUtil::ElementsIn(swift_shape);
 
   const auto literal_data = literal.data<SType>();
+  XLA_COUNTER("LiteralToTensorCopiedBytes", total_elements * sizeof(DType));
   std::unique_ptr<DType[]> data(new DType[total_elements]);
   CopyTensors<SType, DType>(literal_data.data(), literal.shape(), data.get(),
                             total_elements * sizeof(DType), swift_shape);
@@ -469,6 +555,59 @@ at::Tensor XlaLiteralToTensorHelper(const xla::Literal& literal,
   }
 }
 
+// Moves the literal into an at::Tensor whose storage is the literal buffer, if
+// the literal holds DType values (whose XLA type is type) in the at::Tensor
+// layout. Otherwise returns an empty tensor and leaves the literal untouched.
+template <typename DType>
+c10::optional<at::Tensor> AdoptXlaLiteral(xla::Literal* literal,
+                                          xla::PrimitiveType type) {
+  const xla::Shape& shape = literal->shape();
+  if (shape.element_type() != type || !shape.is_static()) {
+    return absl::nullopt;
+  }
+  xla::Shape swift_shape =
+      MakeSwiftTensorLayout(shape.dimensions(), /*dynamic_dimensions=*/{},
+                            shape.element_type());
+  if (!xla::LayoutUtil::Equal(shape.layout(), swift_shape.layout())) {
+    return absl::nullopt;
+  }
+  std::vector<int64_t> dimensions =
+      xla::util::ToVector<int64_t>(shape.dimensions());
+  auto owner = std::make_shared<xla::Literal>(std::move(*literal));
+  xla::int64 total_elements = owner->element_count();
+  const DType* data = static_cast<const DType*>(owner->untyped_data());
+  XLA_COUNTER("LiteralToTensorAdoptedBytes", total_elements * sizeof(DType));
+  return at::Tensor(absl::make_unique<at::SharedAnyScalarBuffer<DType>>(
+                        std::move(owner), data, total_elements),
+                    std::move(dimensions));
+}
+
+c10::optional<at::Tensor> AdoptXlaLiteral(xla::Literal* literal,
+                                          at::ScalarType dest_element_type) {
+  switch (dest_element_type) {
+    case at::ScalarType::Bool:
+      return AdoptXlaLiteral<bool>(literal, xla::PrimitiveType::PRED);
+    case at::ScalarType::Byte:
+      return AdoptXlaLiteral<uint8_t>(literal, xla::PrimitiveType::U8);
+    case at::ScalarType::Char:
+      return AdoptXlaLiteral<int8_t>(literal, xla::PrimitiveType::S8);
+    case at::ScalarType::Short:
+      return AdoptXlaLiteral<int16_t>(literal, xla::PrimitiveType::S16);
+    case at::ScalarType::Int:
+      return AdoptXlaLiteral<int32_t>(literal, xla::PrimitiveType::S32);
+    case at::ScalarType::Long:
+      return AdoptXlaLiteral<int64_t>(literal, xla::PrimitiveType::S64);
+    case at::ScalarType::Float:
+      return AdoptXlaLiteral<float>(literal, xla::PrimitiveType::F32);
+    case at::ScalarType::Double:
+      return AdoptXlaLiteral<double>(literal, xla::PrimitiveType::F64);
+    case at::ScalarType::BFloat16:
+      return AdoptXlaLiteral<at::BFloat16>(literal, xla::PrimitiveType::BF16);
+    default:
+      return absl::nullopt;
+  }
+}
+
 }  // namespace
 
 std::vector<xla::int64> ComputeShapeStrides(const xla::Shape& shape) {
@@ -508,6 +647,17 @@ at::Tensor MakeTensorFromXlaLiteral(const xla::Literal& literal,
   }
 }
 
+at::Tensor MakeTensorFromXlaLiteral(xla::Literal&& literal,
+                                    at::ScalarType dest_element_type) {
+  c10::optional<at::Tensor> tensor =
+      AdoptXlaLiteral(&literal, dest_element_type);
+  if (tensor) {
+    return std::move(*tensor);
+  }
+  const xla::Literal& source = literal;
+  return MakeTensorFromXlaLiteral(source, dest_element_type);
+}
+
 xla::ComputationClient::TensorSource TensorToTensorSource(
     const at::Tensor& tensor, const Device& device) {
   const at::Tensor* tensor_ptr = &tensor;
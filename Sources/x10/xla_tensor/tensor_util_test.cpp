@@ -0,0 +1,127 @@
+// Copyright 2020 TensorFlow Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tensorflow/compiler/tf2xla/xla_tensor/tensor_util.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/compiler/xla/layout_util.h"
+#include "tensorflow/compiler/xla/literal_util.h"
+#include "tensorflow/compiler/xla/xla_client/metrics.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace swift_xla {
+namespace {
+
+xla::int64 CounterValue(const std::string& name) {
+  xla::metrics::CounterData* data = xla::metrics::GetCounter(name);
+  return data != nullptr ? data->Value() : 0;
+}
+
+template <typename T>
+std::vector<T> TensorValues(const at::Tensor& tensor) {
+  absl::Span<const T> data = tensor.data<T>();
+  return std::vector<T>(data.begin(), data.end());
+}
+
+TEST(TensorUtilTest, AdoptsMatchingLiteral) {
+  xla::Literal literal =
+      xla::LiteralUtil::CreateR2<float>({{1, 2, 3}, {4, 5, 6}});
+  const void* literal_data = literal.untyped_data();
+  xla::int64 adopted = CounterValue("LiteralToTensorAdoptedBytes");
+  xla::int64 copied = CounterValue("LiteralToTensorCopiedBytes");
+  at::Tensor tensor =
+      MakeTensorFromXlaLiteral(std::move(literal), at::ScalarType::Float);
+  // The tensor points at the literal buffer, which it keeps alive past the
+  // moved from literal.
+  EXPECT_EQ(tensor.data<float>().data(), literal_data);
+  literal = xla::Literal();
+  EXPECT_EQ(tensor.scalar_type(), at::ScalarType::Float);
+  EXPECT_EQ(tensor.shape(), std::vector<int64_t>({2, 3}));
+  EXPECT_EQ(TensorValues<float>(tensor),
+            std::vector<float>({1, 2, 3, 4, 5, 6}));
+  EXPECT_EQ(CounterValue("LiteralToTensorAdoptedBytes"),
+            adopted + 6 * sizeof(float));
+  EXPECT_EQ(CounterValue("LiteralToTensorCopiedBytes"), copied);
+
+  // Copies of the tensor share the adopted storage.
+  at::Tensor copy = tensor;
+  tensor = at::Tensor(std::vector<float>({0}), {1});
+  EXPECT_EQ(TensorValues<float>(copy), std::vector<float>({1, 2, 3, 4, 5, 6}));
+}
+
+TEST(TensorUtilTest, AdoptsScalarAndIntegerLiterals) {
+  xla::int64 copied = CounterValue("LiteralToTensorCopiedBytes");
+  at::Tensor scalar = MakeTensorFromXlaLiteral(
+      xla::LiteralUtil::CreateR0<double>(2.5), at::ScalarType::Double);
+  EXPECT_TRUE(scalar.shape().empty());
+  EXPECT_EQ(TensorValues<double>(scalar), std::vector<double>({2.5}));
+
+  at::Tensor ints = MakeTensorFromXlaLiteral(
+      xla::LiteralUtil::CreateR1<int64_t>({-1, 7, 1LL << 40}),
+      at::ScalarType::Long);
+  EXPECT_EQ(TensorValues<int64_t>(ints),
+            std::vector<int64_t>({-1, 7, 1LL << 40}));
+
+  at::Tensor preds = MakeTensorFromXlaLiteral(
+      xla::LiteralUtil::CreateR1<bool>({true, false}), at::ScalarType::Bool);
+  EXPECT_EQ(TensorValues<bool>(preds), std::vector<bool>({true, false}));
+  EXPECT_EQ(CounterValue("LiteralToTensorCopiedBytes"), copied);
+}
+
+TEST(TensorUtilTest, CopiesMismatchingElementType) {
+  xla::Literal literal = xla::LiteralUtil::CreateR1<int32_t>({1, -2, 3});
+  xla::int64 adopted = CounterValue("LiteralToTensorAdoptedBytes");
+  xla::int64 copied = CounterValue("LiteralToTensorCopiedBytes");
+  at::Tensor tensor =
+      MakeTensorFromXlaLiteral(std::move(literal), at::ScalarType::Float);
+  EXPECT_EQ(tensor.scalar_type(), at::ScalarType::Float);
+  EXPECT_EQ(TensorValues<float>(tensor), std::vector<float>({1, -2, 3}));
+  EXPECT_EQ(CounterValue("LiteralToTensorAdoptedBytes"), adopted);
+  EXPECT_EQ(CounterValue("LiteralToTensorCopiedBytes"),
+            copied + 3 * sizeof(float));
+}
+
+TEST(TensorUtilTest, CopiesMismatchingLayout) {
+  xla::Literal literal =
+      xla::LiteralUtil::CreateR2<float>({{1, 2, 3}, {4, 5, 6}})
+          .Relayout(xla::LayoutUtil::MakeLayout({0, 1}));
+  const void* literal_data = literal.untyped_data();
+  xla::int64 adopted = CounterValue("LiteralToTensorAdoptedBytes");
+  xla::int64 copied = CounterValue("LiteralToTensorCopiedBytes");
+  at::Tensor tensor =
+      MakeTensorFromXlaLiteral(std::move(literal), at::ScalarType::Float);
+  // The dim1-major literal is transposed into the at::Tensor layout.
+  EXPECT_NE(tensor.data<float>().data(), literal_data);
+  EXPECT_EQ(tensor.shape(), std::vector<int64_t>({2, 3}));
+  EXPECT_EQ(TensorValues<float>(tensor),
+            std::vector<float>({1, 2, 3, 4, 5, 6}));
+  EXPECT_EQ(CounterValue("LiteralToTensorAdoptedBytes"), adopted);
+  EXPECT_EQ(CounterValue("LiteralToTensorCopiedBytes"),
+            copied + 6 * sizeof(float));
+}
+
+TEST(TensorUtilTest, ConstLiteralIsCopied) {
+  const xla::Literal literal = xla::LiteralUtil::CreateR1<float>({1, 2});
+  xla::int64 adopted = CounterValue("LiteralToTensorAdoptedBytes");
+  at::Tensor tensor = MakeTensorFromXlaLiteral(literal, at::ScalarType::Float);
+  EXPECT_NE(tensor.data<float>().data(), literal.untyped_data());
+  EXPECT_EQ(TensorValues<float>(tensor), std::vector<float>({1, 2}));
+  EXPECT_EQ(CounterValue("LiteralToTensorAdoptedBytes"), adopted);
+}
+
+}  // namespace
+}  // namespace swift_xla